@@ -0,0 +1,197 @@
+/*
+    log calls/s of logging threads writing to a file: logfmt formatting on the logging thread, the LOG_*
+    macros formatting on the writer, and binary log file. checks every line is written or counted as
+    dropped, and files are rotated by size.
+    usage: log_benchmark [threads] [logs per thread]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include "common/log.hpp"
+#include "common/exception.hpp"
+
+using namespace moon;
+
+static const char* dir = "/tmp/log_benchmark";
+
+static double run(moon::log& logger, int threads, int count)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&logger, t, count]() {
+            for (int i = 0; i < count; ++i)
+            {
+                logger.logfmt(false, LogLevel::Info, "worker %d handle message %d, session %d, size %d", t, i, i * 7, 128);
+            }
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    //calls/s seen by the logging threads, the writer may still be writing
+    return threads * static_cast<double>(count) / std::chrono::duration<double>(end - begin).count();
+}
+
+//packed arguments, formatted by the writer
+static double run_defer(moon::log& logger, int threads, int count)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&logger, t, count]() {
+            auto l = &logger;
+            for (int i = 0; i < count; ++i)
+            {
+                LOG_INFO(l, "worker %d handle message %d, session %d, size %d", t, i, i * 7, 128);
+            }
+        });
+    }
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return threads * static_cast<double>(count) / std::chrono::duration<double>(end - begin).count();
+}
+
+//packed entries of a binary log file, -1: malformed
+static int64_t count_entries(const std::string& file)
+{
+    std::FILE* fp = std::fopen(file.data(), "rb");
+    char magic[sizeof(log_format::FILE_MAGIC)];
+    int64_t n = 0;
+    if (std::fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, log_format::FILE_MAGIC, sizeof(magic)) != 0)
+    {
+        n = -1;
+    }
+    log_format::entry_head head;
+    std::vector<char> payload;
+    while (n >= 0 && std::fread(&head, 1, sizeof(head), fp) == sizeof(head))
+    {
+        payload.resize(head.size);
+        if (std::fread(payload.data(), 1, head.size, fp) != head.size)
+        {
+            n = -1;
+            break;
+        }
+        n += (head.type == log_format::entry_type::packed);
+    }
+    std::fclose(fp);
+    return n;
+}
+
+//lines of all files in dir
+static size_t count_lines()
+{
+    size_t n = 0;
+    for (auto& e : fs::directory_iterator(dir))
+    {
+        std::FILE* fp = std::fopen(e.path().string().data(), "rb");
+        char buf[64 * 1024];
+        size_t len = 0;
+        while ((len = std::fread(buf, 1, sizeof(buf), fp)) > 0)
+        {
+            for (size_t i = 0; i < len; ++i)
+            {
+                n += (buf[i] == '\n');
+            }
+        }
+        std::fclose(fp);
+    }
+    return n;
+}
+
+static size_t count_files()
+{
+    size_t n = 0;
+    for (auto& e : fs::directory_iterator(dir))
+    {
+        (void)e;
+        ++n;
+    }
+    return n;
+}
+
+int main(int argc, char* argv[])
+{
+    int threads = (argc > 1) ? std::atoi(argv[1]) : 16;
+    int count = (argc > 2) ? std::atoi(argv[2]) : 100000;
+    std::string file = std::string(dir) + "/bench.log";
+    size_t total = static_cast<size_t>(threads) * count;
+    int res = 0;
+
+    {
+        fs::remove_all(dir);
+        moon::log logger;
+        logger.init(file);
+        double n = run(logger, threads, count);
+        logger.wait();
+        size_t lines = count_lines();
+        printf("log: %d threads, %.0f calls/s, %zu lines, %zu dropped\n", threads, n, lines, logger.dropped());
+        if (lines != total || logger.dropped() != 0)
+        {
+            printf("log lost lines\n");
+            res = 1;
+        }
+    }
+
+    {
+        fs::remove_all(dir);
+        moon::log logger;
+        logger.init(file);
+        double n = run_defer(logger, threads, count);
+        logger.wait();
+        size_t lines = count_lines();
+        printf("log deferred format: %d threads, %.0f calls/s, %zu lines, %zu dropped\n", threads, n, lines, logger.dropped());
+        if (lines != total || logger.dropped() != 0)
+        {
+            printf("log lost lines\n");
+            res = 1;
+        }
+    }
+
+    {
+        fs::remove_all(dir);
+        moon::log logger;
+        logger.set_binary(true);
+        logger.init(file);
+        double n = run_defer(logger, threads, count);
+        logger.wait();
+        int64_t entries = count_entries(file);
+        printf("log binary: %d threads, %.0f calls/s, %lld entries, %zu bytes\n", threads, n, static_cast<long long>(entries), static_cast<size_t>(fs::file_size(file)));
+        if (entries != static_cast<int64_t>(total))
+        {
+            printf("log lost entries\n");
+            res = 1;
+        }
+    }
+
+    {
+        //overload: info is dropped instead of waiting for the writer
+        fs::remove_all(dir);
+        moon::log logger;
+        logger.set_drop_level("INFO");
+        logger.set_rotate(4 * 1024 * 1024, 0);
+        logger.init(file);
+        double n = run(logger, threads, count);
+        logger.wait();
+        size_t lines = count_lines();
+        size_t files = count_files();
+        //lines of dropped reports are counted too
+        printf("log drop info, rotate 4MB: %d threads, %.0f calls/s, %zu lines, %zu dropped, %zu files\n", threads, n, lines, logger.dropped(), files);
+        if (lines < total - logger.dropped() || (lines * 100 > 4 * 1024 * 1024 * 2 && files < 2))
+        {
+            printf("log lost lines or not rotated\n");
+            res = 1;
+        }
+    }
+    fs::remove_all(dir);
+    return res;
+}
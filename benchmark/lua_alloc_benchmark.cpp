@@ -0,0 +1,271 @@
+/*
+    lua state allocator: system realloc vs slab_allocator, used the same way as lua_service::lalloc.
+    Every thread runs SLOTS lua states like services of a worker, threads are started again
+    each hour so states also move between threads like pooled services. Each state keeps a random
+    size long-lived data set and handles messages producing garbage, states are replaced
+    (service exit and new service) at random. One simulated hour is ROUNDS_PER_HOUR messages
+    per thread. Reports throughput, and each hour the process RSS against lua live memory:
+    the difference is allocator overhead and fragmentation.
+    Run each allocator in its own process, RSS is not returned to the OS between runs.
+    usage: lua_alloc_benchmark slab|system [threads] [hours]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <random>
+#include <vector>
+#include <memory>
+#include "common/slab_allocator.hpp"
+#include "lua.hpp"
+
+extern "C" {
+#include "lua53/lstring.h"
+}
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+using namespace moon;
+
+static constexpr size_t SLOTS = 16;
+static constexpr size_t ROUNDS_PER_HOUR = 20000;
+
+static bool use_slab = true;
+static std::atomic<int64_t> live_bytes{ 0 };
+static std::atomic<int64_t> messages{ 0 };
+
+struct state_ud
+{
+    slab_allocator allocator;
+    int64_t mem = 0;
+};
+
+static void* lalloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+    auto s = static_cast<state_ud*>(ud);
+    int64_t diff = static_cast<int64_t>(nsize) - (ptr ? static_cast<int64_t>(osize) : 0);
+    void* res = nullptr;
+    if (use_slab)
+    {
+        if (nsize == 0)
+        {
+            s->allocator.deallocate(ptr, osize);
+        }
+        else
+        {
+            res = s->allocator.reallocate(ptr, ptr ? osize : 0, nsize);
+        }
+    }
+    else
+    {
+        if (nsize == 0)
+        {
+            free(ptr);
+        }
+        else
+        {
+            res = realloc(ptr, nsize);
+        }
+    }
+
+    if (nsize == 0 || res != nullptr)
+    {
+        s->mem += diff;
+        live_bytes += diff;
+    }
+    return res;
+}
+
+static const char* script = R"(
+local live = {}
+local nlive = 0
+local seq = 0
+
+local function make(i)
+    local k = i % 4
+    if k == 0 then
+        return {id = i, name = "obj" .. i, hp = i * 3, pos = {x = i, y = -i}}
+    elseif k == 1 then
+        return string.rep("s", 16 + i % 200) .. i
+    elseif k == 2 then
+        local v = i
+        return function() return v end
+    else
+        local t = {}
+        for j = 1, i % 32 do t[j] = j end
+        return t
+    end
+end
+
+function setup(n)
+    for i = 1, n do
+        live[i] = make(i)
+    end
+    nlive = n
+end
+
+function handle(r)
+    seq = seq + 1
+    --request decode and response encode garbage
+    local req = {cmd = "move", seq = seq, args = {r, r + 1, "target" .. r}}
+    local parts = {}
+    for i = 1, 8 + r % 24 do
+        parts[i] = tostring(req.seq + i)
+    end
+    local rsp = table.concat(parts, ",")
+    --mutate long-lived data
+    if nlive > 0 then
+        local idx = r % nlive + 1
+        live[idx] = make(r + seq)
+    end
+    return #rsp
+end
+)";
+
+struct slot
+{
+    std::unique_ptr<state_ud> ud;
+    lua_State* L = nullptr;
+};
+
+static void close_slot(slot& s)
+{
+    if (s.L != nullptr)
+    {
+        lua_close(s.L);
+        s.L = nullptr;
+    }
+    s.ud.reset();
+}
+
+static void open_slot(slot& s, int nlive)
+{
+    s.ud = std::make_unique<state_ud>();
+    s.L = lua_newstate(lalloc, s.ud.get());
+    luaL_openlibs(s.L);
+    if (luaL_dostring(s.L, script) != LUA_OK)
+    {
+        printf("%s\n", lua_tostring(s.L, -1));
+        exit(1);
+    }
+    lua_getglobal(s.L, "setup");
+    lua_pushinteger(s.L, nlive);
+    lua_call(s.L, 1, 0);
+}
+
+static double rss_mb()
+{
+#if defined(__linux__)
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f == nullptr)
+    {
+        return 0;
+    }
+    long size = 0, resident = 0;
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+    {
+        resident = 0;
+    }
+    fclose(f);
+    return static_cast<double>(resident) * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+#else
+    return 0;
+#endif
+}
+
+static void run_hour(std::vector<slot>& slots, std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> pick(0, static_cast<int>(slots.size()) - 1);
+    std::uniform_int_distribution<int> percent(0, 99);
+    //most services are small, a few hold large data
+    std::uniform_int_distribution<int> small(100, 3000);
+    std::uniform_int_distribution<int> large(20000, 60000);
+    for (size_t r = 0; r < ROUNDS_PER_HOUR; ++r)
+    {
+        auto& s = slots[pick(rng)];
+        if (s.L == nullptr || percent(rng) == 0)
+        {
+            close_slot(s);
+            open_slot(s, (percent(rng) < 10) ? large(rng) : small(rng));
+        }
+        lua_getglobal(s.L, "handle");
+        lua_pushinteger(s.L, static_cast<lua_Integer>(rng() % 100000));
+        lua_call(s.L, 1, 1);
+        lua_pop(s.L, 1);
+    }
+    messages += ROUNDS_PER_HOUR;
+}
+
+int main(int argc, char* argv[])
+{
+    use_slab = (argc < 2) || (strcmp(argv[1], "system") != 0);
+    int threads = (argc > 2) ? std::atoi(argv[2]) : 4;
+    int hours = (argc > 3) ? std::atoi(argv[3]) : 24;
+
+    luaS_initshr();
+
+    printf("allocator %s, threads %d\n", use_slab ? "slab" : "system", threads);
+    printf("%-6s %10s %10s %10s %12s %14s\n", "hour", "rss(MB)", "live(MB)", "rss/live", "slab use", "messages/s");
+
+    std::vector<std::vector<slot>> all(threads);
+    for (auto& v : all)
+    {
+        v.resize(SLOTS);
+    }
+
+    double total_sec = 0;
+    for (int h = 1; h <= hours; ++h)
+    {
+        messages = 0;
+        auto begin = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&all, t, h] {
+                std::mt19937 rng(static_cast<unsigned>(t * 7919 + h));
+                run_hour(all[t], rng);
+            });
+        }
+        for (auto& w : workers)
+        {
+            w.join();
+        }
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        total_sec += sec;
+
+        //small blocks in use / page memory of all slabs
+        double page_bytes = 0, small_bytes = 0;
+        for (auto& v : all)
+        {
+            for (auto& s : v)
+            {
+                if (s.ud)
+                {
+                    page_bytes += static_cast<double>(s.ud->allocator.page_bytes());
+                    small_bytes += static_cast<double>(s.ud->allocator.small_bytes());
+                }
+            }
+        }
+
+        double live = static_cast<double>(live_bytes.load()) / (1024.0 * 1024.0);
+        double rss = rss_mb();
+        printf("%-6d %10.1f %10.1f %10.2f %11.0f%% %14.0f\n", h, rss, live, (live > 0) ? rss / live : 0
+            , (page_bytes > 0) ? small_bytes * 100 / page_bytes : 0, messages.load() / sec);
+    }
+    printf("total %.2f s\n", total_sec);
+
+    //remaining states are closed by main thread
+    for (auto& v : all)
+    {
+        for (auto& s : v)
+        {
+            close_slot(s);
+        }
+    }
+    luaS_exitshr();
+    return 0;
+}
@@ -0,0 +1,123 @@
+/*
+    ownership of seri.pack/seri.concat buffer handles, build with -fsanitize=address:
+    a handle dropped without send must not leak, a handle sent twice must not double free.
+    usage: lua_buffer_handle_test
+*/
+#include <cstdio>
+#include "luabind/lua_buffer.hpp"
+
+extern "C" {
+#include "lua53/lstring.h"
+}
+
+using namespace moon;
+
+static std::vector<buffer_ptr_t> sent;
+
+//same as router::send gets the payload
+static int send(lua_State* L)
+{
+    sent.emplace_back(sol::stack::get<buffer_ptr_t>(L, 1));
+    return 0;
+}
+
+static int send_count(lua_State* L)
+{
+    lua_pushinteger(L, static_cast<lua_Integer>(sent.size()));
+    return 1;
+}
+
+//check payloads still alive after handles are collected, then release them
+static int check_sent(lua_State* L)
+{
+    size_t len = 0;
+    const char* s = luaL_checklstring(L, 1, &len);
+    for (auto& b : sent)
+    {
+        luaL_argcheck(L, b->size() == len && memcmp(b->data(), s, len) == 0, 1, "sent payload changed");
+    }
+    sent.clear();
+    return 0;
+}
+
+static const char* script = R"(
+local seri, send, send_count, check_sent, raw = ...
+local big = string.rep("x", 10000)
+
+-- dropped without send
+for _ = 1, 1000 do
+    local h = seri.pack(big)
+    assert(type(h) == "userdata" and #h > 10000)
+end
+collectgarbage()
+
+-- small payload is a string
+assert(type(seri.pack(1, 2, 3)) == "string")
+assert(select("#", seri.unpack(seri.pack(1, 2, 3))) == 3)
+
+-- sent twice, payload outlives the handle
+local h = seri.pack(big)
+send(h)
+send(h)
+assert(send_count() == 2)
+local expect = h:bytes()
+assert(seri.unpack(h) == big)
+h = nil
+collectgarbage()
+check_sent(expect)
+send(seri.concat(big, "tail"))
+collectgarbage()
+check_sent(big .. "tail")
+
+-- explicit release, sent payload lives on
+h = seri.pack(big)
+send(h)
+h:release()
+assert(not pcall(send, h) and not pcall(h.size, h))
+check_sent(expect)
+
+-- view keeps the buffer
+local v = seri.concat(big, "tail"):view(-4)
+collectgarbage()
+assert(v:bytes() == "tail")
+
+-- message:buffer() style lightuserdata is not owned, can't be sent
+assert(not pcall(send, raw))
+
+-- error while packing
+for _ = 1, 100 do
+    assert(not pcall(seri.pack, big, print))
+    assert(not pcall(seri.concat, big, print))
+end
+assert(seri.unpack(seri.pack(big)) == big)
+collectgarbage()
+print("ok")
+)";
+
+int main()
+{
+    luaS_initshr();
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+
+    int res = 0;
+    if (luaL_loadstring(L, script) != LUA_OK)
+    {
+        printf("%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    lua_serialize::open(L);
+    lua_pushcfunction(L, send);
+    lua_pushcfunction(L, send_count);
+    lua_pushcfunction(L, check_sent);
+    lua_pushlightuserdata(L, &sent);
+    if (lua_pcall(L, 5, 0, 0) != LUA_OK)
+    {
+        printf("%s\n", lua_tostring(L, -1));
+        res = 1;
+    }
+
+    lua_close(L);
+    luaS_exitshr();
+    return res;
+}
@@ -0,0 +1,95 @@
+/*
+    payload access from lua: copy to lua string(msg:bytes) vs buffer view(msg:view).
+    each round gets the payload and reads a 4 bytes header from it.
+    usage: lua_buffer_view_benchmark [rounds]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include "luabind/lua_buffer_view.hpp"
+
+extern "C" {
+#include "lua53/lstring.h"
+}
+
+using namespace moon;
+
+static int payload_string(lua_State* L)
+{
+    auto buf = static_cast<buffer*>(lua_touserdata(L, lua_upvalueindex(1)));
+    lua_pushlstring(L, buf->data(), buf->size());
+    return 1;
+}
+
+static int payload_view(lua_State* L)
+{
+    auto holder = static_cast<buffer_ptr_t*>(lua_touserdata(L, lua_upvalueindex(1)));
+    lua_buffer_view::push(L, *holder, (*holder)->data(), (*holder)->size());
+    return 1;
+}
+
+static const char* script = R"(
+local get_string, get_view, rounds = ...
+local unpack = string.unpack
+
+local t0 = os.clock()
+local sum = 0
+for _ = 1, rounds do
+    local s = get_string()
+    sum = sum + unpack("<I4", s)
+end
+local t1 = os.clock()
+for _ = 1, rounds do
+    local v = get_view()
+    sum = sum - v:uint(1, 4)
+end
+local t2 = os.clock()
+assert(sum == 0)
+return (t1 - t0), (t2 - t1)
+)";
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? std::atoi(argv[1]) : 200000;
+
+    luaS_initshr();
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+
+    printf("%-10s %14s %14s %10s\n", "payload", "string(ns/op)", "view(ns/op)", "speedup");
+    for (size_t size : { 1024, 64 * 1024 })
+    {
+        auto holder = std::make_shared<buffer>(size);
+        for (size_t i = 0; i < size; ++i)
+        {
+            char c = static_cast<char>(i * 31);
+            holder->write_back(&c);
+        }
+
+        if (luaL_loadstring(L, script) != LUA_OK)
+        {
+            printf("%s\n", lua_tostring(L, -1));
+            return 1;
+        }
+        lua_pushlightuserdata(L, holder.get());
+        lua_pushcclosure(L, payload_string, 1);
+        lua_pushlightuserdata(L, &holder);
+        lua_pushcclosure(L, payload_view, 1);
+        lua_pushinteger(L, rounds);
+        if (lua_pcall(L, 3, 2, 0) != LUA_OK)
+        {
+            printf("%s\n", lua_tostring(L, -1));
+            return 1;
+        }
+        double string_ns = lua_tonumber(L, -2) * 1e9 / rounds;
+        double view_ns = lua_tonumber(L, -1) * 1e9 / rounds;
+        lua_pop(L, 2);
+        lua_gc(L, LUA_GCCOLLECT, 0);
+
+        printf("%-10zu %14.1f %14.1f %9.1fx\n", size, string_ns, view_ns, string_ns / view_ns);
+    }
+
+    lua_close(L);
+    luaS_exitshr();
+    return 0;
+}
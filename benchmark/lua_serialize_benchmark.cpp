@@ -0,0 +1,184 @@
+/*
+    seri pack/packs/unpack of game state tables, best of 5 runs.
+    usage: lua_serialize_benchmark [rounds]
+    compare with lua_serialize.hpp of another git revision: premake5 gmake --serialize-baseline=<rev>
+    defines SERIALIZE_BASELINE, the old class is renamed to lua_serialize_baseline.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include "luabind/lua_serialize.hpp"
+#ifdef SERIALIZE_BASELINE
+#define lua_serialize lua_serialize_baseline
+#include "lua_serialize_baseline.hpp"
+#undef lua_serialize
+#endif
+
+extern "C" {
+#include "lua53/lstring.h"
+}
+
+using namespace moon;
+
+//pack of old revisions returns buffer*, current one returns a buffer handle released by gc
+static int free_buffer(lua_State* L)
+{
+    if (lua_type(L, 1) == LUA_TLIGHTUSERDATA)
+    {
+        delete static_cast<buffer*>(lua_touserdata(L, 1));
+    }
+    return 0;
+}
+
+static const char* script = R"(
+local seri, free, rounds = ...
+local pack, packs, unpack = seri.pack, seri.packs, seri.unpack
+
+local player = {
+    id = 1000001, name = "player_1000001", level = 87, exp = 123456789,
+    pos = {x = 1024.5, y = 32.25, z = -77.125}, online = true,
+    attr = {hp = 12000, mp = 3400, atk = 870, def = 560, crit = 0.15},
+    inventory = {},
+}
+for i = 1, 60 do
+    player.inventory[i] = {id = 20000 + i, count = i * 3, bind = (i % 2 == 0), expire = 1700000000 + i}
+end
+
+local positions = {}
+for i = 1, 1000 do
+    positions[i] = (i % 3 == 0) and (i * 0.5) or i * 17
+end
+
+local entities = {}
+for i = 1, 200 do
+    entities[100000 + i * 7] = {type = i % 5, hp = i * 10, x = i * 1.5, y = i * 2.5}
+end
+
+local cases = {
+    {"player", {player}, 2},
+    {"positions", {positions}, 2},
+    {"entities", {entities}, 2},
+    {"rpc_args", {"move", 1000001, 12.5, 33.0, true}, 100},
+}
+
+local res = {}
+for _, c in ipairs(cases) do
+    local name, args, scale = c[1], c[2], c[3]
+    local n = rounds * scale
+    local t0 = os.clock()
+    for _ = 1, n do
+        free(pack(table.unpack(args)))
+    end
+    local t1 = os.clock()
+    local s
+    for _ = 1, n do
+        s = packs(table.unpack(args))
+    end
+    local t2 = os.clock()
+    for _ = 1, n do
+        unpack(s)
+    end
+    local t3 = os.clock()
+    res[#res + 1] = {name, #s, (t1 - t0) * 1e9 / n, (t2 - t1) * 1e9 / n, (t3 - t2) * 1e9 / n}
+end
+return res
+)";
+
+//push result table of script
+static bool run(lua_State* L, lua_CFunction open, int rounds)
+{
+    if (luaL_loadstring(L, script) != LUA_OK)
+    {
+        printf("%s\n", lua_tostring(L, -1));
+        return false;
+    }
+    open(L);
+    lua_pushcfunction(L, free_buffer);
+    lua_pushinteger(L, rounds);
+    if (lua_pcall(L, 3, 1, 0) != LUA_OK)
+    {
+        printf("%s\n", lua_tostring(L, -1));
+        return false;
+    }
+    lua_gc(L, LUA_GCCOLLECT, 0);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? std::atoi(argv[1]) : 2000;
+
+    luaS_initshr();
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+
+#ifdef SERIALIZE_BASELINE
+    const lua_CFunction opens[] = { lua_serialize_baseline::open, lua_serialize::open };
+#else
+    const lua_CFunction opens[] = { lua_serialize::open };
+#endif
+    constexpr int nimpl = static_cast<int>(sizeof(opens) / sizeof(opens[0]));
+    constexpr int max_case = 8;
+    constexpr int repeat = 5;
+    //[baseline/current][case][bytes, pack, packs, unpack], best of repeat
+    double v[nimpl][max_case][4];
+    std::string names[max_case];
+    int ncase = 0;
+    for (int r = 0; r < repeat; ++r)
+    {
+        for (int n = 0; n < nimpl; ++n)
+        {
+            //alternate the order, the one run later is measured with a warmer heap
+            int k = (r % 2 == 0) ? n : nimpl - 1 - n;
+            if (!run(L, opens[k], rounds))
+            {
+                return 1;
+            }
+            ncase = std::min(max_case, (int)lua_rawlen(L, -1));
+            for (int i = 0; i < ncase; ++i)
+            {
+                lua_rawgeti(L, -1, i + 1);
+                lua_rawgeti(L, -1, 1);
+                names[i] = lua_tostring(L, -1);
+                lua_pop(L, 1);
+                for (int j = 0; j < 4; ++j)
+                {
+                    lua_rawgeti(L, -1, j + 2);
+                    double x = lua_tonumber(L, -1);
+                    v[k][i][j] = (r == 0) ? x : std::min(v[k][i][j], x);
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 1);
+        }
+    }
+
+    if (nimpl == 1)
+    {
+        printf("%-10s %8s %14s %14s %14s\n", "case", "bytes", "pack ns/op", "packs ns/op", "unpack ns/op");
+        for (int i = 0; i < ncase; ++i)
+        {
+            printf("%-10s %8.0f %14.0f %14.0f %14.0f\n", names[i].data(), v[0][i][0], v[0][i][1], v[0][i][2], v[0][i][3]);
+        }
+    }
+    else
+    {
+        //speedup = baseline / current
+        printf("%-10s %13s %24s %24s %24s\n", "case", "bytes(b/c)", "pack ns/op(b/c)", "packs ns/op(b/c)", "unpack ns/op(b/c)");
+        for (int i = 0; i < ncase; ++i)
+        {
+            printf("%-10s %6.0f/%-6.0f", names[i].data(), v[0][i][0], v[nimpl - 1][i][0]);
+            for (int j = 1; j < 4; ++j)
+            {
+                printf(" %9.0f/%-8.0f%5.2fx", v[0][i][j], v[nimpl - 1][i][j], v[0][i][j] / v[nimpl - 1][i][j]);
+            }
+            printf("\n");
+        }
+    }
+
+    lua_close(L);
+    luaS_exitshr();
+    return 0;
+}
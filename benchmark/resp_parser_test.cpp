@@ -0,0 +1,328 @@
+/*
+    resp::framer and lua module resp, build with -fsanitize=address:
+    known replies decode as expected, random replies frame the same however the stream is split,
+    mutated streams never read out of bounds and frame the same bytes however split, decode speed.
+    usage: resp_parser_test [fuzz rounds]
+*/
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include "luabind/lua_resp.hpp"
+
+extern "C" {
+#include "lua53/lstring.h"
+}
+
+using namespace moon;
+
+static const char* script = R"(
+local resp = ...
+local null = resp.null
+local values, errors = {}, {}
+
+local function one(data)
+    local n = resp.decode(data, values, errors)
+    assert(n == 1, n)
+    return values[1], errors[1]
+end
+
+assert(one("+OK\r\n") == "OK")
+assert(one(":-42\r\n") == -42)
+assert(one(":9223372036854775807\r\n") == math.maxinteger)
+assert(one("$5\r\nhe\0lo\r\n") == "he\0lo")
+assert(one("$0\r\n\r\n") == "")
+assert(one("$-1\r\n") == null)
+assert(one("*-1\r\n") == null)
+assert(one("_\r\n") == null)
+assert(one("#t\r\n") == true)
+assert(one(",3.5\r\n") == 3.5)
+assert(one(",inf\r\n") == math.huge)
+assert(one("(3492890328409238509324850943850943825024385\r\n") == "3492890328409238509324850943850943825024385")
+assert(one("=15\r\ntxt:Some string\r\n") == "Some string")
+
+local v, e = one("-ERR unknown command\r\n")
+assert(v == false and e == "ERR unknown command")
+v, e = one("!21\r\nSYNTAX invalid syntax\r\n")
+assert(v == false and e == "SYNTAX invalid syntax")
+
+v = one("*3\r\n:1\r\n*2\r\n$1\r\na\r\n-ERR x\r\n*0\r\n")
+assert(#v == 3 and v[1] == 1 and v[2][1] == "a" and v[2][2][1] == false and v[2][2][2] == "ERR x" and #v[3] == 0)
+v = one("%2\r\n+first\r\n:1\r\n$6\r\nsecond\r\n~1\r\n#f\r\n")
+assert(v.first == 1 and v.second[1] == false)
+v = one("|1\r\n+key-popularity\r\n%1\r\n$1\r\na\r\n,0.19\r\n*1\r\n:7\r\n")
+assert(#v == 1 and v[1] == 7)
+
+-- several replies, error entry is reset when reused
+local n = resp.decode("-ERR a\r\n+OK\r\n$-1\r\n", values, errors)
+assert(n == 3 and values[1] == false and errors[1] == "ERR a" and values[2] == "OK" and values[3] == null)
+n = resp.decode(":1\r\n", values, errors)
+assert(n == 1 and values[1] == 1 and errors[1] == nil)
+assert(resp.decode("", values, errors) == 0)
+
+-- malformed or incomplete
+for _, bad in ipairs({"+OK", "$5\r\nab\r\n", "*2\r\n:1\r\n", "?\r\n", ":1x\r\n", ",\r\n1\r\n", "#x\r\n", "$-2\r\n",
+    "=3\r\nabc\r\n", ":99999999999999999999\r\n", "\n", "+a\n", string.rep("*1\r\n", 65) .. ":1\r\n"}) do
+    assert(not pcall(resp.decode, bad, values, errors), bad)
+end
+assert(pcall(resp.decode, string.rep("*1\r\n", 64) .. ":1\r\n", values, errors))
+print("decode ok")
+)";
+
+//random valid reply, RESP3 types
+static void gen(std::mt19937& rng, std::string& out, int depth)
+{
+    auto r = [&rng](int n) { return static_cast<int>(rng() % n); };
+    int t = (depth >= 5) ? r(10) : r(15);
+    switch (t)
+    {
+    case 0: out += "+OK\r\n"; break;
+    case 1: out += "-ERR some error\r\n"; break;
+    case 2: out += ":" + std::to_string(static_cast<int64_t>(rng()) - INT32_MAX) + "\r\n"; break;
+    case 3:
+    {
+        std::string s(r(40), 'x');
+        for (auto& c : s) c = static_cast<char>(r(256));
+        out += "$" + std::to_string(s.size()) + "\r\n" + s + "\r\n";
+        break;
+    }
+    case 4: out += "$-1\r\n"; break;
+    case 5: out += "_\r\n"; break;
+    case 6: out += ",1.25e3\r\n"; break;
+    case 7: out += r(2) ? "#t\r\n" : "#f\r\n"; break;
+    case 8: out += "(12345678901234567890\r\n"; break;
+    case 9: out += "=8\r\ntxt:abcd\r\n"; break;
+    case 10: out += "*-1\r\n"; break;
+    default:
+    {
+        static const char agg[] = { '*', '%', '~', '>', '|' };
+        char type = agg[t - 10];
+        int n = r(6);
+        out += type + std::to_string(n) + "\r\n";
+        int elements = (type == '%' || type == '|') ? n * 2 : n;
+        if (type == '|')
+        {
+            elements += 1;
+        }
+        for (int i = 0; i < elements; ++i)
+        {
+            gen(rng, out, depth + 1);
+        }
+        break;
+    }
+    }
+}
+
+//feed stream in chunks like reads of a connection, returns framed sizes, -1 appended on error
+static std::vector<int64_t> frame_split(std::mt19937& rng, const std::string& stream, size_t max_chunk)
+{
+    std::vector<int64_t> res;
+    resp::framer f;
+    std::string buf;
+    size_t pos = 0;
+    while (pos < stream.size())
+    {
+        size_t n = std::min(stream.size() - pos, 1 + rng() % max_chunk);
+        //exact size copy: asan finds reads past the received data
+        buf.append(stream, pos, n);
+        pos += n;
+        while (true)
+        {
+            std::vector<char> data(buf.begin(), buf.end());
+            int64_t done = f.frame(data.data(), data.size());
+            if (done < 0)
+            {
+                res.push_back(-1);
+                return res;
+            }
+            if (done == 0)
+            {
+                break;
+            }
+            res.push_back(done);
+            buf.erase(0, static_cast<size_t>(done));
+        }
+    }
+    return res;
+}
+
+static int check_decode(lua_State* L, const char* data, size_t size)
+{
+    lua_pushvalue(L, 1);
+    lua_pushlstring(L, data, size);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 3);
+    if (lua_pcall(L, 3, 1, 0) != LUA_OK)
+    {
+        printf("decode framed replies failed: %s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return -1;
+    }
+    int n = static_cast<int>(lua_tointeger(L, -1));
+    lua_pop(L, 1);
+    return n;
+}
+
+int main(int argc, char* argv[])
+{
+    int rounds = (argc > 1) ? std::atoi(argv[1]) : 20000;
+
+    luaS_initshr();
+    lua_State* L = luaL_newstate();
+    luaL_openlibs(L);
+
+    int res = 0;
+    if (luaL_loadstring(L, script) != LUA_OK)
+    {
+        printf("%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+    lua_resp::open(L);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+    {
+        printf("%s\n", lua_tostring(L, -1));
+        return 1;
+    }
+
+    //stack: decode, values, errors
+    lua_settop(L, 0);
+    lua_resp::open(L);
+    lua_getfield(L, -1, "decode");
+    lua_replace(L, 1);
+    lua_newtable(L);
+    lua_newtable(L);
+
+    std::mt19937 rng(12345);
+
+    //valid replies: every split frames reply by reply, framed data decodes
+    for (int i = 0; i < rounds / 10 && res == 0; ++i)
+    {
+        std::string stream;
+        std::vector<int64_t> sizes;
+        int count = 1 + static_cast<int>(rng() % 8);
+        for (int k = 0; k < count; ++k)
+        {
+            size_t before = stream.size();
+            gen(rng, stream, 0);
+            sizes.push_back(static_cast<int64_t>(stream.size() - before));
+        }
+        auto framed = frame_split(rng, stream, 1 + rng() % 64);
+        int64_t total = 0;
+        int64_t expect = 0;
+        size_t next = 0;
+        for (auto n : framed)
+        {
+            //a frame holds whole replies
+            expect = 0;
+            int replies = 0;
+            while (expect < n && next < sizes.size())
+            {
+                expect += sizes[next++];
+                ++replies;
+            }
+            if (n < 0 || expect != n || check_decode(L, stream.data() + total, static_cast<size_t>(n)) != replies)
+            {
+                printf("valid stream framed wrong, round %d\n", i);
+                res = 1;
+                break;
+            }
+            total += n;
+        }
+        if (res == 0 && total != static_cast<int64_t>(stream.size()))
+        {
+            printf("valid stream not framed, round %d\n", i);
+            res = 1;
+        }
+    }
+
+    //mutated replies: same frames however split, framed data decodes
+    for (int i = 0; i < rounds && res == 0; ++i)
+    {
+        std::string stream;
+        int count = 1 + static_cast<int>(rng() % 4);
+        for (int k = 0; k < count; ++k)
+        {
+            gen(rng, stream, 0);
+        }
+        int mutations = 1 + static_cast<int>(rng() % 3);
+        for (int k = 0; k < mutations && !stream.empty(); ++k)
+        {
+            size_t at = rng() % stream.size();
+            switch (rng() % 4)
+            {
+            case 0: stream[at] = static_cast<char>(rng() % 256); break;
+            case 1: stream.erase(at, 1 + rng() % 4); break;
+            case 2: stream.insert(at, 1, "\r\n$*:-1"[rng() % 7]); break;
+            default: stream.resize(at); break;
+            }
+        }
+        auto whole = frame_split(rng, stream, stream.size() + 1);
+        auto split = frame_split(rng, stream, 1 + rng() % 16);
+        auto framed_size = [](const std::vector<int64_t>& v) {
+            int64_t n = 0;
+            for (auto size : v) n += (size > 0) ? size : 0;
+            return n;
+        };
+        bool whole_error = !whole.empty() && whole.back() < 0;
+        bool split_error = !split.empty() && split.back() < 0;
+        if (framed_size(whole) != framed_size(split) || whole_error != split_error)
+        {
+            printf("mutated stream framed differently, round %d\n", i);
+            res = 1;
+            break;
+        }
+        int64_t total = 0;
+        for (auto n : whole)
+        {
+            if (n > 0)
+            {
+                if (check_decode(L, stream.data() + total, static_cast<size_t>(n)) <= 0)
+                {
+                    res = 1;
+                    break;
+                }
+                total += n;
+            }
+        }
+        //decode of any data must fail or succeed cleanly
+        lua_pushvalue(L, 1);
+        lua_pushlstring(L, stream.data(), stream.size());
+        lua_pushvalue(L, 2);
+        lua_pushvalue(L, 3);
+        lua_pcall(L, 3, 1, 0);
+        lua_pop(L, 1);
+    }
+    if (res == 0)
+    {
+        printf("fuzz ok, %d rounds\n", rounds);
+    }
+
+    //decode speed of a pipelined batch
+    {
+        std::string stream;
+        for (int i = 0; i < 1000; ++i)
+        {
+            stream += "$10\r\nvalue_";
+            stream += std::to_string(1000 + i);
+            stream += "\r\n*3\r\n:1\r\n+OK\r\n$-1\r\n";
+        }
+        auto start = std::chrono::steady_clock::now();
+        int times = 1000;
+        for (int i = 0; i < times; ++i)
+        {
+            resp::framer f;
+            if (f.frame(stream.data(), stream.size()) != static_cast<int64_t>(stream.size()) || check_decode(L, stream.data(), stream.size()) != 2000)
+            {
+                res = 1;
+                break;
+            }
+        }
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        printf("frame and decode %d replies x %d: %lld ms, %.0f replies/s\n", 2000, times, static_cast<long long>(ms), 2000.0 * times * 1000 / (ms > 0 ? ms : 1));
+    }
+
+    lua_close(L);
+    luaS_exitshr();
+    return res;
+}
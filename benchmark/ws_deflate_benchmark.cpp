@@ -0,0 +1,122 @@
+/*
+    websocket permessage-deflate compress ratio and throughput of json state snapshots.
+    usage: ws_deflate_benchmark [messages]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "components/tcp/impl/ws_deflate.hpp"
+
+using namespace moon;
+
+//json state snapshot, fields repeat between messages like a game state sync
+static std::string make_snapshot(int seq, int entities)
+{
+    std::string s = "{\"seq\":" + std::to_string(seq) + ",\"entities\":[";
+    for (int i = 0; i < entities; ++i)
+    {
+        if (i > 0)
+        {
+            s.append(",");
+        }
+        s.append("{\"id\":" + std::to_string(10000 + i));
+        s.append(",\"x\":" + std::to_string((seq * 7 + i * 13) % 1000));
+        s.append(",\"y\":" + std::to_string((seq * 3 + i * 17) % 1000));
+        s.append(",\"hp\":" + std::to_string(100 - (seq + i) % 100));
+        s.append(",\"state\":\"moving\",\"buff\":[1,2,3]}");
+    }
+    s.append("]}");
+    return s;
+}
+
+struct options
+{
+    const char* name;
+    int level;
+    int window_bits;
+    bool no_context_takeover;
+};
+
+int main(int argc, char* argv[])
+{
+    if (!ws::permessage_deflate::supported())
+    {
+        printf("zlib not enabled, define MOON_ENABLE_ZLIB\n");
+        return 1;
+    }
+
+    int count = (argc > 1) ? std::atoi(argv[1]) : 5000;
+
+    const int sizes[] = { 2, 20, 200 };
+
+    const options opts[] = {
+        { "level1 w15 ctx", 1, 15, false },
+        { "level1 w15 no_ctx", 1, 15, true },
+        { "level1 w10 ctx", 1, 10, false },
+        { "level6 w15 ctx", 6, 15, false },
+        { "level9 w15 ctx", 9, 15, false },
+    };
+
+    printf("%-20s %10s %10s %12s %14s\n", "options", "msg_size", "ratio", "deflate(MB/s)", "inflate(MB/s)");
+    for (auto entities : sizes)
+    {
+        std::vector<std::string> msgs;
+        size_t total = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            msgs.push_back(make_snapshot(i, entities));
+            total += msgs.back().size();
+        }
+
+        for (auto& o : opts)
+        {
+            ws::permessage_deflate sender;
+            ws::permessage_deflate receiver;
+            sender.init(o.level, 8, o.window_bits, o.no_context_takeover, o.window_bits, o.no_context_takeover, 64 * 1024 * 1024);
+            receiver.init(o.level, 8, o.window_bits, o.no_context_takeover, o.window_bits, o.no_context_takeover, 64 * 1024 * 1024);
+
+            std::vector<buffer> frames;
+            frames.reserve(msgs.size());
+            size_t compressed = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (auto& m : msgs)
+            {
+                frames.emplace_back(m.size());
+                if (!sender.compress(m.data(), m.size(), &frames.back()))
+                {
+                    printf("compress failed\n");
+                    return 1;
+                }
+                compressed += frames.back().size();
+            }
+            auto end = std::chrono::steady_clock::now();
+            double deflate_sec = std::chrono::duration<double>(end - begin).count();
+
+            buffer out(64 * 1024);
+            begin = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < frames.size(); ++i)
+            {
+                out.clear();
+                if (!receiver.decompress(frames[i].data(), frames[i].size(), &out)
+                    || out.size() != msgs[i].size())
+                {
+                    printf("decompress failed\n");
+                    return 1;
+                }
+            }
+            end = std::chrono::steady_clock::now();
+            double inflate_sec = std::chrono::duration<double>(end - begin).count();
+
+            double mb = static_cast<double>(total) / (1024.0 * 1024.0);
+            printf("%-20s %10zu %10.3f %12.1f %14.1f\n"
+                , o.name
+                , total / msgs.size()
+                , static_cast<double>(compressed) / static_cast<double>(total)
+                , mb / deflate_sec
+                , mb / inflate_sec);
+        }
+    }
+    return 0;
+}
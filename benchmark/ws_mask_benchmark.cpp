@@ -0,0 +1,64 @@
+/*
+    websocket payload unmask throughput.
+    usage: ws_mask_benchmark [total_mb]
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include "components/tcp/impl/ws_mask.hpp"
+
+using mask_func_t = void(*)(uint8_t*, size_t, uint32_t);
+
+static double run(mask_func_t f, std::vector<uint8_t>& data, size_t frame_size, size_t total)
+{
+    uint32_t key = 0x5A3C96E1;
+    size_t rounds = total / frame_size;
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < rounds; ++i)
+    {
+        //odd offset, frames in receive buffer are not aligned
+        f(data.data() + 1, frame_size, key);
+    }
+    auto end = std::chrono::steady_clock::now();
+    double sec = std::chrono::duration<double>(end - begin).count();
+    return (static_cast<double>(rounds * frame_size) / (1024.0 * 1024.0)) / sec;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t total_mb = (argc > 1) ? static_cast<size_t>(std::atoi(argv[1])) : 1024;
+    size_t total = total_mb * 1024 * 1024;
+
+    const size_t frame_sizes[] = { 125, 1024, 10 * 1024, 64 * 1024 };
+
+    std::vector<uint8_t> data(64 * 1024 + 1);
+    for (size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<uint8_t>(i);
+    }
+
+    //verify
+    {
+        std::vector<uint8_t> a(data), b(data);
+        for (size_t n = 0; n < 100; ++n)
+        {
+            moon::ws::mask(a.data() + 1, n * 37, 0x11223344);
+            moon::ws::mask_bytewise(b.data() + 1, n * 37, 0x11223344);
+        }
+        if (a != b)
+        {
+            printf("mask result mismatch\n");
+            return 1;
+        }
+    }
+
+    printf("%-12s %16s %16s\n", "frame", "bytewise(MB/s)", "mask(MB/s)");
+    for (auto n : frame_sizes)
+    {
+        double v1 = run(moon::ws::mask_bytewise, data, n, total);
+        double v2 = run(moon::ws::mask, data, n, total);
+        printf("%-12zu %16.1f %16.1f\n", n, v1, v2);
+    }
+    return 0;
+}
@@ -1,12 +1,36 @@
 #pragma once
 #include "common/macro_define.hpp"
-#include "common/concurrent_queue.hpp"
 #include "common/time.hpp"
 #include "common/termcolor.hpp"
 #include "common/directory.hpp"
-#include "common/object_pool.hpp"
-#include "common/buffer.hpp"
-#include "common/spinlock.hpp"
+#include "common/log_format.hpp"
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <ctime>
+#include <cstdio>
+
+#if defined(__GNUC__)
+#define MOON_PRINTF_FORMAT(fmt_index, args_index) __attribute__((format(printf, fmt_index, args_index)))
+#else
+#define MOON_PRINTF_FORMAT(fmt_index, args_index)
+#endif
+
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+struct iovec
+{
+    void* iov_base;
+    size_t iov_len;
+};
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
 
 namespace moon
 {
@@ -19,13 +43,189 @@ namespace moon
         Max
     };
 
+    /*
+        Single producer single consumer byte ring of one logging thread, lock-free.
+        Records are contiguous: a record that does not fit before the end of the ring starts at the front,
+        the space left at the end is marked skipped.
+    */
+    class log_ring
+    {
+    public:
+        struct record
+        {
+            //bytes of the record in the ring, aligned. 0: skip to the end of the ring
+            uint32_t size;
+            //bytes of the text, or of the packed arguments
+            uint32_t len;
+            //milliseconds since epoch
+            int64_t time;
+            uint64_t thread;
+            //format of the packed arguments, nullptr: text
+            const char* fmt;
+            uint8_t console;
+            uint8_t level;
+        };
+
+        static constexpr size_t ALIGN = 16;
+
+        static constexpr size_t align(size_t n)
+        {
+            return (n + ALIGN - 1) & ~(ALIGN - 1);
+        }
+
+        //capacity: power of 2
+        explicit log_ring(size_t capacity)
+            :capacity_(capacity)
+            , data_(new char[capacity])
+        {
+            assert(capacity >= ALIGN && (capacity & (capacity - 1)) == 0);
+        }
+
+        //producer: contiguous space of size bytes (aligned), nullptr: full
+        char* prepare(size_t size)
+        {
+            size_t head = head_.load(std::memory_order_relaxed);
+            size_t tail = tail_.load(std::memory_order_acquire);
+            size_t off = head & (capacity_ - 1);
+            size_t skip = (capacity_ - off < size) ? capacity_ - off : 0;
+            if (capacity_ - (head - tail) < skip + size)
+            {
+                return nullptr;
+            }
+            if (skip > 0)
+            {
+                reinterpret_cast<record*>(data_.get() + off)->size = 0;
+                head_.store(head + skip, std::memory_order_release);
+                off = 0;
+            }
+            return data_.get() + off;
+        }
+
+        //producer: publish the record written to prepare()
+        void commit(size_t size)
+        {
+            head_.store(head_.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        }
+
+        //consumer: read position of the first record not released
+        size_t read_pos() const
+        {
+            return tail_.load(std::memory_order_relaxed);
+        }
+
+        //consumer: record at pos, nullptr: no more. the next record is at pos + size
+        const record* peek(size_t& pos) const
+        {
+            size_t head = head_.load(std::memory_order_acquire);
+            while (pos != head)
+            {
+                size_t off = pos & (capacity_ - 1);
+                auto r = reinterpret_cast<const record*>(data_.get() + off);
+                if (r->size != 0)
+                {
+                    return r;
+                }
+                pos += capacity_ - off;
+            }
+            return nullptr;
+        }
+
+        //consumer: records before pos are written, their space is reused
+        void release(size_t pos)
+        {
+            tail_.store(pos, std::memory_order_release);
+        }
+    private:
+        const size_t capacity_;
+        std::unique_ptr<char[]> data_;
+        alignas(64) std::atomic<size_t> head_ = 0;
+        alignas(64) std::atomic<size_t> tail_ = 0;
+    };
+
+    //"2017-11-11 16:03:11.635 | 1234   | INFO  | ", the date of the last second is reused
+    class log_header
+    {
+    public:
+        static constexpr size_t MAX_LEN = 64;
+
+        size_t format(char* buf, int64_t mill, uint64_t thread, LogLevel level)
+        {
+            if (mill / 1000 != second_)
+            {
+                second_ = mill / 1000;
+                time::milltimestamp(mill, date_, sizeof(date_));
+            }
+            //date and time without milliseconds
+            memcpy(buf, date_, 19);
+            auto ms = static_cast<int>(mill % 1000);
+            buf[19] = '.';
+            buf[20] = static_cast<char>('0' + ms / 100);
+            buf[21] = static_cast<char>('0' + ms / 10 % 10);
+            buf[22] = static_cast<char>('0' + ms % 10);
+            size_t offset = 23;
+            memcpy(buf + offset, " | ", 3);
+            offset += 3;
+            auto len = moon::uint64_to_str(thread, buf + offset);
+            offset += len;
+            if (len < 6)
+            {
+                memcpy(buf + offset, "      ", 6 - len);
+                offset += 6 - len;
+            }
+            //11 chars, without the terminating null
+            memcpy(buf + offset, to_string(level), 11);
+            offset += 11;
+            return offset;
+        }
+
+        static const char* to_string(LogLevel lv)
+        {
+            switch (lv)
+            {
+            case LogLevel::Error:
+                return " | ERROR | ";
+            case LogLevel::Warn:
+                return " | WARN  | ";
+            case LogLevel::Info:
+                return " | INFO  | ";
+            case LogLevel::Debug:
+                return " | DEBUG | ";
+            default:
+                return " | NULL  | ";
+            }
+        }
+    private:
+        int64_t second_ = -1;
+        char date_[32];
+    };
+
+    /*
+        Each logging thread enqueues to its own log_ring without lock, the writer thread drains all rings
+        and writes them with one writev per batch. Records of a thread keep their order, records of
+        different threads are ordered by batch.
+        When a ring is full, levels at or below the drop level are dropped and counted, others wait for the writer.
+        The file is rotated by size and by time: it is renamed with a timestamp suffix and reopened.
+        Logs of the CONSOLE_* and LOG_* macros are packed arguments formatted by the writer, the header too.
+        A binary log file keeps them packed, see log_format, and is read with tools/log_decoder.
+    */
     class log
     {
         static const int MAX_LOG_LEN = 8 * 1024;
+        static const int MAX_IOV = 1024;
+        //writer buffer of headers and formatted logs of a batch
+        static const int SCRATCH_SIZE = 256 * 1024;
     public:
+        //ring bytes of each logging thread
+        static constexpr size_t RING_SIZE = 512 * 1024;
+        //longer text is truncated, a record must fit the ring
+        static constexpr size_t MAX_TEXT_LEN = RING_SIZE / 4;
+
         log()
             :state_(state::init)
             , level_(LogLevel::Debug)
+            , drop_level_(LogLevel::Debug)
+            , id_(next_id())
+            , scratch_(new char[SCRATCH_SIZE])
             , thread_(&log::write, this)
         {
         }
@@ -41,28 +241,48 @@ namespace moon
 
         void init(const std::string& logfile)
         {
-            if (ofs_)
-            {
-                ofs_->flush();
-                ofs_->close();
-            }
+            close_file();
 
             if (!logfile.empty())
             {
                 std::error_code ec;
                 auto parent_path = fs::path(logfile).parent_path();
-                if (!fs::exists(parent_path, ec))
+                if (!parent_path.empty() && !fs::exists(parent_path, ec))
                 {
                     fs::create_directories(parent_path, ec);
                     MOON_CHECK(!ec, ec.message().data());
                 }
-                ofs_.reset(new std::ofstream());
-                ofs_->open(logfile, std::ofstream::out | std::ofstream::trunc);
+                path_ = logfile;
+                MOON_CHECK(open_file(), moon::format("open log file %s failed", logfile.data()).data());
             }
             state_.store(state::ready, std::memory_order_release);
         }
 
-        void logfmt(bool console, LogLevel level, const char* fmt, ...)
+        //max_size: bytes of a log file before rotation, 0: no limit. interval: seconds of a log file, 0: no limit,
+        //rotation happens at multiples of interval from local midnight. call before init
+        void set_rotate(size_t max_size, int64_t interval)
+        {
+            max_size_ = max_size;
+            interval_ = interval;
+        }
+
+        //binary log file instead of text. call before init
+        void set_binary(bool v)
+        {
+            binary_ = v;
+        }
+
+        bool enabled(LogLevel level) const
+        {
+            return level_.load(std::memory_order_relaxed) >= level;
+        }
+
+        LogLevel get_level() const
+        {
+            return level_.load(std::memory_order_relaxed);
+        }
+
+        void logfmt(bool console, LogLevel level, const char* fmt, ...) MOON_PRINTF_FORMAT(4, 5)
         {
             if (level_ < level)
             {
@@ -81,7 +301,11 @@ namespace moon
             int n = vsnprintf(fmtbuf, MAX_LOG_LEN, fmt, ap);
 #endif
             va_end(ap);
-            logstring(console, level, moon::string_view_t(fmtbuf, n));
+            if (n < 0)
+            {
+                return;
+            }
+            logstring(console, level, moon::string_view_t(fmtbuf, std::min(n, MAX_LOG_LEN - 1)));
         }
 
         void logstring(bool console, LogLevel level, moon::string_view_t s)
@@ -91,15 +315,23 @@ namespace moon
                 return;
             }
 
-            auto buf = buffer_cache_.create(s.size());
-            auto b = std::addressof(*buf->begin());
-            *(b++) = static_cast<char>(console);
-            *(b++) = static_cast<char>(level);
-            size_t offset = format_header(b, level);
-            buf->offset_writepos(2 + static_cast<int>(offset));
-            buf->write_back(s.data(), 0, s.size());
-            buf->write_back("\n", 0, 1);
-            log_queue_.push_back(buf);
+            if (s.size() > MAX_TEXT_LEN)
+            {
+                s = s.substr(0, MAX_TEXT_LEN);
+            }
+            push(console, level, nullptr, s.size(), [&s](char* p) { memcpy(p, s.data(), s.size()); });
+        }
+
+        //fmt must be a string literal, use the CONSOLE_* and LOG_* macros
+        template<typename... Args>
+        void logdefer(bool console, LogLevel level, const char* fmt, const Args&... args)
+        {
+            if (level_ < level)
+            {
+                return;
+            }
+            size_t len = (log_format::packed_size(args) + ... + 0);
+            push(console, level, fmt, len, [&](char* p) { ((p = log_format::pack(p, args)), ...); (void)p; });
         }
 
         void set_level(LogLevel level)
@@ -109,65 +341,133 @@ namespace moon
 
         void set_level(string_view_t s)
         {
-            if (moon::iequal_string(s, string_view_t{ "DEBUG" }))
+            set_level(to_level(s));
+        }
+
+        //when the ring is full, logs of this level and less severe are dropped instead of waiting
+        void set_drop_level(string_view_t s)
+        {
+            drop_level_ = to_level(s);
+        }
+
+        //logs dropped since start
+        size_t dropped() const
+        {
+            return dropped_total_.load(std::memory_order_relaxed) + dropped_.load(std::memory_order_relaxed);
+        }
+
+        void wait()
+        {
+            if (state_.load() == state::exited)
             {
-                set_level(LogLevel::Debug);
+                return;
             }
-            else  if (moon::iequal_string(s, string_view_t{ "INFO" }))
+
+            state_.store(state::exited);
+            wakeup();
+
+            if (thread_.joinable())
+                thread_.join();
+
+            close_file();
+        }
+    private:
+        static LogLevel to_level(string_view_t s)
+        {
+            if (moon::iequal_string(s, string_view_t{ "INFO" }))
             {
-                set_level(LogLevel::Info);
+                return LogLevel::Info;
             }
             else  if (moon::iequal_string(s, string_view_t{ "WARN" }))
             {
-                set_level(LogLevel::Warn);
+                return LogLevel::Warn;
             }
             else  if (moon::iequal_string(s, string_view_t{ "ERROR" }))
             {
-                set_level(LogLevel::Error);
+                return LogLevel::Error;
+            }
+            return LogLevel::Debug;
+        }
+
+        static size_t next_id()
+        {
+            static std::atomic<size_t> id = 0;
+            return ++id;
+        }
+
+        log_ring* local_ring()
+        {
+            //ring of this thread for the last log used, id: log may be created at the address of a destroyed one
+            thread_local size_t cache_id = 0;
+            thread_local log_ring* cache_ring = nullptr;
+            if (cache_id == id_)
+            {
+                return cache_ring;
+            }
+
+            std::lock_guard<std::mutex> lk(rings_lock_);
+            auto tid = std::this_thread::get_id();
+            log_ring* ring = nullptr;
+            for (auto& it : rings_)
+            {
+                if (it.first == tid)
+                {
+                    ring = it.second.get();
+                    break;
+                }
             }
-            else
+            if (nullptr == ring)
             {
-                set_level(LogLevel::Debug);
+                rings_.emplace_back(tid, std::make_unique<log_ring>(RING_SIZE));
+                ring = rings_.back().second.get();
+                rings_count_.store(rings_.size(), std::memory_order_release);
             }
+            cache_id = id_;
+            cache_ring = ring;
+            return ring;
         }
 
-        void wait()
+        //record of len bytes, fill writes them
+        template<typename Fill>
+        void push(bool console, LogLevel level, const char* fmt, size_t len, Fill&& fill)
         {
-            if (state_.load() == state::exited)
+            log_ring* ring = local_ring();
+            size_t size = log_ring::align(sizeof(log_ring::record) + len);
+            char* p = nullptr;
+            while (nullptr == (p = ring->prepare(size)))
             {
-                return;
+                if (level >= drop_level_.load(std::memory_order_relaxed) || state_.load(std::memory_order_relaxed) == state::exited)
+                {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                wakeup();
+                std::this_thread::yield();
             }
 
-            state_.store(state::exited);
-            log_queue_.exit();
-
-            if (thread_.joinable())
-                thread_.join();
+            auto r = reinterpret_cast<log_ring::record*>(p);
+            fill(p + sizeof(log_ring::record));
+            r->len = static_cast<uint32_t>(len);
+            r->time = time::millsecond();
+            r->thread = moon::thread_id();
+            r->fmt = fmt;
+            r->console = static_cast<uint8_t>(console);
+            r->level = static_cast<uint8_t>(level);
+            r->size = static_cast<uint32_t>(size);
+            ring->commit(size);
 
-            if (ofs_&&ofs_->is_open())
+            //pairs with the fence of the writer before it sleeps
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping_.load(std::memory_order_relaxed))
             {
-                ofs_->flush();
-                ofs_->close();
-                ofs_ = nullptr;
+                wakeup();
             }
         }
-    private:
-        size_t format_header(char* buf, LogLevel level) const
+
+        void wakeup()
         {
-            size_t offset = 0;
-            offset += time::milltimestamp(buf, 23);
-            memcpy(buf + offset, " | ", 3);
-            offset += 3;
-            auto len = moon::uint64_to_str(moon::thread_id(), buf + offset);
-            offset += len;
-            if (len < 6)
-            {
-                memcpy(buf + offset, "      ", 6 - len);
-                offset += 6 - len;
-            }
-            memcpy(buf + offset, to_string(level), 12);
-            offset += 12;
-            return offset;
+            std::lock_guard<std::mutex> lk(sleep_lock_);
+            sleep_cond_.notify_one();
         }
 
         void write()
@@ -175,88 +475,394 @@ namespace moon
             while (state_.load(std::memory_order_acquire) == state::init)
                 std::this_thread::sleep_for(std::chrono::microseconds(50));
 
-            queue_t::container_type swaps;
-            while (state_.load() == state::ready || log_queue_.size() != 0)
+            std::vector<log_ring*> rings;
+            std::vector<size_t> read_pos;
+            iov_.reserve(MAX_IOV);
+            while (true)
             {
-                swaps.clear();
-                log_queue_.swap(swaps);
-                for (auto& it : swaps)
+                bool exiting = (state_.load(std::memory_order_acquire) == state::exited);
+                if (rings.size() != rings_count_.load(std::memory_order_acquire))
+                {
+                    std::lock_guard<std::mutex> lk(rings_lock_);
+                    rings.clear();
+                    for (auto& it : rings_)
+                    {
+                        rings.push_back(it.second.get());
+                    }
+                }
+
+                size_t n = 0;
+                read_pos.resize(rings.size());
+                for (size_t i = 0; i < rings.size(); ++i)
                 {
-                    auto b = it->data();
-                    auto bconsole = static_cast<bool>(*(b++));
-                    auto level = static_cast<LogLevel>(*(b++));
-                    it->seek(2, buffer::seek_origin::Current);
-                    if (bconsole)
+                    size_t pos = rings[i]->read_pos();
+                    while (auto r = rings[i]->peek(pos))
                     {
-                        auto s = moon::string_view_t(reinterpret_cast<const char*>(it->data()), it->size());
-                        switch (level)
+                        //a record takes up to 3 iovecs and a formatted log of scratch
+                        if (iov_.size() + 3 > MAX_IOV || SCRATCH_SIZE - scratch_used_ < MAX_LOG_LEN + 2 * log_header::MAX_LEN)
                         {
-                        case LogLevel::Error:
-                            std::cerr << termcolor::red << s;
-                            break;
-                        case LogLevel::Warn:
-                            std::cout << termcolor::yellow << s;
-                            break;
-                        case LogLevel::Info:
-                            std::cout << termcolor::white << s;
-                            break;
-                        case LogLevel::Debug:
-                            std::cout << termcolor::green << s;
-                            break;
-                        default:
-                            break;
+                            write_file();
+                            for (size_t k = 0; k <= i; ++k)
+                            {
+                                rings[k]->release((k == i) ? pos : read_pos[k]);
+                            }
                         }
-                        std::cout << termcolor::white;
+                        write_record(r);
+                        pos += r->size;
+                        ++n;
                     }
+                    read_pos[i] = pos;
+                }
+                write_file();
+                for (size_t i = 0; i < rings.size(); ++i)
+                {
+                    rings[i]->release(read_pos[i]);
+                }
+
+                if (auto dropped = dropped_.exchange(0, std::memory_order_relaxed); dropped > 0)
+                {
+                    dropped_total_.fetch_add(dropped, std::memory_order_relaxed);
+                    write_dropped(dropped);
+                }
+
+                rotate();
+
+                if (n > 0)
+                {
+                    continue;
+                }
+
+                if (exiting)
+                {
+                    break;
+                }
+
+                std::unique_lock<std::mutex> lk(sleep_lock_);
+                sleeping_.store(true, std::memory_order_relaxed);
+                //pairs with the fence of logstring: either the writer sees the record or the producer sees sleeping_
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!has_records(rings) && state_.load() != state::exited && rings.size() == rings_count_.load())
+                {
+                    sleep_cond_.wait_for(lk, std::chrono::milliseconds(100));
+                }
+                sleeping_.store(false, std::memory_order_relaxed);
+            }
+        }
 
-                    if (ofs_)
+        static bool has_records(const std::vector<log_ring*>& rings)
+        {
+            for (auto ring : rings)
+            {
+                size_t pos = ring->read_pos();
+                if (nullptr != ring->peek(pos))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        //console output and iovecs of the file
+        void write_record(const log_ring::record* r)
+        {
+            auto level = static_cast<LogLevel>(r->level);
+            auto data = reinterpret_cast<const char*>(r) + sizeof(log_ring::record);
+            if (r->console || !binary_)
+            {
+                //header, and formatted log and newline of packed arguments
+                char* header = scratch_.get() + scratch_used_;
+                size_t len = header_.format(header, r->time, r->thread, level);
+                if (nullptr != r->fmt)
+                {
+                    len += log_format::format(header + len, MAX_LOG_LEN, r->fmt, data, r->len);
+                    header[len++] = '\n';
+                }
+                scratch_used_ += len;
+                moon::string_view_t text = (nullptr != r->fmt) ? moon::string_view_t{} : moon::string_view_t{ data, r->len };
+                if (r->console)
+                {
+                    print(level, moon::string_view_t{ header, len }, text);
+                }
+                if (!binary_ && is_open())
+                {
+                    iov_.push_back(iovec{ header, len });
+                    if (nullptr == r->fmt)
                     {
-                        ofs_->write(it->data(), it->size());
+                        iov_.push_back(iovec{ const_cast<char*>(data), r->len });
+                        iov_.push_back(iovec{ const_cast<char*>("\n"), 1 });
                     }
                 }
-                if (ofs_)
+            }
+
+            if (!binary_ || !is_open())
+            {
+                return;
+            }
+
+            log_format::entry_head head{};
+            if (nullptr != r->fmt)
+            {
+                auto res = formats_.emplace(r->fmt, static_cast<uint32_t>(formats_.size() + 1));
+                head.id = res.first->second;
+                if (res.second)
                 {
-                    ofs_->flush();
+                    //first use of the format in this file
+                    head.type = log_format::entry_type::format;
+                    head.size = static_cast<uint32_t>(strlen(r->fmt));
+                    push_head(head);
+                    iov_.push_back(iovec{ const_cast<char*>(r->fmt), head.size });
                 }
             }
+            head.type = (nullptr != r->fmt) ? log_format::entry_type::packed : log_format::entry_type::text;
+            head.level = r->level;
+            head.size = r->len;
+            head.time = r->time;
+            head.thread = r->thread;
+            push_head(head);
+            iov_.push_back(iovec{ const_cast<char*>(data), r->len });
         }
 
-        const char* to_string(LogLevel lv) const
+        void push_head(const log_format::entry_head& head)
         {
-            switch (lv)
+            char* p = scratch_.get() + scratch_used_;
+            memcpy(p, &head, sizeof(head));
+            scratch_used_ += sizeof(head);
+            iov_.push_back(iovec{ p, sizeof(head) });
+        }
+
+        void print(LogLevel level, moon::string_view_t s, moon::string_view_t text)
+        {
+            auto& os = (level == LogLevel::Error) ? std::cerr : std::cout;
+            switch (level)
             {
             case LogLevel::Error:
-                return " | ERROR | ";
+                os << termcolor::red;
+                break;
             case LogLevel::Warn:
-                return " | WARN  | ";
+                os << termcolor::yellow;
+                break;
             case LogLevel::Info:
-                return " | INFO  | ";
+                os << termcolor::white;
+                break;
             case LogLevel::Debug:
-                return " | DEBUG | ";
+                os << termcolor::green;
+                break;
             default:
-                return " | NULL  | ";
+                break;
+            }
+            os << s;
+            if (!text.empty())
+            {
+                os << text << '\n';
+            }
+            std::cout << termcolor::white;
+        }
+
+        void write_dropped(size_t count)
+        {
+            alignas(log_ring::ALIGN) char buf[sizeof(log_ring::record) + 64];
+            auto r = reinterpret_cast<log_ring::record*>(buf);
+            int len = snprintf(buf + sizeof(log_ring::record), 64, "log overload, %zu logs dropped", count);
+            r->len = static_cast<uint32_t>(std::min(len, 63));
+            r->time = time::millsecond();
+            r->thread = moon::thread_id();
+            r->fmt = nullptr;
+            r->console = 1;
+            r->level = static_cast<uint8_t>(LogLevel::Warn);
+            write_record(r);
+            write_file();
+        }
+
+        bool open_file()
+        {
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+            fp_ = std::fopen(path_.data(), "wb");
+            bool ok = (nullptr != fp_);
+#else
+            fd_ = ::open(path_.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            bool ok = (fd_ >= 0);
+#endif
+            file_size_ = 0;
+            formats_.clear();
+            if (ok && binary_)
+            {
+                iov_.push_back(iovec{ const_cast<char*>(log_format::FILE_MAGIC), sizeof(log_format::FILE_MAGIC) });
+                write_file();
             }
+            if (interval_ > 0)
+            {
+                std::time_t now = std::time(nullptr);
+                std::tm m;
+                moon::time::localtime(&now, &m);
+                std::time_t midnight = now - (m.tm_hour * 3600 + m.tm_min * 60 + m.tm_sec);
+                next_rotate_ = midnight + ((now - midnight) / interval_ + 1) * interval_;
+            }
+            return ok;
+        }
+
+        void close_file()
+        {
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+            if (nullptr != fp_)
+            {
+                std::fclose(fp_);
+                fp_ = nullptr;
+            }
+#else
+            if (fd_ >= 0)
+            {
+                ::close(fd_);
+                fd_ = -1;
+            }
+#endif
         }
 
+        bool is_open() const
+        {
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+            return nullptr != fp_;
+#else
+            return fd_ >= 0;
+#endif
+        }
+
+        //write and clear the iovecs of the batch
+        void write_file()
+        {
+            if (iov_.empty())
+            {
+                return;
+            }
+            if (is_open())
+            {
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+                for (auto& v : iov_)
+                {
+                    std::fwrite(v.iov_base, 1, v.iov_len, fp_);
+                    file_size_ += v.iov_len;
+                }
+                std::fflush(fp_);
+#else
+                iovec* v = iov_.data();
+                int count = static_cast<int>(iov_.size());
+                while (count > 0)
+                {
+                    ssize_t n = ::writev(fd_, v, count);
+                    if (n < 0)
+                    {
+                        if (errno == EINTR)
+                        {
+                            continue;
+                        }
+                        break;
+                    }
+                    file_size_ += static_cast<size_t>(n);
+                    //partial write: skip the written iovecs
+                    auto left = static_cast<size_t>(n);
+                    while (count > 0 && left >= v->iov_len)
+                    {
+                        left -= v->iov_len;
+                        ++v;
+                        --count;
+                    }
+                    if (count > 0)
+                    {
+                        v->iov_base = static_cast<char*>(v->iov_base) + left;
+                        v->iov_len -= left;
+                    }
+                }
+#endif
+            }
+            iov_.clear();
+            scratch_used_ = 0;
+        }
+
+        void rotate()
+        {
+            if (!is_open() || (0 == max_size_ && 0 == interval_))
+            {
+                return;
+            }
+            std::time_t now = std::time(nullptr);
+            if (!((max_size_ > 0 && file_size_ >= max_size_) || (interval_ > 0 && now >= next_rotate_)))
+            {
+                return;
+            }
+
+            close_file();
+            std::tm m;
+            moon::time::localtime(&now, &m);
+            char suffix[32];
+            std::strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &m);
+            std::string name = path_ + suffix;
+            std::error_code ec;
+            for (int i = 1; fs::exists(name, ec); ++i)
+            {
+                name = path_ + suffix + "-" + std::to_string(i);
+            }
+            fs::rename(path_, name, ec);
+            if (ec || !open_file())
+            {
+                std::cerr << "log rotate " << path_ << " failed: " << ec.message() << std::endl;
+            }
+        }
+
+
         std::atomic<state> state_;
         std::atomic<LogLevel> level_;
-        std::unique_ptr<std::ofstream > ofs_;
+        std::atomic<LogLevel> drop_level_;
+        //identifies this log in the thread local ring cache
+        const size_t id_;
+        std::atomic<size_t> dropped_ = 0;
+        std::atomic<size_t> dropped_total_ = 0;
+
+        std::mutex rings_lock_;
+        std::vector<std::pair<std::thread::id, std::unique_ptr<log_ring>>> rings_;
+        std::atomic<size_t> rings_count_ = 0;
+
+        std::mutex sleep_lock_;
+        std::condition_variable sleep_cond_;
+        std::atomic<bool> sleeping_ = false;
+
+        //writer thread only, after init
+        std::string path_;
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+        std::FILE* fp_ = nullptr;
+#else
+        int fd_ = -1;
+#endif
+        size_t file_size_ = 0;
+        size_t max_size_ = 0;
+        int64_t interval_ = 0;
+        std::time_t next_rotate_ = 0;
+        std::vector<iovec> iov_;
+        bool binary_ = false;
+        //id of each format written to the binary log file
+        std::unordered_map<const char*, uint32_t> formats_;
+        std::unique_ptr<char[]> scratch_;
+        size_t scratch_used_ = 0;
+        log_header header_;
+
         std::thread thread_;
-        shared_pointer_pool<buffer, 1000, spin_lock> buffer_cache_;
-        using queue_t = concurrent_queue<std::shared_ptr<buffer>, std::mutex, std::vector, true>;
-        queue_t log_queue_;
     };
 
-#define CONSOLE_INFO(logger,fmt,...) logger->logfmt(true,moon::LogLevel::Info,fmt,##__VA_ARGS__);
-#define CONSOLE_WARN(logger,fmt,...) logger->logfmt(true,moon::LogLevel::Warn,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
-#define CONSOLE_ERROR(logger,fmt,...) logger->logfmt(true,moon::LogLevel::Error,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
-
-#define LOG_INFO(logger,fmt,...) logger->logfmt(false,moon::LogLevel::Info,fmt,##__VA_ARGS__);  
-#define LOG_WARN(logger,fmt,...) logger->logfmt(false,moon::LogLevel::Warn,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
-#define LOG_ERROR(logger,fmt,...) logger->logfmt(false,moon::LogLevel::Error,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
+/*
+    Arguments are evaluated only when the level is enabled, packed and formatted by the log writer.
+    fmt must be a string literal, it is checked against the arguments at compile time.
+*/
+#define MOON_LOG(logger,console,level,fmt,...) do {\
+    static_assert(moon::log_format::check<decltype(moon::log_format::arg_types(__VA_ARGS__))>(fmt), "log format does not match arguments: " fmt);\
+    if ((logger)->enabled(level)) (logger)->logdefer(console, level, fmt, ##__VA_ARGS__);\
+} while (0)
 
-#define CONSOLE_DEBUG(logger,fmt,...) logger->logfmt(true,moon::LogLevel::Debug,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
-#define LOG_DEBUG(logger,fmt,...) logger->logfmt(false,moon::LogLevel::Debug,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
-}
+#define CONSOLE_INFO(logger,fmt,...) MOON_LOG(logger,true,moon::LogLevel::Info,fmt,##__VA_ARGS__);
+#define CONSOLE_WARN(logger,fmt,...) MOON_LOG(logger,true,moon::LogLevel::Warn,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
+#define CONSOLE_ERROR(logger,fmt,...) MOON_LOG(logger,true,moon::LogLevel::Error,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
 
+#define LOG_INFO(logger,fmt,...) MOON_LOG(logger,false,moon::LogLevel::Info,fmt,##__VA_ARGS__);
+#define LOG_WARN(logger,fmt,...) MOON_LOG(logger,false,moon::LogLevel::Warn,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
+#define LOG_ERROR(logger,fmt,...) MOON_LOG(logger,false,moon::LogLevel::Error,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
 
+#define CONSOLE_DEBUG(logger,fmt,...) MOON_LOG(logger,true,moon::LogLevel::Debug,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
+#define LOG_DEBUG(logger,fmt,...) MOON_LOG(logger,false,moon::LogLevel::Debug,fmt" (%s:%d)",##__VA_ARGS__,__FILENAME__,__LINE__);
+}
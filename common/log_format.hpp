@@ -0,0 +1,549 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <algorithm>
+
+namespace moon
+{
+    /*
+        Deferred formatting of printf style logs: the logging thread packs the arguments, the log writer
+        formats them, or writes them to a binary log file formatted offline by tools/log_decoder.
+        The format is checked against the argument types at compile time.
+    */
+    namespace log_format
+    {
+        //longer string arguments are truncated, as the formatted log
+        constexpr size_t MAX_STRING = 8 * 1024;
+
+        enum class arg_kind :uint8_t
+        {
+            invalid,
+            integer,
+            unsigned_integer,
+            floating,
+            string,
+            pointer
+        };
+
+        template<typename T>
+        constexpr arg_kind kind_of()
+        {
+            using type = std::decay_t<T>;
+            if constexpr (std::is_same_v<type, char*> || std::is_same_v<type, const char*>
+                || std::is_same_v<type, std::string> || std::is_same_v<type, std::string_view>)
+                return arg_kind::string;
+            else if constexpr (std::is_floating_point_v<type>)
+                return arg_kind::floating;
+            else if constexpr (std::is_enum_v<type>)
+                return kind_of<std::underlying_type_t<type>>();
+            else if constexpr (std::is_integral_v<type>)
+                return std::is_signed_v<type> ? arg_kind::integer : arg_kind::unsigned_integer;
+            else if constexpr (std::is_pointer_v<type> || std::is_null_pointer_v<type>)
+                return arg_kind::pointer;
+            else
+                return arg_kind::invalid;
+        }
+
+        template<typename... Args>
+        struct arg_list
+        {
+            static constexpr size_t size = sizeof...(Args);
+            static constexpr arg_kind kinds[sizeof...(Args) + 1] = { kind_of<Args>()..., arg_kind::invalid };
+        };
+
+        //declaration only, decltype(arg_types(args...)) is the arg_list of a log call
+        template<typename... Args>
+        arg_list<std::decay_t<Args>...> arg_types(Args&&...);
+
+        //a conversion specification: %[flags][width][.precision][length]conversion
+        struct spec
+        {
+            //bytes from '%' to the conversion
+            size_t size = 0;
+            //0: incomplete
+            char conversion = 0;
+            bool star_width = false;
+            bool star_precision = false;
+            //the length modifier is replaced by the packed type when formatting
+            size_t length_begin = 0;
+            //bytes of the integer the length modifier names, 0: none
+            size_t length_width = 0;
+        };
+
+        //fmt[0] is '%'
+        constexpr spec parse_spec(const char* fmt)
+        {
+            spec s;
+            size_t i = 1;
+            while (fmt[i] == '-' || fmt[i] == '+' || fmt[i] == ' ' || fmt[i] == '#' || fmt[i] == '0')
+            {
+                ++i;
+            }
+            if (fmt[i] == '*')
+            {
+                s.star_width = true;
+                ++i;
+            }
+            while (fmt[i] >= '0' && fmt[i] <= '9')
+            {
+                ++i;
+            }
+            if (fmt[i] == '.')
+            {
+                ++i;
+                if (fmt[i] == '*')
+                {
+                    s.star_precision = true;
+                    ++i;
+                }
+                while (fmt[i] >= '0' && fmt[i] <= '9')
+                {
+                    ++i;
+                }
+            }
+            s.length_begin = i;
+            while (fmt[i] == 'h' || fmt[i] == 'l' || fmt[i] == 'L' || fmt[i] == 'q' || fmt[i] == 'j' || fmt[i] == 'z' || fmt[i] == 't')
+            {
+                ++i;
+            }
+            switch (i - s.length_begin)
+            {
+            case 1:
+                switch (fmt[s.length_begin])
+                {
+                case 'h': s.length_width = sizeof(short); break;
+                case 'l': s.length_width = sizeof(long); break;
+                case 'j': s.length_width = sizeof(intmax_t); break;
+                case 'z': s.length_width = sizeof(size_t); break;
+                case 't': s.length_width = sizeof(ptrdiff_t); break;
+                default: s.length_width = sizeof(long long); break;
+                }
+                break;
+            case 2:
+                s.length_width = (fmt[s.length_begin] == 'h') ? sizeof(char) : sizeof(long long);
+                break;
+            default:
+                break;
+            }
+            s.conversion = fmt[i];
+            s.size = i + 1;
+            return s;
+        }
+
+        constexpr bool accepts(char conversion, arg_kind kind)
+        {
+            switch (conversion)
+            {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                return kind == arg_kind::integer || kind == arg_kind::unsigned_integer;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                return kind == arg_kind::floating;
+            case 's':
+                return kind == arg_kind::string;
+            case 'p':
+                return kind == arg_kind::pointer;
+            default:
+                return false;
+            }
+        }
+
+        //true: each conversion of fmt has an argument of a matching kind, no argument left
+        template<typename ArgList>
+        constexpr bool check(const char* fmt)
+        {
+            size_t n = 0;
+            for (size_t i = 0; fmt[i] != '\0'; ++i)
+            {
+                if (fmt[i] != '%')
+                {
+                    continue;
+                }
+                if (fmt[i + 1] == '%')
+                {
+                    ++i;
+                    continue;
+                }
+                spec s = parse_spec(fmt + i);
+                if (s.star_width && (n == ArgList::size || !accepts('d', ArgList::kinds[n++])))
+                {
+                    return false;
+                }
+                if (s.star_precision && (n == ArgList::size || !accepts('d', ArgList::kinds[n++])))
+                {
+                    return false;
+                }
+                if (n == ArgList::size || !accepts(s.conversion, ArgList::kinds[n++]))
+                {
+                    return false;
+                }
+                i += s.size - 1;
+            }
+            return n == ArgList::size;
+        }
+
+        template<typename T>
+        std::string_view string_of(const T& v)
+        {
+            if constexpr (std::is_array_v<T>)
+            {
+                return std::string_view{ v };
+            }
+            else if constexpr (std::is_same_v<T, char*> || std::is_same_v<T, const char*>)
+            {
+                return (nullptr != v) ? std::string_view{ v } : std::string_view{ "(null)" };
+            }
+            else
+            {
+                return std::string_view{ v.data(), v.size() };
+            }
+        }
+
+        //bytes of an integer argument, 0: other kinds
+        template<typename T>
+        constexpr size_t width_of()
+        {
+            using type = std::decay_t<T>;
+            if constexpr (std::is_enum_v<type> || std::is_integral_v<type>)
+                return sizeof(type);
+            else
+                return 0;
+        }
+
+        /*
+            packed argument: kind byte, then 8 bytes value, or uint32 size and bytes of string.
+            kind byte: arg_kind in the low 4 bits, width_of an integer in the high 4 bits (0: 8 bytes).
+        */
+        template<typename T>
+        size_t packed_size(const T& v)
+        {
+            if constexpr (kind_of<T>() == arg_kind::string)
+            {
+                return 1 + sizeof(uint32_t) + std::min(string_of(v).size(), MAX_STRING);
+            }
+            else
+            {
+                return 1 + sizeof(uint64_t);
+            }
+        }
+
+        template<typename T>
+        char* pack(char* p, const T& v)
+        {
+            constexpr arg_kind kind = kind_of<T>();
+            static_assert(kind != arg_kind::invalid, "unsupported log argument type");
+            *(p++) = static_cast<char>(static_cast<uint8_t>(kind) | (width_of<T>() << 4));
+            if constexpr (kind == arg_kind::string)
+            {
+                auto s = string_of(v);
+                auto size = static_cast<uint32_t>(std::min(s.size(), MAX_STRING));
+                memcpy(p, &size, sizeof(size));
+                memcpy(p + sizeof(size), s.data(), size);
+                return p + sizeof(size) + size;
+            }
+            else
+            {
+                uint64_t u = 0;
+                if constexpr (kind == arg_kind::floating)
+                {
+                    double d = static_cast<double>(v);
+                    memcpy(&u, &d, sizeof(d));
+                }
+                else if constexpr (kind == arg_kind::pointer)
+                {
+                    u = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(v));
+                }
+                else if constexpr (kind == arg_kind::integer)
+                {
+                    u = static_cast<uint64_t>(static_cast<int64_t>(v));
+                }
+                else
+                {
+                    u = static_cast<uint64_t>(v);
+                }
+                memcpy(p, &u, sizeof(u));
+                return p + sizeof(u);
+            }
+        }
+
+        struct arg
+        {
+            arg_kind kind = arg_kind::invalid;
+            //bytes of an integer argument
+            uint8_t width = 0;
+            //integers sign extended or zero extended to 64 bits
+            uint64_t value = 0;
+            std::string_view str;
+        };
+
+        //value of an integer argument as printf reads it for the conversion: truncated to the width of the
+        //length modifier, or of the argument promoted to int, then sign extended for signed conversions
+        inline uint64_t convert(const arg& a, const spec& s)
+        {
+            size_t width = (s.length_width != 0) ? s.length_width : std::max<size_t>(a.width, sizeof(int));
+            if (width >= sizeof(uint64_t))
+            {
+                return a.value;
+            }
+            uint64_t v = a.value & ((uint64_t{ 1 } << (width * 8)) - 1);
+            uint64_t sign = uint64_t{ 1 } << (width * 8 - 1);
+            if ((s.conversion == 'd' || s.conversion == 'i') && (v & sign) != 0)
+            {
+                v |= ~((sign << 1) - 1);
+            }
+            return v;
+        }
+
+        //reads the argument at p and moves p after it. false: malformed
+        inline bool unpack(const char*& p, const char* end, arg& a)
+        {
+            if (p == end)
+            {
+                return false;
+            }
+            auto b = static_cast<uint8_t>(*(p++));
+            a.kind = static_cast<arg_kind>(b & 0x0F);
+            a.width = static_cast<uint8_t>(b >> 4);
+            if (a.width == 0 || a.width > sizeof(uint64_t))
+            {
+                a.width = sizeof(uint64_t);
+            }
+            if (a.kind == arg_kind::string)
+            {
+                uint32_t size = 0;
+                if (static_cast<size_t>(end - p) < sizeof(size))
+                {
+                    return false;
+                }
+                memcpy(&size, p, sizeof(size));
+                p += sizeof(size);
+                if (static_cast<size_t>(end - p) < size)
+                {
+                    return false;
+                }
+                a.str = std::string_view{ p, size };
+                p += size;
+                return true;
+            }
+            if (a.kind == arg_kind::invalid || a.kind > arg_kind::pointer || static_cast<size_t>(end - p) < sizeof(a.value))
+            {
+                return false;
+            }
+            memcpy(&a.value, p, sizeof(a.value));
+            p += sizeof(a.value);
+            return true;
+        }
+
+        /*
+            formats fmt with the packed arguments [args, args + size) to buf, truncated to len - 1 bytes.
+            returns the bytes written. stops at malformed arguments.
+        */
+        inline size_t format(char* buf, size_t len, const char* fmt, const char* args, size_t size)
+        {
+            if (len == 0)
+            {
+                return 0;
+            }
+            const char* end = args + size;
+            size_t n = 0;
+            for (const char* c = fmt; *c != '\0' && n + 1 < len; ++c)
+            {
+                if (*c != '%')
+                {
+                    buf[n++] = *c;
+                    continue;
+                }
+                if (c[1] == '%')
+                {
+                    buf[n++] = '%';
+                    ++c;
+                    continue;
+                }
+
+                spec s = parse_spec(c);
+                //flags, width and precision, '*' replaced by its argument
+                char sp[64];
+                size_t k = 0;
+                int precision = -1;
+                bool in_precision = false;
+                bool ok = (s.conversion != 0 && s.length_begin < 32);
+                for (size_t i = 0; ok && i < s.length_begin; ++i)
+                {
+                    if (c[i] == '.')
+                    {
+                        in_precision = true;
+                        precision = 0;
+                    }
+                    if (c[i] != '*')
+                    {
+                        sp[k++] = c[i];
+                        if (in_precision && c[i] >= '0' && c[i] <= '9')
+                        {
+                            precision = precision * 10 + (c[i] - '0');
+                        }
+                        continue;
+                    }
+                    arg a;
+                    ok = unpack(args, end, a) && (a.kind == arg_kind::integer || a.kind == arg_kind::unsigned_integer);
+                    int v = ok ? static_cast<int>(static_cast<int64_t>(a.value)) : 0;
+                    if (in_precision)
+                    {
+                        //negative precision is taken as omitted
+                        precision = std::max(v, 0);
+                        if (v < 0)
+                        {
+                            --k;
+                            in_precision = false;
+                            precision = -1;
+                            continue;
+                        }
+                    }
+                    k += static_cast<size_t>(snprintf(sp + k, sizeof(sp) - k, "%d", v));
+                }
+
+                arg a;
+                if (!ok || !unpack(args, end, a) || !accepts(s.conversion, a.kind))
+                {
+                    break;
+                }
+
+                if ((a.kind == arg_kind::integer || a.kind == arg_kind::unsigned_integer) && s.conversion != 'c')
+                {
+                    a.value = convert(a, s);
+                }
+
+                int r = 0;
+                size_t left = len - n;
+                //plain %d %i %u %s, without snprintf
+                if (k == 1 && s.conversion == 's')
+                {
+                    size_t size = std::min(a.str.size(), left - 1);
+                    memcpy(buf + n, a.str.data(), size);
+                    n += size;
+                    c += s.size - 1;
+                    continue;
+                }
+                if (k == 1 && (s.conversion == 'd' || s.conversion == 'i' || s.conversion == 'u') && left > 21)
+                {
+                    uint64_t v = a.value;
+                    if (s.conversion != 'u' && static_cast<int64_t>(v) < 0)
+                    {
+                        buf[n++] = '-';
+                        v = 0 - v;
+                    }
+                    char digits[20];
+                    size_t count = 0;
+                    do
+                    {
+                        digits[count++] = static_cast<char>('0' + v % 10);
+                        v /= 10;
+                    } while (v != 0);
+                    while (count > 0)
+                    {
+                        buf[n++] = digits[--count];
+                    }
+                    c += s.size - 1;
+                    continue;
+                }
+                switch (a.kind)
+                {
+                case arg_kind::integer:
+                case arg_kind::unsigned_integer:
+                    if (s.conversion == 'c')
+                    {
+                        sp[k++] = 'c';
+                        sp[k] = '\0';
+                        r = snprintf(buf + n, left, sp, static_cast<int>(a.value));
+                    }
+                    else
+                    {
+                        sp[k++] = 'l';
+                        sp[k++] = 'l';
+                        sp[k++] = s.conversion;
+                        sp[k] = '\0';
+                        if (s.conversion == 'd' || s.conversion == 'i')
+                            r = snprintf(buf + n, left, sp, static_cast<long long>(static_cast<int64_t>(a.value)));
+                        else
+                            r = snprintf(buf + n, left, sp, static_cast<unsigned long long>(a.value));
+                    }
+                    break;
+                case arg_kind::floating:
+                {
+                    double d = 0;
+                    memcpy(&d, &a.value, sizeof(d));
+                    sp[k++] = s.conversion;
+                    sp[k] = '\0';
+                    r = snprintf(buf + n, left, sp, d);
+                    break;
+                }
+                case arg_kind::string:
+                {
+                    //string is not null terminated: precision limits it
+                    if (in_precision)
+                    {
+                        while (sp[k - 1] != '.')
+                        {
+                            --k;
+                        }
+                        --k;
+                    }
+                    int size = static_cast<int>(a.str.size());
+                    if (precision >= 0 && precision < size)
+                    {
+                        size = precision;
+                    }
+                    memcpy(sp + k, ".*s", 4);
+                    r = snprintf(buf + n, left, sp, size, a.str.data());
+                    break;
+                }
+                case arg_kind::pointer:
+                    sp[k++] = 'p';
+                    sp[k] = '\0';
+                    r = snprintf(buf + n, left, sp, reinterpret_cast<void*>(static_cast<uintptr_t>(a.value)));
+                    break;
+                default:
+                    break;
+                }
+                if (r > 0)
+                {
+                    n += std::min(static_cast<size_t>(r), left - 1);
+                }
+                c += s.size - 1;
+            }
+            buf[n] = '\0';
+            return n;
+        }
+
+        /*
+            binary log file: FILE_MAGIC, then entries, each an entry_head and size bytes of payload, native byte order.
+            format entry: id and the format string, defined before the packed entries of it in the same file.
+            text entry: the text. packed entry: id of the format and the packed arguments.
+        */
+        constexpr char FILE_MAGIC[8] = { 'M','O','O','N','L','O','G','1' };
+
+        enum class entry_type :uint8_t
+        {
+            format = 1,
+            text,
+            packed
+        };
+
+        struct entry_head
+        {
+            entry_type type;
+            uint8_t level;
+            uint16_t reserved;
+            uint32_t size;
+            uint32_t id;
+            uint32_t reserved2;
+            //milliseconds since epoch
+            int64_t time;
+            uint64_t thread;
+        };
+        static_assert(sizeof(entry_head) == 32, "entry_head is part of the file format");
+    }
+}
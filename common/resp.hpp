@@ -0,0 +1,274 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <vector>
+
+namespace moon
+{
+    /*
+        RESP2/RESP3 (redis serialization protocol) parsing, shared by the connection framer and the lua decoder.
+        An element is a type byte, a line ended by CRLF, and for bulk types the payload and CRLF.
+    */
+    namespace resp
+    {
+        //nesting limit of aggregates
+        constexpr size_t MAX_NESTING = 64;
+        //as redis proto-max-bulk-len
+        constexpr int64_t MAX_BULK_SIZE = 512 * 1024 * 1024;
+
+        enum class parse_result
+        {
+            ok,
+            more,//incomplete element, need more data
+            error,
+        };
+
+        struct element
+        {
+            char type = 0;
+            //simple types: the line. bulk types: the payload
+            const char* data = nullptr;
+            size_t size = 0;
+            //aggregate types: number of child elements, -1: null. bulk types: -1 null
+            int64_t count = 0;
+            //offset after the element header, or after the payload of bulk types
+            size_t next = 0;
+        };
+
+        inline bool is_aggregate(char type)
+        {
+            switch (type)
+            {
+            case '*':
+            case '%':
+            case '~':
+            case '>':
+            case '|':
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        //decimal integer of [begin, end), optional '-'. false: empty, invalid char or overflow
+        inline bool parse_integer(const char* begin, const char* end, int64_t& v)
+        {
+            bool neg = false;
+            if (begin < end && *begin == '-')
+            {
+                neg = true;
+                ++begin;
+            }
+            if (begin == end)
+            {
+                return false;
+            }
+            uint64_t n = 0;
+            for (; begin < end; ++begin)
+            {
+                unsigned d = static_cast<unsigned char>(*begin) - '0';
+                if (d > 9 || n > (UINT64_MAX - d) / 10)
+                {
+                    return false;
+                }
+                n = n * 10 + d;
+            }
+            if (n > static_cast<uint64_t>(INT64_MAX) + (neg ? 1 : 0))
+            {
+                return false;
+            }
+            v = neg ? static_cast<int64_t>(0 - n) : static_cast<int64_t>(n);
+            return true;
+        }
+
+        //[begin, end) is followed by '\r' that stops strtod. leading space is rejected: strtod would skip CRLF
+        inline bool parse_double(const char* begin, const char* end, double& v)
+        {
+            if (begin == end || std::isspace(static_cast<unsigned char>(*begin)))
+            {
+                return false;
+            }
+            char* stop = nullptr;
+            v = std::strtod(begin, &stop);
+            return stop == end;
+        }
+
+        //each element takes at least 3 bytes: type and CRLF
+        constexpr size_t MIN_ELEMENT_SIZE = 3;
+
+        //element header at data[pos]. child elements of aggregate types are not parsed
+        inline parse_result parse_element(const char* data, size_t size, size_t pos, element& e)
+        {
+            if (pos >= size)
+            {
+                return parse_result::more;
+            }
+            auto lf = static_cast<const char*>(std::memchr(data + pos, '\n', size - pos));
+            if (nullptr == lf)
+            {
+                return parse_result::more;
+            }
+            const char* line = data + pos + 1;
+            if (lf <= line || *(lf - 1) != '\r')
+            {
+                return parse_result::error;
+            }
+            const char* line_end = lf - 1;
+            e.type = data[pos];
+            e.next = static_cast<size_t>(lf - data) + 1;
+            e.data = line;
+            e.size = static_cast<size_t>(line_end - line);
+            e.count = 0;
+            switch (e.type)
+            {
+            case '+':
+            case '-':
+            case '(':
+                return parse_result::ok;
+            case ':':
+            {
+                int64_t v = 0;
+                return parse_integer(line, line_end, v) ? parse_result::ok : parse_result::error;
+            }
+            case ',':
+            {
+                double v = 0;
+                return parse_double(line, line_end, v) ? parse_result::ok : parse_result::error;
+            }
+            case '#':
+                return (e.size == 1 && (*line == 't' || *line == 'f')) ? parse_result::ok : parse_result::error;
+            case '_':
+                return (e.size == 0) ? parse_result::ok : parse_result::error;
+            case '$':
+            case '!':
+            case '=':
+            {
+                int64_t n = 0;
+                if (!parse_integer(line, line_end, n) || n < -1 || n > MAX_BULK_SIZE || (n == -1 && e.type != '$'))
+                {
+                    return parse_result::error;
+                }
+                e.count = n;
+                if (n < 0)
+                {
+                    e.data = nullptr;
+                    e.size = 0;
+                    return parse_result::ok;
+                }
+                size_t end = e.next + static_cast<size_t>(n);
+                if (end + 2 > size)
+                {
+                    return parse_result::more;
+                }
+                if (data[end] != '\r' || data[end + 1] != '\n')
+                {
+                    return parse_result::error;
+                }
+                e.data = data + e.next;
+                e.size = static_cast<size_t>(n);
+                e.next = end + 2;
+                //verbatim string: 3 bytes format and ':'
+                if (e.type == '=' && (e.size < 4 || e.data[3] != ':'))
+                {
+                    return parse_result::error;
+                }
+                return parse_result::ok;
+            }
+            case '*':
+            case '%':
+            case '~':
+            case '>':
+            case '|':
+            {
+                int64_t n = 0;
+                if (!parse_integer(line, line_end, n) || n < -1 || n > INT32_MAX || (n == -1 && e.type != '*'))
+                {
+                    return parse_result::error;
+                }
+                if (e.type == '%' || e.type == '|')
+                {
+                    n *= 2;
+                }
+                if (e.type == '|')
+                {
+                    //attribute is followed by the value it describes
+                    n += 1;
+                }
+                e.count = n;
+                return parse_result::ok;
+            }
+            default:
+                return parse_result::error;
+            }
+        }
+
+        /*
+            Finds the end of complete replies in a receive buffer, incrementally: the state of a partial
+            reply is kept, so data is scanned once however it is split into reads.
+        */
+        class framer
+        {
+        public:
+            //data[0, size) holds the data of the previous call at the front. returns the size of complete
+            //replies at the front, 0: none, -1: protocol error. the caller removes the returned bytes.
+            int64_t frame(const char* data, size_t size)
+            {
+                size_t done = 0;
+                while (true)
+                {
+                    element e;
+                    auto res = parse_element(data, size, pos_, e);
+                    if (res == parse_result::more)
+                    {
+                        break;
+                    }
+                    if (res == parse_result::error)
+                    {
+                        return fail(done);
+                    }
+                    pos_ = e.next;
+                    if (is_aggregate(e.type) && e.count > 0)
+                    {
+                        if (stack_.size() == MAX_NESTING)
+                        {
+                            return fail(done);
+                        }
+                        stack_.push_back(e.count);
+                        continue;
+                    }
+                    //an element done, and the aggregates it completes
+                    while (!stack_.empty() && --stack_.back() == 0)
+                    {
+                        stack_.pop_back();
+                    }
+                    if (stack_.empty())
+                    {
+                        done = pos_;
+                    }
+                }
+                pos_ -= done;
+                return static_cast<int64_t>(done);
+            }
+
+            void reset()
+            {
+                pos_ = 0;
+                stack_.clear();
+            }
+        private:
+            //replies before the error are returned, the error is found again by next call
+            int64_t fail(size_t done)
+            {
+                reset();
+                return (done > 0) ? static_cast<int64_t>(done) : -1;
+            }
+        private:
+            //start of the next element, relative to the data after the returned replies
+            size_t pos_ = 0;
+            //elements left of each open aggregate
+            std::vector<int64_t> stack_;
+        };
+    }
+}
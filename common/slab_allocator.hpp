@@ -0,0 +1,434 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include "platform_define.hpp"
+#include "noncopyable.hpp"
+
+#if TARGET_PLATFORM != PLATFORM_WINDOWS
+#include <sys/mman.h>
+#endif
+
+namespace moon
+{
+    /*
+        Size-class slab allocator, used by one thread at a time (e.g. a lua state), no lock.
+        Blocks <= MAX_BLOCK_SIZE come from PAGE_SIZE aligned pages, one size class per page,
+        bigger blocks use malloc. Like lua_Alloc, deallocate/reallocate need the block size.
+        Empty pages go back to a thread local page cache shared by all allocators of the thread,
+        so a page may be freed by another thread than it was allocated: pages are plain memory.
+        Pages are mapped from OS directly (except windows), aligned blocks in malloc heap leave holes.
+        Pages over the thread cache limit are returned to OS by madvise and kept in a global pool,
+        munmap of single pages would split the mapping into too many areas.
+    */
+    class slab_allocator : public noncopyable
+    {
+    public:
+        static constexpr size_t PAGE_SIZE = 16 * 1024;
+        static constexpr size_t ALIGNMENT = 16;
+        //size classes: 16 bytes step up to 128, then 32 bytes step up to 256.
+        //few classes: the partial pages of a small lua state are mostly waste
+        static constexpr size_t MEDIUM_SIZE = 128;
+        static constexpr size_t MEDIUM_STEP = 32;
+        static constexpr size_t MAX_BLOCK_SIZE = 256;
+        static constexpr size_t CLASS_NUM = MEDIUM_SIZE / ALIGNMENT + (MAX_BLOCK_SIZE - MEDIUM_SIZE) / MEDIUM_STEP;
+        //empty pages kept by each thread
+        static constexpr size_t MAX_CACHED_PAGES = 256;
+        //pages mapped or taken from global pool at once
+        static constexpr size_t MAP_PAGES = 16;
+
+        slab_allocator() = default;
+
+        ~slab_allocator()
+        {
+            for (size_t i = 0; i < CLASS_NUM; ++i)
+            {
+                release_list(partial_[i]);
+                release_list(full_[i]);
+            }
+        }
+
+        void* allocate(size_t size)
+        {
+            if (size > MAX_BLOCK_SIZE)
+            {
+                return std::malloc(size);
+            }
+
+            size_t cls = size_class(size);
+            page* p = partial_[cls];
+            if (nullptr == p)
+            {
+                p = new_page(cls);
+                if (nullptr == p)
+                {
+                    return nullptr;
+                }
+            }
+
+            size_t bsize = block_size(cls);
+            void* block = p->freelist;
+            if (nullptr != block)
+            {
+                p->freelist = *static_cast<void**>(block);
+            }
+            else
+            {
+                block = p->bump;
+                p->bump += bsize;
+            }
+            ++p->used;
+            small_bytes_ += bsize;
+
+            if (nullptr == p->freelist && p->bump + bsize > reinterpret_cast<char*>(p) + PAGE_SIZE)
+            {
+                unlink(partial_[cls], p);
+                link(full_[cls], p);
+                p->full = true;
+            }
+            return block;
+        }
+
+        void deallocate(void* ptr, size_t size)
+        {
+            if (nullptr == ptr)
+            {
+                return;
+            }
+
+            if (size > MAX_BLOCK_SIZE)
+            {
+                std::free(ptr);
+                return;
+            }
+
+            page* p = page_of(ptr);
+            size_t cls = p->cls;
+            *static_cast<void**>(ptr) = p->freelist;
+            p->freelist = ptr;
+            --p->used;
+            small_bytes_ -= block_size(cls);
+
+            if (p->full)
+            {
+                unlink(full_[cls], p);
+                link(partial_[cls], p);
+                p->full = false;
+            }
+
+            //keep the last partial page of the class, avoid page thrashing
+            if (p->used == 0 && (nullptr != p->prev || nullptr != p->next))
+            {
+                unlink(partial_[cls], p);
+                release_page(p);
+            }
+        }
+
+        //same as realloc, the content is kept if allocation fails
+        void* reallocate(void* ptr, size_t osize, size_t nsize)
+        {
+            if (nullptr == ptr)
+            {
+                return allocate(nsize);
+            }
+
+            if (osize > MAX_BLOCK_SIZE && nsize > MAX_BLOCK_SIZE)
+            {
+                return std::realloc(ptr, nsize);
+            }
+
+            if (osize <= MAX_BLOCK_SIZE && nsize <= MAX_BLOCK_SIZE && size_class(osize) == size_class(nsize))
+            {
+                return ptr;
+            }
+
+            void* res = allocate(nsize);
+            if (nullptr != res)
+            {
+                std::memcpy(res, ptr, (osize < nsize) ? osize : nsize);
+                deallocate(ptr, osize);
+            }
+            return res;
+        }
+
+        //memory held by pages
+        size_t page_bytes() const
+        {
+            return pages_ * PAGE_SIZE;
+        }
+
+        //small blocks in use, rounded up to size class
+        size_t small_bytes() const
+        {
+            return small_bytes_;
+        }
+    private:
+        struct page
+        {
+            page* prev;
+            page* next;
+            void* freelist;
+            //next never used block
+            char* bump;
+            uint32_t used;
+            uint16_t cls;
+            bool full;
+        };
+
+        static constexpr size_t HEADER_SIZE = (sizeof(page) + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+        static_assert((PAGE_SIZE & (PAGE_SIZE - 1)) == 0, "PAGE_SIZE must be power of 2");
+
+        //empty pages of all threads, memory is returned to OS but address space is kept for reuse.
+        //never destroyed: allocators may be destroyed by static destructors
+        struct page_pool
+        {
+            std::mutex lock;
+            std::vector<void*> pages;
+        };
+
+        struct page_cache
+        {
+            std::vector<void*> pages;
+
+            ~page_cache()
+            {
+                give_back(pages, pages.size());
+                exited() = true;
+            }
+
+            //allocators used after thread local destruction bypass the cache
+            static bool& exited()
+            {
+                thread_local bool v = false;
+                return v;
+            }
+        };
+
+        static size_t size_class(size_t size)
+        {
+            if (size <= MEDIUM_SIZE)
+            {
+                return (size == 0) ? 0 : (size - 1) / ALIGNMENT;
+            }
+            return MEDIUM_SIZE / ALIGNMENT + (size - MEDIUM_SIZE - 1) / MEDIUM_STEP;
+        }
+
+        static size_t block_size(size_t cls)
+        {
+            if (cls < MEDIUM_SIZE / ALIGNMENT)
+            {
+                return (cls + 1) * ALIGNMENT;
+            }
+            return MEDIUM_SIZE + (cls - MEDIUM_SIZE / ALIGNMENT + 1) * MEDIUM_STEP;
+        }
+
+        static page* page_of(void* ptr)
+        {
+            return reinterpret_cast<page*>(reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t)(PAGE_SIZE - 1));
+        }
+
+        static page_cache* cache()
+        {
+            if (page_cache::exited())
+            {
+                return nullptr;
+            }
+            thread_local page_cache c;
+            return &c;
+        }
+
+        static page_pool& pool()
+        {
+            static page_pool* p = new page_pool;
+            return *p;
+        }
+
+        //move the last n pages of v to pool
+        static void give_back(std::vector<void*>& v, size_t n)
+        {
+            auto first = v.end() - n;
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+            for (auto it = first; it != v.end(); ++it)
+            {
+                _aligned_free(*it);
+            }
+#else
+            for (auto it = first; it != v.end(); ++it)
+            {
+                madvise(*it, PAGE_SIZE, MADV_DONTNEED);
+            }
+            auto& pl = pool();
+            {
+                std::unique_lock<std::mutex> lk(pl.lock);
+                pl.pages.insert(pl.pages.end(), first, v.end());
+            }
+#endif
+            v.erase(first, v.end());
+        }
+
+        //add pages to v, from pool or OS. false: out of memory
+        static bool take(std::vector<void*>& v)
+        {
+#if TARGET_PLATFORM == PLATFORM_WINDOWS
+            void* mem = _aligned_malloc(PAGE_SIZE, PAGE_SIZE);
+            if (nullptr == mem)
+            {
+                return false;
+            }
+            v.push_back(mem);
+            return true;
+#else
+            auto& pl = pool();
+            {
+                std::unique_lock<std::mutex> lk(pl.lock);
+                size_t n = std::min(MAP_PAGES, pl.pages.size());
+                if (n > 0)
+                {
+                    v.insert(v.end(), pl.pages.end() - n, pl.pages.end());
+                    pl.pages.erase(pl.pages.end() - n, pl.pages.end());
+                    return true;
+                }
+            }
+
+            //map one more page, trim to PAGE_SIZE aligned
+            size_t len = (MAP_PAGES + 1) * PAGE_SIZE;
+            void* mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (MAP_FAILED == mem)
+            {
+                return false;
+            }
+            auto begin = reinterpret_cast<uintptr_t>(mem);
+            auto aligned = (begin + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+            auto end = aligned + MAP_PAGES * PAGE_SIZE;
+            if (aligned > begin)
+            {
+                munmap(mem, aligned - begin);
+            }
+            if (end < begin + len)
+            {
+                munmap(reinterpret_cast<void*>(end), begin + len - end);
+            }
+            for (auto p = aligned; p < end; p += PAGE_SIZE)
+            {
+                v.push_back(reinterpret_cast<void*>(p));
+            }
+            return true;
+#endif
+        }
+
+        static void* get_page()
+        {
+            auto c = cache();
+            if (nullptr == c)
+            {
+                std::vector<void*> v;
+                if (!take(v))
+                {
+                    return nullptr;
+                }
+                void* mem = v.front();
+                std::swap(v.front(), v.back());
+                give_back(v, v.size() - 1);
+                return mem;
+            }
+
+            if (c->pages.empty() && !take(c->pages))
+            {
+                return nullptr;
+            }
+            void* mem = c->pages.back();
+            c->pages.pop_back();
+            return mem;
+        }
+
+        static void put_page(void* mem)
+        {
+            auto c = cache();
+            if (nullptr == c)
+            {
+                std::vector<void*> v{ mem };
+                give_back(v, 1);
+                return;
+            }
+
+            c->pages.push_back(mem);
+            if (c->pages.size() > MAX_CACHED_PAGES)
+            {
+                give_back(c->pages, MAX_CACHED_PAGES / 2);
+            }
+        }
+
+        static void link(page*& head, page* p)
+        {
+            p->prev = nullptr;
+            p->next = head;
+            if (nullptr != head)
+            {
+                head->prev = p;
+            }
+            head = p;
+        }
+
+        static void unlink(page*& head, page* p)
+        {
+            if (nullptr != p->prev)
+            {
+                p->prev->next = p->next;
+            }
+            else
+            {
+                head = p->next;
+            }
+            if (nullptr != p->next)
+            {
+                p->next->prev = p->prev;
+            }
+            p->prev = p->next = nullptr;
+        }
+
+        page* new_page(size_t cls)
+        {
+            void* mem = get_page();
+            if (nullptr == mem)
+            {
+                return nullptr;
+            }
+
+            auto p = static_cast<page*>(mem);
+            p->prev = p->next = nullptr;
+            p->freelist = nullptr;
+            p->bump = static_cast<char*>(mem) + HEADER_SIZE;
+            p->used = 0;
+            p->cls = static_cast<uint16_t>(cls);
+            p->full = false;
+            link(partial_[cls], p);
+            ++pages_;
+            return p;
+        }
+
+        void release_page(page* p)
+        {
+            --pages_;
+            put_page(p);
+        }
+
+        void release_list(page*& head)
+        {
+            while (nullptr != head)
+            {
+                page* p = head;
+                unlink(head, p);
+                release_page(p);
+            }
+        }
+    private:
+        size_t pages_ = 0;
+        size_t small_bytes_ = 0;
+        page* partial_[CLASS_NUM] = {};
+        page* full_[CLASS_NUM] = {};
+    };
+}
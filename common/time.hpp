@@ -21,13 +21,18 @@ namespace moon
 
         //e. 2017-11-11 16:03:11.635
         static size_t milltimestamp(char* buf, size_t len)
+        {
+            return milltimestamp(millsecond(), buf, len);
+        }
+
+        //mill: milliseconds since epoch
+        static size_t milltimestamp(int64_t mill, char* buf, size_t len)
         {
             if (len < 23)
             {
                 return 0;
             }
 
-            auto mill = millsecond();
             time_t now = mill / 1000;
             std::tm m;
             moon::time::localtime(&now, &m);
@@ -166,6 +166,17 @@ namespace moon
         }
 
     protected:
+        //drop all timers in wheels, the timer can be used like a new one
+        void clear_wheels()
+        {
+            for (auto& wheel : wheels_)
+            {
+                wheel = timer_wheel_t{};
+            }
+            tick_ = 0;
+            previous_tick_ = 0;
+        }
+
         // slots:      8bit(notuse) 8bit(wheel3_slot)  8bit(wheel2_slot)  8bit(wheel1_slot)  
         uint64_t make_key(timer_id_t id, uint32_t slots)
         {
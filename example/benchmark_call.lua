@@ -0,0 +1,59 @@
+--co_call round trip benchmark between two services
+
+local moon = require("moon")
+
+local N = 200000
+
+--one coroutine calls one by one
+local function sequential(receiver)
+    for i = 1, N do
+        local v = moon.co_call("lua", receiver, i)
+        assert(v == i)
+    end
+end
+
+--every call in its own moon.async, at most `window` calls pending
+local function async_per_call(receiver, window)
+    local co = coroutine.running()
+    local pending = 0
+    local waiting = false
+    for i = 1, N do
+        pending = pending + 1
+        moon.async(function()
+            local v = moon.co_call("lua", receiver, i)
+            assert(v == i)
+            pending = pending - 1
+            if waiting and pending == 0 then
+                waiting = false
+                coroutine.resume(co)
+            end
+        end)
+        if pending >= window then
+            waiting = true
+            coroutine.yield()
+        end
+    end
+    if pending > 0 then
+        waiting = true
+        coroutine.yield()
+    end
+end
+
+moon.start(function()
+    moon.async(function()
+        local receiver = moon.new_service("lua", {name = "benchmark_call_receiver", file = "benchmark_call_receiver.lua"})
+        local cases = {
+            {"sequential", function() sequential(receiver) end},
+            {"async per call, window 100", function() async_per_call(receiver, 100) end},
+            {"async per call, window 1000", function() async_per_call(receiver, 1000) end},
+        }
+        moon.set_loglevel("INFO")
+        for _, case in ipairs(cases) do
+            local t0 = moon.millsecond()
+            case[2]()
+            local cost = moon.millsecond() - t0
+            print(string.format("%-28s %d calls %d ms, %.0f calls/s", case[1], N, cost, N * 1000 / cost))
+        end
+        moon.abort()
+    end)
+end)
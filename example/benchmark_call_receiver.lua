@@ -0,0 +1,7 @@
+--Receiver of benchmark_call: echo
+
+local moon = require("moon")
+
+moon.dispatch("lua", function(msg, p)
+    moon.response("lua", msg:sender(), msg:responseid(), p.unpack(msg))
+end)
@@ -0,0 +1,98 @@
+--cross node call benchmark: clusterd relay service vs native cluster transport.
+--run two processes: ./moon 13 and ./moon 14
+local moon = require("moon")
+local seri = require("seri")
+local cluster = require("cluster")
+
+local N = 50000
+local NODE = "server_13"
+local SERVICE = "benchmark_cluster_receiver"
+
+--the old cluster.call: through clusterd services of both nodes
+local clusterd
+local function clusterd_call(rnode, rservice, ...)
+    local responseid, err = moon.make_response(clusterd)
+    if not responseid then
+        return false, err
+    end
+    moon.raw_send('lua', clusterd, seri.packs(rnode, rservice, "CALL"), seri.pack(...), responseid)
+    return coroutine.yield()
+end
+
+local function sequential(call)
+    for i = 1, N do
+        local v = call(NODE, SERVICE, i)
+        assert(v == i, v)
+    end
+end
+
+--every call in its own moon.async, at most `window` calls pending
+local function async_window(call, window)
+    local co = coroutine.running()
+    local pending = 0
+    local waiting = false
+    for i = 1, N do
+        pending = pending + 1
+        moon.async(function()
+            local v = call(NODE, SERVICE, i)
+            assert(v == i, v)
+            pending = pending - 1
+            if waiting and pending < window then
+                waiting = false
+                coroutine.resume(co)
+            end
+        end)
+        if pending >= window then
+            waiting = true
+            coroutine.yield()
+        end
+    end
+    while pending > 0 do
+        waiting = true
+        coroutine.yield()
+    end
+end
+
+--write syscalls of this process, linux only. some sandboxes always report 0
+local function syscw()
+    local f = io.open("/proc/self/io")
+    if not f then
+        return nil
+    end
+    local s = f:read("a")
+    f:close()
+    local n = tonumber(s:match("syscw:%s*(%d+)"))
+    if n == 0 then
+        return nil
+    end
+    return n
+end
+
+moon.start(function()
+    moon.async(function()
+        clusterd = moon.unique_service("clusterd")
+        --wait for the other node
+        while not cluster.call(NODE, SERVICE, 0) or not clusterd_call(NODE, SERVICE, 0) do
+            moon.co_wait(100)
+        end
+
+        local cases = {
+            {"clusterd sequential", function() sequential(clusterd_call) end},
+            {"native sequential", function() sequential(cluster.call) end},
+            {"clusterd window 100", function() async_window(clusterd_call, 100) end},
+            {"native window 100", function() async_window(cluster.call, 100) end},
+            {"native window 1000", function() async_window(cluster.call, 1000) end},
+        }
+        moon.set_loglevel("INFO")
+        for _, case in ipairs(cases) do
+            local w0 = syscw()
+            local t0 = moon.millsecond()
+            case[2]()
+            local cost = moon.millsecond() - t0
+            local w1 = syscw()
+            print(string.format("%-22s %d calls %d ms, %.0f calls/s, %s writes/call", case[1], N, cost, N * 1000 / cost
+                , w0 and string.format("%.2f", (w1 - w0) / N) or "-"))
+        end
+        moon.abort()
+    end)
+end)
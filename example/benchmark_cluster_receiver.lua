@@ -0,0 +1,6 @@
+local moon = require("moon")
+
+--echo, called through clusterd or native cluster
+moon.dispatch('lua',function(msg,p)
+    moon.response('lua', msg:sender(), msg:responseid(), p.unpack(msg))
+end)
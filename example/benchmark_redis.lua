@@ -0,0 +1,83 @@
+--redis client benchmark against benchmark_redis_server.lua (or a redis-server at the same port).
+--run ./moon 18
+local moon = require("moon")
+local redis = require("moon.redis")
+
+local N = 20000
+local HOST = "127.0.0.1"
+local PORT = "6390"
+
+local function connect()
+    local c = redis.new()
+    while not c:async_connect(HOST, PORT) do
+        moon.co_wait(100)
+    end
+    return c
+end
+
+--one coroutine, wait each reply before next command
+local function sequential(c)
+    for i = 1, N do
+        local ok, err = c:set("key" .. i, i)
+        assert(ok == "OK", err)
+    end
+end
+
+--commands of many coroutines pipelined on one connection, at most `window` waiting
+local function shared(c, window)
+    local co = coroutine.running()
+    local pending = 0
+    local waiting = false
+    for i = 1, N do
+        pending = pending + 1
+        moon.async(function()
+            local v, err = c:incr("counter")
+            assert(v, err)
+            pending = pending - 1
+            if waiting and pending < window then
+                waiting = false
+                coroutine.resume(co)
+            end
+        end)
+        if pending >= window then
+            waiting = true
+            coroutine.yield()
+        end
+    end
+    while pending > 0 do
+        waiting = true
+        coroutine.yield()
+    end
+end
+
+--init_pipeline/commit_pipeline batches of `batch` commands
+local function batched(c, batch)
+    for i = 1, N, batch do
+        c:init_pipeline(batch)
+        for j = i, i + batch - 1 do
+            c:get("key" .. j)
+        end
+        local res, err = c:commit_pipeline()
+        assert(res and #res == batch, err)
+    end
+end
+
+moon.start(function()
+    moon.async(function()
+        local c = connect()
+        local cases = {
+            {"sequential", function() sequential(c) end},
+            {"shared connection window 100", function() shared(c, 100) end},
+            {"shared connection window 1000", function() shared(c, 1000) end},
+            {"pipeline batch 100", function() batched(c, 100) end},
+        }
+        for _, case in ipairs(cases) do
+            local t = moon.millsecond()
+            case[2]()
+            local cost = moon.millsecond() - t
+            print(string.format("%-32s %6d commands %6d ms %8.0f/s", case[1], N, cost, N * 1000 / cost))
+        end
+        c:close()
+        moon.abort()
+    end)
+end)
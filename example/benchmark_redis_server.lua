@@ -0,0 +1,83 @@
+--minimal redis server stand-in for benchmark_redis.lua: RESP requests, commands PING SET GET INCR DEL.
+--replies are sent in request order, so pipelined requests work as with redis-server.
+local moon = require("moon")
+local socket = require("moon.socket")
+local decode = require("resp").decode
+
+local tonumber = tonumber
+local concat = table.concat
+
+local data = {}
+
+local command = {}
+
+command.PING = function()
+    return "+PONG\r\n"
+end
+
+command.SET = function(key, value)
+    data[key] = value
+    return "+OK\r\n"
+end
+
+command.GET = function(key)
+    local v = data[key]
+    if not v then
+        return "$-1\r\n"
+    end
+    return concat({"$", #v, "\r\n", v, "\r\n"})
+end
+
+command.INCR = function(key)
+    local v = (tonumber(data[key]) or 0) + 1
+    data[key] = tostring(v)
+    return ":" .. v .. "\r\n"
+end
+
+command.DEL = function(key)
+    local n = data[key] and 1 or 0
+    data[key] = nil
+    return ":" .. n .. "\r\n"
+end
+
+--requests are RESP arrays too: a read gets all complete requests received, replies go out with one write
+local function serve(conn)
+    local requests, errors = {}, {}
+    while true do
+        local data, err = conn:co_read('resp')
+        if not data then
+            print("redis stand-in connection closed", err)
+            return
+        end
+        local n = decode(data, requests, errors)
+        local replies = {}
+        for i = 1, n do
+            local args = requests[i]
+            requests[i] = nil
+            local f = command[args[1]:upper()]
+            if f then
+                replies[i] = f(table.unpack(args, 2))
+            else
+                replies[i] = "-ERR unknown command '" .. args[1] .. "'\r\n"
+            end
+        end
+        conn:send(concat(replies))
+    end
+end
+
+moon.init(function(conf)
+    local sock = socket.new()
+    sock:listen(conf.host or "127.0.0.1", conf.port or 6390)
+    moon.async(function()
+        while true do
+            local conn = sock:co_accept()
+            if conn then
+                conn:setnodelay()
+                moon.async(function()
+                    serve(conn)
+                end)
+            end
+        end
+    end)
+    return true
+end)
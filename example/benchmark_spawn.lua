@@ -0,0 +1,37 @@
+--Service spawn benchmark: time and memory of creating many lua services
+
+local moon = require("moon")
+
+local conf = ...
+
+--resident memory of process(linux only)
+local function rss()
+    local f = io.open("/proc/self/statm")
+    if not f then
+        return 0
+    end
+    local s = f:read("l")
+    f:close()
+    local res = s:match("%d+ (%d+)")
+    return tonumber(res) * 4096
+end
+
+moon.start(function()
+    local counts = {1000, 9000}
+    local total = 0
+    for _, n in ipairs(counts) do
+        local m0 = rss()
+        local t0 = moon.millsecond()
+        for _ = 1, n do
+            moon.new_service("lua", {name = "benchmark_spawn_empty", file = "benchmark_spawn_empty.lua"})
+        end
+        local t1 = moon.millsecond()
+        total = total + n
+        --config loglevel ERROR hides "new service" logs, which cost more than spawn
+        moon.set_loglevel("INFO")
+        print(string.format("spawn %d services(total %d): %d ms, %.1f us/service, rss %.1f KB/service",
+            n, total, t1 - t0, (t1 - t0) * 1000 / n, (rss() - m0) / 1024 / n))
+        moon.set_loglevel("ERROR")
+    end
+    moon.abort()
+end)
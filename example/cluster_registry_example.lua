@@ -0,0 +1,21 @@
+--nodes join and leave at runtime: run ./moon 16, then ./moon 15.
+--remove server_15 from cluster_registry.json: calls fail with unknown node, add it back: calls work again.
+local moon = require("moon")
+local cluster = require("cluster")
+
+local NODE = "server_15"
+
+moon.start(function()
+    moon.async(function()
+        while true do
+            local ret, err = cluster.call(NODE, "cluster_example_receiver", "ACCUM", 1, 2, 3)
+            if ret then
+                print(NODE, "ACCUM", ret)
+            else
+                print(NODE, err)
+            end
+            print(cluster.stats(NODE))
+            moon.co_wait(1000)
+        end
+    end)
+end)
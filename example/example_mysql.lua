@@ -16,6 +16,15 @@ if result then
     end
 end
 
+-- big tables: columnar result, rows are built only when accessed
+local rs = conn:query_result("select id,title from article_detail;")
+if rs then
+    print(table.concat(rs:columns(), ","))
+    for i = 1, #rs do
+        print(rs:get(i, "id"), rs:get(i, 2))
+    end
+end
+
 local create_table = [[
     DROP TABLE IF EXISTS `article_detail`;
     CREATE TABLE `article_detail` (
@@ -0,0 +1,32 @@
+--GC policy example: same garbage-producing load with and without idle gc steps("gcidle")
+
+local moon = require("moon")
+
+local function run(name, conf)
+    conf.name = name
+    conf.file = "gc_example_worker.lua"
+    local sid = moon.new_service("lua", conf)
+    for _ = 1, 200 do
+        for _ = 1, 20 do
+            moon.send("lua", sid, "", "work")
+        end
+        --let the worker drain its queue and go idle
+        moon.co_wait(1)
+    end
+    local total, idle, nplayer = moon.co_call("lua", sid, "stat")
+    assert(nplayer == 50000)
+    local gc = moon.co_runcmd("service." .. sid .. ".gc")
+    print(string.format("%-8s gc %.2f ms, in idle %.2f ms, in dispatch %.2f ms", name, total, idle, total - idle))
+    print(gc)
+    moon.co_remove_service(sid)
+end
+
+moon.start(function()
+    moon.async(function()
+        moon.set_loglevel("INFO")
+        run("default", {})
+        run("gcidle", {gcidle = 1024})
+        run("tuned", {gcidle = 1024, gcpause = 150, gcstepmul = 400})
+        moon.abort()
+    end)
+end)
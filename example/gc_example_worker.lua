@@ -0,0 +1,27 @@
+--Worker of gc_example: every "work" message produces garbage
+
+local moon = require("moon")
+
+--long-lived data, gc traverses it every cycle
+local players = {}
+for i = 1, 50000 do
+    players[i] = {id = i, name = "player" .. i, items = {}}
+end
+
+local function work()
+    local t = {}
+    for i = 1, 200 do
+        t[i] = {id = i, name = "item" .. i}
+    end
+    return #t
+end
+
+moon.dispatch("lua", function(msg, p)
+    local cmd = p.unpack(msg)
+    if cmd == "work" then
+        work()
+    elseif cmd == "stat" then
+        local total, idle = moon.gc_time()
+        moon.response("lua", msg:sender(), msg:responseid(), total, idle, #players)
+    end
+end)
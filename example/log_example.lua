@@ -1,3 +1,4 @@
+local moon = require("moon")
 local log = require("log")
 
 do
@@ -34,6 +35,7 @@ log.debug("this line will not print")
 log.warn("this line will  print")
 log.error("this line will  print")
 
-log.LOG_LEVEL = log.LOG_TRACE
-log.DEBUG = false
-log.debug("this line will not print or log file")
+log.LOG_LEVEL = nil
+moon.set_loglevel("INFO")
+log.debug("this line will not print")
+log.info("this line will  print")
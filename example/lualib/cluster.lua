@@ -1,31 +1,51 @@
 local moon = require("moon")
 local seri = require("seri")
-local packs = seri.packs
 local pack = seri.pack
 local co_yield = coroutine.yield
 
 local M = {}
 
-local clusterd
+local cluster_send = moon.cluster_send
+local make_response = moon.make_response
+--not cached: a pooled service is reused with another id, modules stay loaded
+local moon_sid = moon.sid
 
-local send = moon.raw_send
+local PTYPE_LUA = moon.PTYPE_LUA
 
+--milliseconds, 0: node config "call_timeout"
+local timeout = 0
 
-function M.call(rnode, rservice, ...)
-    if not clusterd then
-        clusterd = moon.unique_service("clusterd")
-        if 0 == clusterd then
-            return false, "clusterd service not start"
-        end
-    end
+---设置本服务 call 的超时时间(毫秒), 超时返回 false, 错误信息。0: 使用节点配置 "call_timeout"
+---@param ms int
+function M.settimeout(ms)
+    timeout = ms
+end
 
-    local responseid,err = moon.make_response(clusterd)
+---调用其它节点的唯一服务(native cluster, 配置 "cluster")
+---@param rnode string
+---@param rservice string
+function M.call(rnode, rservice, ...)
+    local responseid, err = make_response()
     if not responseid then
         return false, err
     end
 
-    send('lua',clusterd,packs(rnode, rservice,"CALL"),pack(...),responseid)
+    cluster_send(moon_sid(), rnode, rservice, pack(...), responseid, PTYPE_LUA, timeout)
     return co_yield()
 end
 
+---发送消息给其它节点的唯一服务，不需要回应
+---@param rnode string
+---@param rservice string
+function M.send(rnode, rservice, ...)
+    cluster_send(moon_sid(), rnode, rservice, pack(...), 0, PTYPE_LUA, 0)
+end
+
+---各节点的调用统计 json: calls, responses, timeouts, failures(连接断开), inflight, latency_avg, latency_max(微秒)
+---@param rnode string @nil: 所有节点
+---@return string
+function M.stats(rnode)
+    return moon.co_runcmd("cluster." .. (rnode or "*") .. ".stats")
+end
+
 return M
@@ -84,20 +84,47 @@ function core.id()
 end
 
 ---@param receiver int
----@param cacheid int
+---@param cache core.buffer
 ---@param header string
 ---@param responseid int
 ---@param type int
-function core.send_cache(receiver,cacheid,header,responseid,type)
-    ignore_param(receiver,cacheid,header,responseid,type)
+function core.send_cache(receiver,cache,header,responseid,type)
+    ignore_param(receiver,cache,header,responseid,type)
 end
 
----@overload fun(buf:string)
----@param buf userdata
+---shared payload, valid until the last reference(lua or unhandled message) is released
+---@param buf string|core.buffer
+---@return core.buffer
 function core.make_cache(buf)
     ignore_param(buf)
 end
 
+---send one payload to many receivers without copy
+---@param sender int
+---@param receivers int[]
+---@param buf string|core.buffer
+---@param header string
+---@param type int
+function core.multicast(sender,receivers,buf,header,type)
+    ignore_param(sender,receivers,buf,header,type)
+end
+
+---send to unique service of another cluster node, the response comes as responseid.
+---sender of the request seen by the receiver is core.CLUSTER_SERVICE_ID
+---@param sender int
+---@param node string
+---@param service string
+---@param buf string|core.buffer
+---@param responseid int @0: no response
+---@param type int
+---@param timeout int @milliseconds, the call gets error when no response in time. 0: node "call_timeout"
+function core.cluster_send(sender,node,service,buf,responseid,type,timeout)
+    ignore_param(sender,node,service,buf,responseid,type,timeout)
+end
+
+---@type int
+core.CLUSTER_SERVICE_ID = 0
+
 ---@param protocol string
 function core.get_tcp(protocol)
     ignore_param(protocol)
@@ -119,6 +146,12 @@ function core.memory_use()
     -- body
 end
 
+---milliseconds spent in gc since service init: total, by worker idle steps(config "gcidle")
+---@return number, number
+function core.gc_time()
+    -- body
+end
+
 ---@return int
 function core.workernum()
     -- body
@@ -229,6 +262,112 @@ function message:buffer()
     ignore_param(self)
 end
 
+---payload view without copy, can be passed to seri.unpack. json.decode(v:pointer(), v:size())
+---@param pos int
+---@param count int
+---@return core.buffer_view
+function message:view(pos,count)
+    ignore_param(self,pos,count)
+end
+
+---@class core.buffer_view
+local buffer_view = {}
+ignore_param(buffer_view)
+
+---@return int
+function buffer_view:size()
+    ignore_param(self)
+end
+
+---@param i int
+---@param j int
+---@return core.buffer_view
+function buffer_view:sub(i,j)
+    ignore_param(self,i,j)
+end
+
+---@param i int
+---@param j int
+---@return string
+function buffer_view:bytes(i,j)
+    ignore_param(self,i,j)
+end
+
+---@param i int
+---@return int
+function buffer_view:byte(i)
+    ignore_param(self,i)
+end
+
+---@param s string
+---@param init int
+---@return int
+function buffer_view:find(s,init)
+    ignore_param(self,s,init)
+end
+
+---@param i int
+---@param n int
+---@param bigendian boolean
+---@return int
+function buffer_view:int(i,n,bigendian)
+    ignore_param(self,i,n,bigendian)
+end
+
+---@param i int
+---@param n int
+---@param bigendian boolean
+---@return int
+function buffer_view:uint(i,n,bigendian)
+    ignore_param(self,i,n,bigendian)
+end
+
+---@param i int
+---@return number
+function buffer_view:float(i)
+    ignore_param(self,i)
+end
+
+---@param i int
+---@return number
+function buffer_view:double(i)
+    ignore_param(self,i)
+end
+
+---@return userdata
+function buffer_view:pointer()
+    ignore_param(self)
+end
+
+---seri.pack/seri.concat result larger than 4KB, and core.make_cache result. released by gc
+---@class core.buffer
+local buffer = {}
+ignore_param(buffer)
+
+---@return int
+function buffer:size()
+    ignore_param(self)
+end
+
+---@param i int
+---@param j int
+---@return string
+function buffer:bytes(i,j)
+    ignore_param(self,i,j)
+end
+
+---@param i int
+---@param j int
+---@return core.buffer_view
+function buffer:view(i,j)
+    ignore_param(self,i,j)
+end
+
+---drop this reference now, sent messages keep the payload
+function buffer:release()
+    ignore_param(self)
+end
+
 ---@param header string
 ---@param receiver int
 ---@param mtype int
@@ -3,6 +3,7 @@ local c = require("moon_core")
 local string_format     = string.format
 local string_len        = string.len
 local debug_traceback   = debug.traceback
+local debug_getinfo     = debug.getinfo
 local string_rep        = string.rep
 local string_split      = util.string_split
 local string_trim       = util.string_trim
@@ -15,8 +16,18 @@ M.LOG_WARN = 2
 M.LOG_INFO = 3
 M.LOG_DEBUG = 4
 
--- 设置当前日志等级,低于这个等级的日志不会输出
-M.LOG_LEVEL = M.LOG_DEBUG
+-- 服务器日志等级每次调用时读取, moon.set_loglevel 立即生效. 低于这个等级的日志不会输出,也不会格式化
+-- 可选的额外过滤等级, 只对本服务生效, 默认 nil 不过滤
+M.LOG_LEVEL = nil
+
+local get_loglevel = c.get_loglevel
+
+local function enabled(level)
+    local extra = M.LOG_LEVEL
+    return level <= get_loglevel() and (not extra or level <= extra)
+end
+
+M.enabled = enabled
 
 -----------------------------------------------------------------------
 function M.throw(fmt, ...)
@@ -37,8 +48,9 @@ local logV = c.LOGV
 
 local function do_log(bcle,level,fmt, ... )
     local str = string_format(fmt, ...)
-    local traceback = string_split(debug_traceback("", 2), "\n")
-    logV(bcle, level, table.concat({str,"(",string_trim(traceback[2]),")"}))
+    -- 1: do_log, 2: log.xxx, 3: 调用者
+    local info = debug_getinfo(3, "Sl")
+    logV(bcle, level, string_format("%s (%s:%d)", str, info.short_src, info.currentline))
 end
 
 local print = print
@@ -112,21 +124,25 @@ function M.dump(value, desciption, nesting, _print)
 end
 
 function M.error(fmt, ...)
-    do_log(true, M.LOG_ERROR,fmt,...)
+    if enabled(M.LOG_ERROR) then
+        do_log(true, M.LOG_ERROR,fmt,...)
+    end
 end
 
 function M.warn(fmt, ...)
-    do_log(true, M.LOG_WARN,fmt,...)
+    if enabled(M.LOG_WARN) then
+        do_log(true, M.LOG_WARN,fmt,...)
+    end
 end
 
 function M.debug(fmt, ...)
-    if M.LOG_DEBUG <= M.LOG_LEVEL then
+    if enabled(M.LOG_DEBUG) then
         do_log(false, M.LOG_DEBUG,fmt,...)
     end
 end
 
 function M.info(fmt, ...)
-    if M.LOG_INFO <= M.LOG_LEVEL then
+    if enabled(M.LOG_INFO) then
         do_log(true, M.LOG_INFO,fmt,...)
     end
 end
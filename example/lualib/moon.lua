@@ -9,8 +9,9 @@ local co_create = coroutine.create
 local co_running = coroutine.running
 local _co_resume = coroutine.resume
 local co_yield = coroutine.yield
-local table_remove = table.remove
 local _send = core.send
+local _multicast = core.multicast
+local _make_cache = core.make_cache
 
 local PTYPE_SYSTEM = 1
 local PTYPE_TEXT = 2
@@ -64,15 +65,25 @@ end
 
 local sid_ = core.id()
 
-local response_uid = 1
-local resplistener = {} --response message handler
 local protocol = {}
 
 local services_exited = {}
-local response_wacther = {}
 
 local waitallco = {}
 
+--response session: responseid = generation << SESSION_SLOT_BITS | slot.
+--slots are reused, the generation changes each time, so a late response of a released session is ignored.
+local SESSION_SLOT_BITS = 20
+local SESSION_SLOT_MASK = (1 << SESSION_SLOT_BITS) - 1
+local SESSION_GEN_MASK = 0x3FF
+
+local session_co = {} --slot: waiting coroutine, false: free
+local session_gen = {} --slot: generation
+local session_receiver = {} --slot: receiver watched for exit, false: none
+local session_free = {} --free slots
+local session_free_n = 0
+local session_n = 0
+
 local function co_resume(co, ...)
     local ok, err = _co_resume(co, ...)
     if not ok then
@@ -82,35 +93,71 @@ end
 
 ---make map<coroutine,responseid>
 local function make_response(receiver)
-    repeat
-        response_uid = response_uid + 1
-        if response_uid == 0xFFFFFFF then
-            response_uid = 1
-        end
-    until not resplistener[response_uid]
+    if receiver and services_exited[receiver] then
+        return false, string.format( "[%u] attempt send to dead service [%d]", sid_, receiver)
+    end
 
-    if receiver then
-        if services_exited[receiver] then
-            return false, string.format( "[%u] attempt send to dead service [%d]", sid_, receiver)
+    local slot
+    if session_free_n > 0 then
+        slot = session_free[session_free_n]
+        session_free_n = session_free_n - 1
+    else
+        slot = session_n + 1
+        if slot > SESSION_SLOT_MASK then
+            error(string.format("[%u] too many waiting sessions", sid_))
         end
-        response_wacther[response_uid] = receiver
+        session_n = slot
+        session_gen[slot] = 0
     end
 
-    local co = co_running()
-    resplistener[response_uid] = co
-    return response_uid
+    session_co[slot] = co_running()
+    session_receiver[slot] = receiver or false
+    return (session_gen[slot] << SESSION_SLOT_BITS) | slot
+end
+
+---release the session, return the waiting coroutine. nil: unknown or released responseid
+local function take_response(responseid)
+    local slot = responseid & SESSION_SLOT_MASK
+    local co = session_co[slot]
+    if not co or session_gen[slot] ~= (responseid >> SESSION_SLOT_BITS) then
+        return nil
+    end
+    session_co[slot] = false
+    session_receiver[slot] = false
+    session_gen[slot] = (session_gen[slot] + 1) & SESSION_GEN_MASK
+    session_free_n = session_free_n + 1
+    session_free[session_free_n] = slot
+    return co
+end
+
+local function reset_response()
+    session_co = {}
+    session_gen = {}
+    session_receiver = {}
+    session_free = {}
+    session_free_n = 0
+    session_n = 0
 end
 
 moon.make_response = make_response
 
+local init_callback
+
+core.set_init(function ( str )
+    --服务对象可能是从服务池复用的, 服务id已经改变
+    sid_ = core.id()
+    if not init_callback then
+        return true
+    end
+    return init_callback(json_decode(str))
+end)
+
 ---
 --- 注册服务初始化回掉函数,服务对象创建时会调用,可以在这里做服务自身的初始化操作
 --- 回掉函数需要返回bool:true 初始化成功; false 服务始化失败.
 ---@param callback fun(config:table):boolean
 function moon.init(callback)
-    core.set_init(function ( str )
-        return callback(json_decode(str))
-    end)
+    init_callback = callback
 end
 
 ---
@@ -148,13 +195,9 @@ local function _default_dispatch(msg, PTYPE)
 
     local responseid = msg:responseid()
     if responseid > 0 and PTYPE ~= PTYPE_ERROR then
-        response_wacther[responseid] = nil
-        local co = resplistener[responseid]
+        local co = take_response(responseid)
         if co then
-            --print(coroutine.status(co))
             co_resume(co, p.unpack(msg))
-            --print(coroutine.status(co))
-            resplistener[responseid] = nil
             return
         end
         error(string.format( "response [%u] can not find co", responseid))
@@ -219,6 +262,45 @@ function moon.raw_send(PTYPE, receiver, header, data, responseid)
 	return true
 end
 
+---向多个服务发送同一消息,消息内容只打包一次,所有接收者共享<br>
+---param receivers:接收者服务id数组<br>
+---@param PTYPE string
+---@param receivers int[]
+---@param header string
+function moon.multicast(PTYPE, receivers, header, ...)
+    local p = protocol[PTYPE]
+    if not p then
+        error(string.format("moon multicast unknown PTYPE[%s] message", PTYPE))
+    end
+    _multicast(sid_, receivers, p.pack(...), header or '', p.PTYPE)
+end
+
+---向多个服务发送同一消息,消息内容不进行协议打包<br>
+---param data 消息内容 string 类型或 moon.make_cache 返回的缓存<br>
+---@param PTYPE string
+---@param receivers int[]
+---@param header string
+---@param data string|userdata
+function moon.raw_multicast(PTYPE, receivers, header, data)
+    local p = protocol[PTYPE]
+    if not p then
+        error(string.format("moon multicast unknown PTYPE[%s] message", PTYPE))
+    end
+    _multicast(sid_, receivers, data, header or '', p.PTYPE)
+end
+
+---按协议打包消息内容为可共享的缓存,用 moon.raw_send 或 moon.multicast 多次发送不再打包<br>
+---缓存跨协程/定时器有效,最后一个引用(lua变量或未处理的消息)释放时销毁,cache:release() 提前释放lua引用<br>
+---@param PTYPE string
+---@return userdata
+function moon.make_cache(PTYPE, ...)
+    local p = protocol[PTYPE]
+    if not p then
+        error(string.format("moon make_cache unknown PTYPE[%s] message", PTYPE))
+    end
+    return _make_cache(p.pack(...))
+end
+
 ---获取当前的服务id
 ---@return int
 function moon.sid()
@@ -240,7 +322,9 @@ end
 ---@return int
 function moon.new_service(stype, config, unique, shared, workerid)
     unique = unique or false
-    shared = shared or true
+    if shared == nil then
+        shared = true
+    end
     workerid = workerid or 0
     config = json_encode(config)
     return core.new_service(stype, unique, shared, workerid, config)
@@ -286,7 +370,10 @@ function moon.set_unique_service(name,id)
 end
 
 -------------------------协程操作封装--------------------------
-local co_pool = setmetatable({}, {__mode = "kv"})
+--finished coroutines of moon.async, reused by next moon.async
+local CO_POOL_SIZE = 1024
+local co_pool = {}
+local co_pool_n = 0
 
 local function check_wait_all( ... )
     local co = co_running()
@@ -306,7 +393,11 @@ end
 local function routine(func)
     while true do
         local co = check_wait_all(func())
-        co_pool[#co_pool + 1] = co
+        if co_pool_n >= CO_POOL_SIZE then
+            return
+        end
+        co_pool_n = co_pool_n + 1
+        co_pool[co_pool_n] = co
         func = co_yield()
     end
 end
@@ -315,8 +406,12 @@ end
 ---@param func function
 ---@return coroutine
 function moon.async(func)
-    local co = table_remove(co_pool)
-    if not co then
+    local co
+    if co_pool_n > 0 then
+        co = co_pool[co_pool_n]
+        co_pool[co_pool_n] = nil
+        co_pool_n = co_pool_n - 1
+    else
         co = co_create(routine)
     end
     co_resume(co, func) --func 作为 routine 的参数
@@ -386,6 +481,25 @@ function moon.co_wait(mills)
 end
 ------------------------------------------
 
+---注册服务回收回掉,配合服务配置 pool = N(同一个脚本文件最多缓存N个退出的服务)使用。
+---服务退出(moon.destroy回掉之后)时调用,回掉函数需要清理模块内的状态,返回true表示服务可以复用,
+---服务对象会放入服务池,不销毁lua虚拟机。下次创建同一个脚本文件的服务时直接复用,
+---不再重新创建虚拟机和加载脚本,只会以新的服务id和配置再次调用 moon.init, moon.start 回掉。
+---使用了网络的服务不会被复用。
+---@param callback fun():boolean
+function moon.reset(callback)
+    core.set_reset(function()
+        if not callback() then
+            return false
+        end
+        reset_response()
+        services_exited = {}
+        waitallco = {}
+        timer_cb = {}
+        return true
+    end)
+end
+
 ---@param serviceid int
 ---@return string
 function moon.co_remove_service(serviceid)
@@ -520,10 +634,9 @@ reg_protocol {
         local topic = msg:header()
         local data = p.unpack(msg)
         --print("PTYPE_ERROR",topic,data)
-        local co = resplistener[responseid]
+        local co = take_response(responseid)
         if co then
             co_resume(co, false, topic..data)
-            resplistener[responseid] = nil
             return
         end
     end
@@ -548,14 +661,11 @@ reg_protocol {
         if header == "exit" then
             local data = msg:bytes()
             services_exited[sender] = true
-            for k, v in pairs(response_wacther) do
-                if v == sender then
-                    local co = resplistener[k]
-                    if co then
-                        co_resume(co, false, data)
-                        resplistener[k] = nil
-                        return
-                    end
+            --wake all sessions waiting the exited service
+            for slot = 1, session_n do
+                if session_receiver[slot] == sender then
+                    local co = take_response((session_gen[slot] << SESSION_SLOT_BITS) | slot)
+                    co_resume(co, false, data)
                 end
             end
         end
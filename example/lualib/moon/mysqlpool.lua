@@ -0,0 +1,62 @@
+--client of mysqld services (service/mysqld.lua). Each mysqld runs its blocking queries on its own
+--worker thread, callers only wait in coroutine: a slow query does not block other services.
+local moon = require("moon")
+
+local co_call = moon.co_call
+local hash_string = moon.hash_string
+
+local M = {}
+
+local mt = {__index = M}
+
+---@param services int[] @serviceid of mysqld services
+function M.new(services)
+    assert(#services > 0, "mysqlpool need mysqld services")
+    local t = {}
+    t.services = services
+    t.n = #services
+    t.next = 0
+    return setmetatable(t, mt)
+end
+
+---calls with the same key use the same connection, so they run in order. nil key: round robin
+---@param key any
+---@return int
+function M:service(key)
+    if key == nil then
+        self.next = self.next % self.n + 1
+        return self.services[self.next]
+    end
+    if type(key) ~= "number" then
+        key = hash_string(tostring(key))
+    end
+    return self.services[key % self.n + 1]
+end
+
+---@return table|boolean @rows, or false and error
+function M:query(sql, key)
+    return co_call('lua', self:service(key), "query", sql)
+end
+
+function M:execute(sql, key)
+    return co_call('lua', self:service(key), "execute", sql)
+end
+
+---prepare on all connections, returns stmtid. stmtid of the same sql is the same for all connections
+---@return string|boolean
+function M:prepare(sql)
+    local stmtid, err
+    for _, s in ipairs(self.services) do
+        stmtid, err = co_call('lua', s, "prepare", sql)
+        if not stmtid then
+            return false, err
+        end
+    end
+    return stmtid
+end
+
+function M:execute_stmt(key, stmtid, ...)
+    return co_call('lua', self:service(key), "execute_stmt", stmtid, ...)
+end
+
+return M
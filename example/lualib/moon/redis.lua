@@ -1,15 +1,16 @@
 --ref https://github.com/openresty/lua-resty-redis
 --not support transactions and pub/sub
-local sub = string.sub
-local byte = string.byte
 local type = type
 local pairs = pairs
 local setmetatable = setmetatable
-local tonumber = tonumber
 local tostring = tostring
+local co_running = coroutine.running
+local co_yield = coroutine.yield
 
 local moon	= require("moon")
+local log	= require("log")
 local seri	= require("seri")
+local resp	= require("resp")
 local socket	= require("moon.socket")
 
 local new_table = moon.new_table or function() return {} end
@@ -56,12 +57,32 @@ local common_cmds = {
 
 local redis = new_table(0, 54)
 
-redis.VERSION = '0.1'
+redis.VERSION = '0.2'
+
+--nil bulk and nil multi-bulk reply
+redis.null = resp.null
+
+local null = redis.null
 
 local mt = {__index = redis}
 
+local function co_resume(co, ...)
+	local ok, err = coroutine.resume(co, ...)
+	if not ok then
+		--error of a waiting coroutine does not stop the reader
+		log.error("%s", debug.traceback(co, err))
+	end
+end
+
 local sock
 
+--[[
+    Commands are pipelined: a command is sent without waiting the replies of others, replies come back
+    in the order of commands. One reader coroutine per connection reads the replies and resumes the
+    waiting coroutines in FIFO order, so many coroutines may use one connection at the same time.
+    A command is sent at once when no reply is outstanding, otherwise it is buffered and the reader
+    sends the buffered commands with one write before it waits the next reply.
+]]
 function redis.new()
 	if not sock then
 		sock = socket.new()
@@ -71,6 +92,14 @@ function redis.new()
 	if not t.sock then
 		return nil, "socket initialized failed"
 	end
+	--waiting coroutines (or pipeline of a coroutine) of sent commands, queue[head..tail]
+	t.queue = {}
+	t.head = 1
+	t.tail = 0
+	--requests not sent yet
+	t.wbuf = {}
+	--connection the reader coroutine is reading
+	t.reading = false
 	return setmetatable(t, mt)
 end
 
@@ -88,6 +117,10 @@ function redis:connect(ip, port, timeout)
 		self.sock:settimeout(timeout)
 	end
 	self.conn = self.sock:connect(ip, port)
+	if self.conn then
+		--commands and replies are small writes
+		self.conn:setnodelay()
+	end
 	return(self.conn ~= nil)
 end
 
@@ -99,79 +132,142 @@ function redis:async_connect(ip, port, timeout)
 		self.sock:settimeout(timeout)
 	end
 	self.conn = self.sock:co_connect(ip, port)
+	if self.conn then
+		self.conn:setnodelay()
+	end
 	return(self.conn ~= nil)
 end
 
+--resume the waiting coroutines of all sent commands with nil, err
+local function _fail_all(self, err)
+	local queue = self.queue
+	for i = self.head, self.tail do
+		local w = queue[i]
+		queue[i] = nil
+		if type(w) == "table" then
+			--every command of a pipeline has the same entry
+			if not w.done then
+				w.done = true
+				co_resume(w.co, nil, err)
+			end
+		else
+			co_resume(w, nil, err)
+		end
+	end
+	self.head = 1
+	self.tail = 0
+	self.wbuf = {}
+end
+
 function redis:close()
 	if not self.conn then
 		return nil, "closed"
 	end
-	print("force close redis")
 	self.conn:close()
+	self.conn = nil
+	_fail_all(self, "closed")
 end
 
-function redis:_readreplay()
-	local line, err1 = self.conn:co_read('\r\n')
-	if not line then
-		return nil, err1
-	end
-
-	local prefix = byte(line)
-
-	if prefix == 36 then -- char '$'
-		local size = tonumber(sub(line, 2))
-		if size < 0 then
-			return moon.null
+local decode = resp.decode
+
+--reads replies of conn while commands are waiting, runs in its own coroutine.
+--a read gets all complete replies received, decoded by native parser at once
+local function _reader(self, conn)
+	local queue = self.queue
+	local values, errors = {}, {}
+	while self.conn == conn and self.head <= self.tail do
+		local data, err
+		local wbuf = self.wbuf
+		if #wbuf > 0 then
+			self.wbuf = {}
+			if not conn:send(seri.concat(wbuf)) then
+				err = "closed"
+			end
+		end
+		if not err then
+			data, err = conn:co_read('resp')
+		end
+		local ok, n
+		if data then
+			ok, n = pcall(decode, data, values, errors)
+			if not ok then
+				data, err = nil, n
+			end
 		end
-
-		local data, err2 = self.conn:co_read(size)
 		if not data then
-			return nil, err2
+			if self.conn == conn then
+				self.reading = false
+				conn:close()
+				self.conn = nil
+				_fail_all(self, err)
+			end
+			return
 		end
 
-		local dummy, err3 = self.conn:co_read(2)
-		-- ignore CRLF
-		if not dummy then
-			return nil, err3
+		for i = 1, n do
+			local res, e = values[i], errors[i]
+			values[i] = nil
+			errors[i] = nil
+			--closed by a waiting coroutine: the rest were failed
+			if self.conn == conn and self.head <= self.tail then
+				local w = queue[self.head]
+				queue[self.head] = nil
+				self.head = self.head + 1
+
+				if type(w) == "table" then
+					local count = w.n + 1
+					w.n = count
+					if res then
+						w.vals[count] = res
+					else
+						-- be a valid redis error value
+						w.vals[count] = {false, e}
+					end
+					if count == w.count then
+						w.done = true
+						co_resume(w.co, w.vals)
+					end
+				else
+					co_resume(w, res, e)
+				end
+			end
 		end
+	end
+	if self.reading == conn then
+		self.reading = false
+	end
+end
 
-		return data
-	elseif prefix == 43 then -- char '+'
-		-- print("status reply")
-		return sub(line, 2)
-	elseif prefix == 42 then -- char '*'
-		local n = tonumber(sub(line, 2))
-		-- print("multi-bulk reply: ", n)
-		if n < 0 then
-			return moon.null
-		end
+--send request, wait reply. w: the waiting coroutine, or the pipeline entry of count commands
+local function _request(self, req, w, count)
+	local conn = self.conn
+	if not conn then
+		return nil, "closed"
+	end
 
-		local vals = new_table(n, 0)
-		local nvals = 0
-		for _ = 1, n do
-			local res, err = self:_readreplay()
-			if res then
-				nvals = nvals + 1
-				vals[nvals] = res
-			elseif res == nil then
-				return nil, err
-			else
-				-- be a valid redis error value
-				nvals = nvals + 1
-				vals[nvals] = {false, err}
-			end
+	if self.head > self.tail then
+		if not conn:send(seri.concat(req)) then
+			return nil, "closed"
 		end
-		return vals
-	elseif prefix == 58 then -- char ':'
-		--print("integer reply",sub(line, 2))
-		return tonumber(sub(line, 2))
-	elseif prefix == 45 then -- char '-'
-		-- print("error reply: ", n)
-		return false, sub(line, 2)
 	else
-		-- when `line` is an empty string, `prefix` will be equal to nil.
-		return nil, 'unknown prefix: \"' .. tostring(prefix) .. '\"'
+		local wbuf = self.wbuf
+		wbuf[#wbuf + 1] = req
+	end
+
+	local queue = self.queue
+	local tail = self.tail
+	for i = 1, count do
+		queue[tail + i] = w
+	end
+	self.tail = tail + count
+
+	if self.reading ~= conn then
+		self.reading = conn
+		moon.async(function()
+			_reader(self, conn)
+		end)
 	end
+	return co_yield()
 end
 
 local function _gen_req(args)
@@ -216,27 +312,7 @@ function redis:docmd(...)
 	end
 
 	-- print("request: ", table.concat(req))
-	if not self.conn:send(seri.concat(req)) then
-		return nil, "closed"
-	end
-
-	local res,err = self:_readreplay()
-	if res == nil then
-		self.conn = nil
-	end
-	return res,err
-end
-
-function redis:readreplay()
-	if not self.conn then
-		return nil, "closed"
-	end
-
-	local res, err = self:_readreplay()
-	if res == nil then
-		self.conn = nil
-	end
-	return res, err
+	return _request(self, req, co_running(), 1)
 end
 
 for i = 1, #common_cmds do
@@ -288,35 +364,17 @@ function redis:commit_pipeline()
 
 	self.reqs = nil
 
-	local conn = rawget(self, "conn")
-	if not conn then
+	if not rawget(self, "conn") then
 		return nil, "not initialized"
 	end
 
-	local ok = conn:send(seri.concat(reqs))
-	if not ok then
-		return nil
-	end
-
-	local nvals = 0
 	local nreqs = #reqs
-	local vals = new_table(nreqs, 0)
-	for _ = 1, nreqs do
-		local res, err = self:_readreplay(conn)
-		if res then
-			nvals = nvals + 1
-			vals[nvals] = res
-		elseif res == nil then
-			self.conn = nil
-			return nil, err
-		else
-			-- be a valid redis error value
-			nvals = nvals + 1
-			vals[nvals] = {false, err}
-		end
+	if nreqs == 0 then
+		return {}
 	end
 
-	return vals
+	local w = {co = co_running(), count = nreqs, n = 0, vals = new_table(nreqs, 0), done = false}
+	return _request(self, reqs, w, nreqs)
 end
 
 return redis
@@ -19,17 +19,21 @@ function M.new( ip, port )
     return setmetatable(t, mt)
 end
 
+--[[
+    A connection is checked when used: a broken connection fails its waiting commands and is
+    reconnected at the next spawn, no PING round trip. Commands are pipelined, so one connection
+    may also be shared by many coroutines instead of spawning one for each.
+]]
 function M:spawn()
     local c = table.remove(self.pool)
     if not c then
         c = redis.new()
-        if not c:connect(M.ip, M.port) then
+        if not c:connect(self.ip, self.port) then
             return nil,"connect redis failed"
         end
         return c
     else
-        local ok,_ = c:docmd("PING")
-        if not ok then
+        if not c.conn then
             print("span redis not connect,reconnecting...")
             while not c:async_connect(self.ip, self.port) do
                 print("reconnect redis server failed")
@@ -9,6 +9,8 @@ local read_delim = {}
 read_delim['\r\n'] = 1
 read_delim['\r\n\r\n'] = 2
 read_delim['\n'] = 3
+--complete redis replies (RESP) in the receive buffer, one or more. decode with require("resp").decode
+read_delim['resp'] = 4
 
 local session       = {}
 
@@ -46,6 +48,12 @@ function session:send(data,bclose)
     end
 end
 
+--disable Nagle's algorithm, small writes are sent at once
+function session:setnodelay()
+    assert(self.connid,"attemp setnodelay an invalid session")
+    self.sock:setnodelay(self.connid)
+end
+
 function session:close()
     assert(self.connid,"attemp close an invalid session")
     local ret = self.sock:close(self.connid)
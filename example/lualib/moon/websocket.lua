@@ -1,5 +1,8 @@
 local moon = require("moon")
 
+local co_yield      = coroutine.yield
+local make_response = moon.make_response
+
 local handler = moon.new_table(0,6)
 
 moon.dispatch(
@@ -26,8 +29,23 @@ local type_map = {
     error = 5
 }
 
-function M.connect( ... )
-    return tcp:connect(...)
+---作为客户端连接 websocket 服务端, 握手完成后触发 "connect" 事件
+---@param path string @可选, 默认 "/"
+---@return int @sessionid, 0 表示连接失败
+function M.connect(host, port, path)
+    return tcp:connect(host, port, path or "/")
+end
+
+---协程方式连接 websocket 服务端, 握手完成后返回 sessionid, 失败返回 false, errmsg
+---@param path string @可选, 默认 "/"
+function M.co_connect(host, port, path)
+    local respid = make_response()
+    tcp:async_connect(host, port, respid, path or "/")
+    local sessionid, err = co_yield()
+    if not sessionid then
+        return false, err
+    end
+    return tonumber(sessionid)
 end
 
 function M.settimeout( ... )
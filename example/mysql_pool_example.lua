@@ -0,0 +1,36 @@
+--mysql queries through mysqld services (config sid 17), the service keeps running while queries block
+local moon = require("moon")
+local mysqlpool = require("moon.mysqlpool")
+
+moon.start(function()
+    local pool = mysqlpool.new({moon.unique_service("mysqld1"), moon.unique_service("mysqld2")})
+
+    moon.repeated(100, -1, function()
+        print("tick")
+    end)
+
+    moon.async(function()
+        print(pool:execute([[
+            CREATE TABLE IF NOT EXISTS `article_detail` (
+            `id` BIGINT NOT NULL,
+            `title` varchar(255) DEFAULT '',
+            PRIMARY KEY (`id`)
+            ) ENGINE=InnoDB DEFAULT CHARSET=utf8;
+        ]]))
+
+        local stmtid = assert(pool:prepare("REPLACE INTO article_detail(id,title) VALUES(?,?)"))
+        for i = 1, 10 do
+            --same key, same connection: executed in order
+            print(pool:execute_stmt(i, stmtid, i, "title" .. i))
+        end
+
+        local rows, err = pool:query("select * from article_detail;")
+        if not rows then
+            print(err)
+            return
+        end
+        for _, row in ipairs(rows) do
+            print(table.unpack(row))
+        end
+    end)
+end)
@@ -13,10 +13,14 @@ local ncount = 10000
 
 local command = {}
 
+--send: pack for each receiver, multicast: pack once, cache: packed at start, reused by every round
+local modes = {"send", "multicast", "cache"}
+local round = 0
+
 command.TEST = function()
     counter = counter + 1
     if counter == ncount*4 then
-        print("cost ",moon.millsecond() - sttime)
+        print(modes[round % #modes + 1], "cost ",moon.millsecond() - sttime)
         counter = 0
     end
 end
@@ -41,13 +45,24 @@ moon.start(function()
     receiver3 = moon.unique_service("send_example_receiver3")
     receiver4 = moon.unique_service("send_example_receiver4")
 
+    local receivers = {receiver1, receiver2, receiver3, receiver4}
+    local cache = moon.make_cache('lua', "123456789")
+
     moon.repeated(1000, -1, function()
+        round = round + 1
         sttime = moon.millsecond()
+        local mode = modes[round % #modes + 1]
         for _=1,ncount do
-            moon.send('lua', receiver1,"TEST","123456789")
-            moon.send('lua', receiver2,"TEST","123456789")
-            moon.send('lua', receiver3,"TEST","123456789")
-            moon.send('lua', receiver4,"TEST","123456789")
+            if mode == "send" then
+                moon.send('lua', receiver1,"TEST","123456789")
+                moon.send('lua', receiver2,"TEST","123456789")
+                moon.send('lua', receiver3,"TEST","123456789")
+                moon.send('lua', receiver4,"TEST","123456789")
+            elseif mode == "multicast" then
+                moon.multicast('lua', receivers, "TEST", "123456789")
+            else
+                moon.raw_multicast('lua', receivers, "TEST", cache)
+            end
         end
     end)
 end)
@@ -1,3 +1,5 @@
+--cluster relay service, replaced by native cluster transport (lualib/cluster.lua, config "cluster").
+--kept for compatibility, see benchmark_cluster.lua
 local moon = require("moon")
 local seri = require("seri")
 local log = require("log")
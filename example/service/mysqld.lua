@@ -0,0 +1,79 @@
+--mysql connection service. lmysql calls block the worker thread, so each connection is a service
+--on its own worker: config "shared": false. start several for a pool, see lualib/moon/mysqlpool.lua.
+--service config: host, port, user, password, database, timeout
+local moon = require("moon")
+local log = require("log")
+local mysql = require("mysql")
+
+local conf
+local conn
+--sql of prepared statements, prepared again on a new connection: stmtid is the hash of sql, callers keep using it
+local prepared = {}
+
+local function connect()
+    local c = mysql.create()
+    local ok, err = c:connect(conf.host, conf.port, conf.user, conf.password, conf.database, conf.timeout or 0)
+    if not ok then
+        return false, err
+    end
+    for sql in pairs(prepared) do
+        local stmtid, perr = c:prepare(sql)
+        if not stmtid then
+            log.error("mysqld %s prepare '%s' failed: %s", moon.name(), sql, tostring(perr))
+        end
+    end
+    conn = c
+    return true
+end
+
+local command = {}
+
+command.query = function(sql)
+    return conn:query(sql)
+end
+
+command.execute = function(sql)
+    return conn:execute(sql)
+end
+
+command.prepare = function(sql)
+    local stmtid, err = conn:prepare(sql)
+    if stmtid then
+        prepared[sql] = true
+    end
+    return stmtid, err
+end
+
+command.execute_stmt = function(stmtid, ...)
+    return conn:execute_stmt(stmtid, ...)
+end
+
+local function docmd(sender, responseid, CMD, ...)
+    local f = command[CMD]
+    if not f then
+        error(string.format("Unknown command %s", tostring(CMD)))
+    end
+
+    if not conn or not conn:connected() then
+        local ok, err = connect()
+        if not ok then
+            moon.response('lua', sender, responseid, false, err)
+            return
+        end
+    end
+    moon.response('lua', sender, responseid, f(...))
+end
+
+moon.init(function(config)
+    conf = config
+    local ok, err = connect()
+    if not ok then
+        --connect again when used
+        log.error("mysqld %s connect failed: %s", moon.name(), tostring(err))
+    end
+    return true
+end)
+
+moon.dispatch('lua', function(msg, p)
+    docmd(msg:sender(), msg:responseid(), p.unpack(msg))
+end)
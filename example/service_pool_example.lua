@@ -0,0 +1,28 @@
+--Service pool example: churn of short-lived room services, with and without "pool"
+
+local moon = require("moon")
+
+local function churn(n, pool)
+    local t0 = moon.millsecond()
+    for i = 1, n do
+        local sid = moon.new_service("lua", {name = "room", file = "service_pool_room.lua", room = i, pool = pool})
+        local room, roomsid = moon.co_call("lua", sid, "player" .. i)
+        assert(room == i and roomsid == sid)
+        moon.co_remove_service(sid)
+    end
+    return moon.millsecond() - t0
+end
+
+moon.start(function()
+    moon.async(function()
+        local n = 2000
+        for _, pool in ipairs({0, 16}) do
+            local cost = churn(n, pool)
+            --config loglevel ERROR hides "new service" logs, which cost more than spawn
+            moon.set_loglevel("INFO")
+            print(string.format("pool=%d: %d rooms %d ms, %.1f us/room", pool, n, cost, cost * 1000 / n))
+            moon.set_loglevel("ERROR")
+        end
+        moon.abort()
+    end)
+end)
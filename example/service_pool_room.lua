@@ -0,0 +1,26 @@
+--Room service for service_pool_example: module state is wiped by moon.reset, so the service can be reused
+
+local moon = require("moon")
+
+local room_id
+local players = {}
+
+moon.init(function(config)
+    assert(not room_id and not next(players), "room state not reset")
+    room_id = config.room
+    return true
+end)
+
+moon.dispatch("lua", function(msg, p)
+    local sender = msg:sender()
+    local responseid = msg:responseid()
+    local player = p.unpack(msg)
+    players[player] = true
+    moon.response("lua", sender, responseid, room_id, moon.sid())
+end)
+
+moon.reset(function()
+    room_id = nil
+    players = {}
+    return true
+end)
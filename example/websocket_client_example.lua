@@ -0,0 +1,65 @@
+--Websocket Client Example: connect to the websocket listener of this service and check echo
+
+local moon = require("moon")
+local websocket = require("moon.websocket")
+
+local clients = {}
+
+websocket.on("accept",function(sessionid, msg)
+    print("wsaccept ", sessionid, msg:bytes())
+end)
+
+websocket.on("connect",function(sessionid, msg)
+    print("wsconnect ", sessionid, msg:bytes())
+end)
+
+websocket.on("message",function(sessionid, msg)
+    local co = clients[sessionid]
+    if co then
+        --client side, resume the test coroutine
+        coroutine.resume(co, msg:bytes())
+    else
+        --server side, echo
+        websocket.send_message(sessionid, msg)
+    end
+end)
+
+websocket.on("close",function(sessionid, msg)
+    print("wsclose ", sessionid, msg:bytes())
+end)
+
+websocket.on("error",function(sessionid, msg)
+    print("wserror ", sessionid, msg:bytes())
+end)
+
+moon.start(function()
+    moon.async(function()
+        local sessionid, err = websocket.co_connect("127.0.0.1", "12347", "/echo")
+        if not sessionid then
+            print("websocket connect failed", err)
+            return
+        end
+
+        clients[sessionid] = coroutine.running()
+        local sizes = {1, 125, 126, 65535, 65536, 200000}
+        for _, n in ipairs(sizes) do
+            local s = string.rep("x", n)
+            websocket.send(sessionid, s)
+            local res = coroutine.yield()
+            assert(res == s, string.format("websocket echo mismatch, size %d", n))
+        end
+        clients[sessionid] = nil
+        websocket.close(sessionid)
+        print("websocket client echo test ok", #sizes)
+
+        --control frames, needs example/wscontrolserver.py
+        sessionid = websocket.co_connect("127.0.0.1", "12348", "/")
+        if sessionid then
+            clients[sessionid] = coroutine.running()
+            local res = coroutine.yield()
+            assert(res == "", "websocket empty text mismatch")
+            clients[sessionid] = nil
+            websocket.send(sessionid, "empty")
+        end
+    end)
+end)
@@ -0,0 +1,60 @@
+# -*- coding:utf-8 -*-
+# websocket peer for client mode control frames: empty ping, ping, pong, empty text, empty close.
+# run it, then start websocket_client_example with port 12348 to connect here.
+import socket
+import base64
+import hashlib
+import time
+
+HOST = "127.0.0.1"
+PORT = 12348
+GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+
+def handshake(c):
+    req = b""
+    while b"\r\n\r\n" not in req:
+        req += c.recv(4096)
+    key = b""
+    for line in req.split(b"\r\n"):
+        if line.lower().startswith(b"sec-websocket-key:"):
+            key = line.split(b":", 1)[1].strip()
+    accept = base64.b64encode(hashlib.sha1(key + GUID).digest())
+    c.sendall(b"HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+              b"Sec-WebSocket-Accept: " + accept + b"\r\n\r\n")
+
+
+def read_frame(c):
+    head = c.recv(2)
+    assert len(head) == 2, "connection closed"
+    assert head[1] & 0x80, "client frame must be masked"
+    n = head[1] & 0x7F
+    key = c.recv(4)
+    data = c.recv(n) if n > 0 else b""
+    return head[0], bytes(b ^ key[i % 4] for i, b in enumerate(data))
+
+
+def main():
+    s = socket.socket()
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind((HOST, PORT))
+    s.listen(1)
+    c, _ = s.accept()
+    c.settimeout(3)
+    handshake(c)
+
+    c.sendall(b"\x89\x00")
+    assert read_frame(c) == (0x8A, b""), "empty ping not answered"
+    c.sendall(b"\x89\x04ping")
+    assert read_frame(c) == (0x8A, b"ping"), "ping not answered"
+    # unsolicited pong is dropped, empty text reaches the client
+    c.sendall(b"\x8A\x00\x81\x00")
+    assert read_frame(c) == (0x81, b"empty"), "empty text not received"
+    c.sendall(b"\x88\x00")
+    time.sleep(0.5)
+    assert c.recv(16) == b"", "empty close not handled"
+    print("websocket control frame test ok")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,10 +1,11 @@
 #pragma once
 #include <vector>
-#include <variant>
 #include <cassert>
+#include <cstdlib>
 #include <string>
 #include <tuple>
 #include <string_view>
+#include <type_traits>
 
 namespace db
 {
@@ -47,92 +48,216 @@ namespace db
         template<class T>
     constexpr bool is_char_array_v = std::is_array_v<T>&&std::is_same_v<char, std::remove_pointer_t<std::decay_t<T>>>;
 
-    using db_data_value_t = std::variant<nullptr_t, char, int, float, double, int64_t, std::string>;
+    //how a column of mysql type is stored. types without a number form (decimal, date, blob...) are text
+    enum class column_kind :uint8_t
+    {
+        integer,
+        number,
+        string
+    };
 
-    class data_table
+    inline column_kind kind_of(int type)
     {
-    public:
-        using row_t = std::vector<db_data_value_t>;
-        using rows_t = std::vector<row_t>;
-        using data_type = rows_t;
-        using iterator = data_type::iterator;
-        using const_iterator = data_type::const_iterator;
-        using difference_type = data_type::difference_type;
-        using size_type = data_type::size_type;
-
-        const_iterator begin() const noexcept
+        switch (type)
         {
-            return rows_.begin();
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONGLONG:
+        case MYSQL_TYPE_YEAR:
+            return column_kind::integer;
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+            return column_kind::number;
+        default:
+            return column_kind::string;
         }
+    }
 
-        iterator begin() noexcept
+    /*
+        Result set stored by column: numbers in one contiguous array per column, text of a column in one
+        string arena with offsets, no allocation per cell. NULL cells are marked in a bitmap created at
+        the first NULL of the column.
+    */
+    class data_table
+    {
+    public:
+        class column
         {
-            return rows_.begin();
-        }
+        public:
+            column(std::string name, int type)
+                :kind_(kind_of(type))
+                , type_(type)
+                , name_(std::move(name))
+            {
+                if (kind_ == column_kind::string)
+                {
+                    offsets_.push_back(0);
+                }
+            }
 
-        const_iterator end() const noexcept
-        {
-            return rows_.end();
-        }
+            const std::string& name() const
+            {
+                return name_;
+            }
 
-        iterator end() noexcept
-        {
-            return rows_.end();
-        }
+            int type() const
+            {
+                return type_;
+            }
 
-        template<typename Name, typename Type>
-        void add_column(Name&& colname, Type&& data_type)
-        {
-            cols_.emplace_back(std::forward<Name>(colname), std::forward<Type>(data_type));
-        }
+            column_kind kind() const
+            {
+                return kind_;
+            }
 
-        template<typename Row>
-        void add_row(Row&& rowdata)
-        {
-            row_t row;
-            row.reserve(cols_.size());
-            int i = 0;
-            for (auto& col : cols_)
+            size_t size() const
             {
-                switch (col.second)
+                return size_;
+            }
+
+            bool is_null(size_t row) const
+            {
+                return !nulls_.empty() && nulls_[row];
+            }
+
+            int64_t integer(size_t row) const
+            {
+                assert(kind_ == column_kind::integer && row < size_);
+                return integers_[row];
+            }
+
+            double number(size_t row) const
+            {
+                assert(kind_ == column_kind::number && row < size_);
+                return numbers_[row];
+            }
+
+            std::string_view string(size_t row) const
+            {
+                assert(kind_ == column_kind::string && row < size_);
+                return std::string_view{ arena_.data() + offsets_[row], offsets_[row + 1] - offsets_[row] };
+            }
+
+            void reserve(size_t rows)
+            {
+                switch (kind_)
                 {
-                case MYSQL_TYPE_TINY:
-                case MYSQL_TYPE_SHORT:
-                case MYSQL_TYPE_LONG:
-                    row.emplace_back(std::stoi(rowdata[i]));
+                case column_kind::integer:
+                    integers_.reserve(rows);
                     break;
-                case MYSQL_TYPE_FLOAT:
-                    row.emplace_back(std::stof(rowdata[i]));
+                case column_kind::number:
+                    numbers_.reserve(rows);
                     break;
-                case MYSQL_TYPE_DOUBLE:
-                    row.emplace_back(std::stod(rowdata[i]));
+                case column_kind::string:
+                    offsets_.reserve(rows + 1);
                     break;
-                case MYSQL_TYPE_LONGLONG:
-                    row.emplace_back(static_cast<int64_t>(std::stoll(rowdata[i])));
+                }
+            }
+
+            //data: text of the cell as mysql returns, nullptr: NULL
+            void add(const char* data, size_t len)
+            {
+                if (nullptr == data)
+                {
+                    if (nulls_.empty())
+                    {
+                        nulls_.resize(size_, false);
+                    }
+                    nulls_.push_back(true);
+                }
+                else if (!nulls_.empty())
+                {
+                    nulls_.push_back(false);
+                }
+
+                switch (kind_)
+                {
+                case column_kind::integer:
+                    integers_.push_back((nullptr != data) ? std::strtoll(data, nullptr, 10) : 0);
                     break;
-                case MYSQL_TYPE_VAR_STRING:
-                    row.emplace_back(std::string(rowdata[i]));
+                case column_kind::number:
+                    numbers_.push_back((nullptr != data) ? std::strtod(data, nullptr) : 0.0);
                     break;
-                default:
+                case column_kind::string:
+                    if (nullptr != data)
+                    {
+                        arena_.append(data, len);
+                    }
+                    offsets_.push_back(arena_.size());
                     break;
                 }
-                i++;
+                ++size_;
+            }
+        private:
+            column_kind kind_;
+            int type_;
+            size_t size_ = 0;
+            std::string name_;
+            std::vector<int64_t> integers_;
+            std::vector<double> numbers_;
+            std::string arena_;
+            //string of row i: arena_[offsets_[i], offsets_[i + 1])
+            std::vector<size_t> offsets_;
+            std::vector<bool> nulls_;
+        };
+
+        template<typename Name, typename Type>
+        void add_column(Name&& colname, Type&& data_type)
+        {
+            cols_.emplace_back(std::string(std::forward<Name>(colname)), static_cast<int>(data_type));
+        }
+
+        void reserve(size_t rows)
+        {
+            for (auto& col : cols_)
+            {
+                col.reserve(rows);
             }
-            rows_.emplace_back(std::move(row));
         }
 
-        template<typename T>
-        T& get(size_t row, size_t col)
+        //rowdata: cells of a row, lengths: byte size of each cell (mysql_fetch_lengths)
+        template<typename Row, typename Lengths>
+        void add_row(Row&& rowdata, Lengths&& lengths)
         {
-            assert(row < rows_.size() && col < cols_.size());
-            return std::get<T>(rows_.at(row).at(col));
+            for (size_t i = 0; i < cols_.size(); ++i)
+            {
+                cols_[i].add(rowdata[i], static_cast<size_t>(lengths[i]));
+            }
+            ++nrow_;
         }
 
+        const column& col(size_t i) const
+        {
+            assert(i < cols_.size());
+            return cols_[i];
+        }
+
+        //T: integral, floating point, std::string_view or std::string. NULL cell is 0 or empty
         template<typename T>
-        const T& get(size_t row, size_t col) const
+        T get(size_t row, size_t col) const
         {
-            assert(row < rows_.size() && col < cols_.size());
-            return std::get<T>(rows_.at(row).at(col));
+            assert(row < nrow_ && col < cols_.size());
+            auto& c = cols_[col];
+            if constexpr (std::is_arithmetic_v<T>)
+            {
+                switch (c.kind())
+                {
+                case column_kind::integer:
+                    return static_cast<T>(c.integer(row));
+                case column_kind::number:
+                    return static_cast<T>(c.number(row));
+                default:
+                    return static_cast<T>(std::strtod(std::string{ c.string(row) }.data(), nullptr));
+                }
+            }
+            else
+            {
+                static_assert(std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>, "unsupported type");
+                assert(c.kind() == column_kind::string);
+                return T{ c.string(row) };
+            }
         }
 
         const size_t column_size() const
@@ -142,10 +267,10 @@ namespace db
 
         const size_t row_size() const
         {
-            return rows_.size();
+            return nrow_;
         }
     private:
-        std::vector<std::pair<std::string, int>> cols_;
-        rows_t rows_;
+        size_t nrow_ = 0;
+        std::vector<column> cols_;
     };
-}
\ No newline at end of file
+}
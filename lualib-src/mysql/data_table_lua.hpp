@@ -1,62 +1,67 @@
 #pragma once
 #include <vector>
-#include <variant>
 #include <cassert>
+#include <cstdlib>
 #include <string>
 #include <tuple>
 #include <string_view>
+#include <memory>
 #include"data_table.hpp"
 #include "lua.hpp"
 namespace db
 {
+    //builds the lua result table row by row while fetching: { {col1, col2, ...}, ... }. NULL cell is nil
     class data_table_lua
     {
     public:
         data_table_lua(lua_State *L_)
             :L(L_)
         {
-            lua_createtable(L, 64, 0);
+            lua_createtable(L, 0, 0);
             lua_table_ = lua_gettop(L);
         }
 
         template<typename Name, typename Type>
         void add_column(Name&& colname, Type&& data_type)
         {
-            cols_.emplace_back(std::forward<Name>(colname), std::forward<Type>(data_type));
+            cols_.emplace_back(kind_of(static_cast<int>(data_type)));
+            (void)colname;
         }
 
-        template<typename Row>
-        void add_row(Row&& rowdata)
+        void reserve(size_t rows)
+        {
+            //replace the empty table with a presized one
+            lua_createtable(L, static_cast<int>(rows), 0);
+            lua_replace(L, lua_table_);
+        }
+
+        template<typename Row, typename Lengths>
+        void add_row(Row&& rowdata, Lengths&& lengths)
         {
             luaL_checkstack(L, LUA_MINSTACK, NULL);
             lua_createtable(L, static_cast<int>(cols_.size()), 0);
 
-            int i = 0;
-            for (auto& col : cols_)
+            for (size_t i = 0; i < cols_.size(); ++i)
             {
-                switch (col.second)
+                const char* data = rowdata[i];
+                if (nullptr == data)
                 {
-                case MYSQL_TYPE_TINY:
-                case MYSQL_TYPE_SHORT:
-                case MYSQL_TYPE_LONG:
-                case MYSQL_TYPE_LONGLONG:
-                    lua_pushinteger(L, std::stoll(rowdata[i]));
-                    break;
-                case MYSQL_TYPE_FLOAT:
-                case MYSQL_TYPE_DOUBLE:
-                    lua_pushnumber(L, std::stod(rowdata[i]));
-                    break;
-                case MYSQL_TYPE_VAR_STRING:
+                    continue;
+                }
+
+                switch (cols_[i])
                 {
-                    std::string_view s(rowdata[i]);
-                    lua_pushlstring(L, s.data(), s.size());
+                case column_kind::integer:
+                    lua_pushinteger(L, static_cast<lua_Integer>(std::strtoll(data, nullptr, 10)));
                     break;
-                }
-                default:
+                case column_kind::number:
+                    lua_pushnumber(L, std::strtod(data, nullptr));
+                    break;
+                case column_kind::string:
+                    lua_pushlstring(L, data, static_cast<size_t>(lengths[i]));
                     break;
                 }
-                i++;
-                lua_rawseti(L, -2, i);
+                lua_rawseti(L, -2, static_cast<lua_Integer>(i + 1));
             }
             lua_rawseti(L, lua_table_, ++nrow_);
         }
@@ -68,8 +73,196 @@ namespace db
 
     private:
         int lua_table_ = 0;
-        int nrow_ = 0;
+        lua_Integer nrow_ = 0;
         lua_State * L;
-        std::vector<std::pair<std::string, int>> cols_;
+        std::vector<column_kind> cols_;
+    };
+
+    //push cell of a columnar data_table, NULL is nil
+    inline void push_cell(lua_State* L, const data_table& dt, size_t row, size_t col)
+    {
+        auto& c = dt.col(col);
+        if (c.is_null(row))
+        {
+            lua_pushnil(L);
+            return;
+        }
+        switch (c.kind())
+        {
+        case column_kind::integer:
+            lua_pushinteger(L, static_cast<lua_Integer>(c.integer(row)));
+            break;
+        case column_kind::number:
+            lua_pushnumber(L, c.number(row));
+            break;
+        case column_kind::string:
+        {
+            auto s = c.string(row);
+            lua_pushlstring(L, s.data(), s.size());
+            break;
+        }
+        }
+    }
+
+    //push row of a columnar data_table as {col1, col2, ...}, same layout as data_table_lua
+    inline void push_row(lua_State* L, const data_table& dt, size_t row)
+    {
+        size_t ncol = dt.column_size();
+        lua_createtable(L, static_cast<int>(ncol), 0);
+        for (size_t c = 0; c < ncol; ++c)
+        {
+            if (dt.col(c).is_null(row))
+            {
+                continue;
+            }
+            push_cell(L, dt, row, c);
+            lua_rawseti(L, -2, static_cast<lua_Integer>(c + 1));
+        }
+    }
+
+    //push a columnar data_table as lua table of rows, same layout as data_table_lua
+    inline void push_data_table(lua_State* L, const data_table& dt)
+    {
+        size_t nrow = dt.row_size();
+        luaL_checkstack(L, LUA_MINSTACK, NULL);
+        lua_createtable(L, static_cast<int>(nrow), 0);
+        for (size_t r = 0; r < nrow; ++r)
+        {
+            push_row(L, dt, r);
+            lua_rawseti(L, -2, static_cast<lua_Integer>(r + 1));
+        }
+    }
+
+    /*
+        Lua userdata owns a columnar data_table, result of conn:query_result(sql). Rows are built only
+        when they are accessed, so loading a big table does not create a lua table per row.
+        Lua API:
+            #rs                 row count
+            rs[i]               row i as {col1, col2, ...}, a new table each access. ipairs(rs) works
+            rs:get(i, col)      one cell without the row table, col: index from 1 or column name
+            rs:columns()        {name1, name2, ...}
+            rs:rows()           all rows, same as conn:query(sql)
+    */
+    class lua_data_table
+    {
+    public:
+        static constexpr const char* METANAME = "mysql.result";
+
+        std::shared_ptr<data_table> dt;
+
+        static void push(lua_State* L, std::shared_ptr<data_table> v)
+        {
+            void* p = lua_newuserdata(L, sizeof(lua_data_table));
+            new (p) lua_data_table{ std::move(v) };
+            if (luaL_newmetatable(L, METANAME))
+            {
+                init_metatable(L);
+            }
+            lua_setmetatable(L, -2);
+        }
+
+        static const data_table& check(lua_State* L, int index)
+        {
+            return *static_cast<lua_data_table*>(luaL_checkudata(L, index, METANAME))->dt;
+        }
+    private:
+        static void init_metatable(lua_State* L)
+        {
+            luaL_Reg l[] = {
+                {"get", lget},
+                {"columns", lcolumns},
+                {"rows", lrows},
+                {NULL, NULL},
+            };
+            //methods table is the upvalue of __index
+            luaL_newlib(L, l);
+            lua_pushcclosure(L, lindex, 1);
+            lua_setfield(L, -2, "__index");
+            lua_pushcfunction(L, llen);
+            lua_setfield(L, -2, "__len");
+            lua_pushcfunction(L, lgc);
+            lua_setfield(L, -2, "__gc");
+        }
+
+        //0: out of range
+        static size_t row_index(const data_table& dt, lua_Integer i)
+        {
+            return (i >= 1 && static_cast<size_t>(i) <= dt.row_size()) ? static_cast<size_t>(i) : 0;
+        }
+
+        static int lindex(lua_State* L)
+        {
+            auto& dt = check(L, 1);
+            if (lua_type(L, 2) == LUA_TNUMBER)
+            {
+                size_t row = row_index(dt, luaL_checkinteger(L, 2));
+                if (0 == row)
+                {
+                    return 0;
+                }
+                push_row(L, dt, row - 1);
+                return 1;
+            }
+            lua_pushvalue(L, 2);
+            lua_rawget(L, lua_upvalueindex(1));
+            return 1;
+        }
+
+        static int llen(lua_State* L)
+        {
+            lua_pushinteger(L, static_cast<lua_Integer>(check(L, 1).row_size()));
+            return 1;
+        }
+
+        static int lget(lua_State* L)
+        {
+            auto& dt = check(L, 1);
+            size_t row = row_index(dt, luaL_checkinteger(L, 2));
+            size_t col = 0;
+            if (lua_type(L, 3) == LUA_TSTRING)
+            {
+                const char* name = lua_tostring(L, 3);
+                while (col < dt.column_size() && dt.col(col).name() != name)
+                {
+                    ++col;
+                }
+            }
+            else
+            {
+                col = static_cast<size_t>(luaL_checkinteger(L, 3) - 1);
+            }
+
+            if (0 == row || col >= dt.column_size())
+            {
+                return 0;
+            }
+            push_cell(L, dt, row - 1, col);
+            return 1;
+        }
+
+        static int lcolumns(lua_State* L)
+        {
+            auto& dt = check(L, 1);
+            lua_createtable(L, static_cast<int>(dt.column_size()), 0);
+            for (size_t c = 0; c < dt.column_size(); ++c)
+            {
+                auto& name = dt.col(c).name();
+                lua_pushlstring(L, name.data(), name.size());
+                lua_rawseti(L, -2, static_cast<lua_Integer>(c + 1));
+            }
+            return 1;
+        }
+
+        static int lrows(lua_State* L)
+        {
+            push_data_table(L, check(L, 1));
+            return 1;
+        }
+
+        static int lgc(lua_State* L)
+        {
+            static_cast<lua_data_table*>(lua_touserdata(L, 1))->~lua_data_table();
+            return 0;
+        }
     };
-}
\ No newline at end of file
+}
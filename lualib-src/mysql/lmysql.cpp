@@ -160,6 +160,30 @@ static int lmysql_query(lua_State *L)
     return 1;
 }
 
+//columnar result, rows are built on access: loading big tables at startup
+static int lmysql_query_result(lua_State *L)
+{
+    struct lua_mysql_box* my = (lua_mysql_box*)lua_touserdata(L, 1);
+    if (my == nullptr || my->mysql == nullptr)
+        return luaL_error(L, "Invalid mysql pointer");
+
+    const char* sql = luaL_checkstring(L, 2);
+
+    std::shared_ptr<db::data_table> dt;
+    try
+    {
+        dt = my->mysql->query<db::data_table>(sql);
+    }
+    catch (std::exception& e)
+    {
+        lua_pushboolean(L, 0);
+        lua_pushstring(L, e.what());
+        return 2;
+    }
+    db::lua_data_table::push(L, std::move(dt));
+    return 1;
+}
+
 static int lmysql_execute(lua_State *L)
 {
     struct lua_mysql_box* my = (lua_mysql_box*)lua_touserdata(L, 1);
@@ -248,6 +272,7 @@ static int lmysql_create(lua_State *L)
             { "errorcode",lmysql_errorcode },
             { "ping",lmysql_ping },
             { "query",lmysql_query },
+            { "query_result",lmysql_query_result },
             { "execute",lmysql_execute },
             { "prepare",lmysql_prepare },
             { "execute_stmt",lmysql_execute_stmt },
@@ -203,12 +203,14 @@ namespace db
                 {
                     dt->add_column(fields[i].name, fields[i].type);
                 }
+                dt->reserve(static_cast<size_t>(mysql_num_rows(result)));
 
                 MYSQL_ROW row;
                 row = mysql_fetch_row(result);
                 while (row != nullptr)
                 {
-                    dt->add_row(row);
+                    //byte size of cells, text may contain '\0'
+                    dt->add_row(row, mysql_fetch_lengths(result));
                     row = mysql_fetch_row(result);
                 }
             } while (0);
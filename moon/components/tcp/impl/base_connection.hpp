@@ -38,6 +38,8 @@ namespace moon
     class base_connection :public std::enable_shared_from_this<base_connection>
     {
     public:
+        friend class tcp;
+
         using socket_t = asio::ip::tcp::socket;
 
 		using message_handler_t = std::function<void(const message_ptr_t&)>;
@@ -50,6 +52,8 @@ namespace moon
             , id_(0)
 			, tcp_(t)
             , last_recv_time_(0)
+            , idle_prev_(nullptr)
+            , idle_next_(nullptr)
             , socket_(std::forward<Args>(args)...)
             , log_(nullptr)
         {
@@ -74,7 +78,7 @@ namespace moon
             remote_addr_ = addr.to_string(ec) + ":";
             remote_addr_ += std::to_string(ep.port());
 
-            last_recv_time_ = std::time(nullptr);
+            update_recv_time();
         }
 
         virtual bool read(const read_request& ctx)
@@ -83,7 +87,8 @@ namespace moon
             return false;
         };
 
-        virtual bool send(const buffer_ptr_t & data)
+        //bclose: close the connection after data is written
+        virtual bool send(const buffer_ptr_t & data, bool bclose = false)
         {
             if (data == nullptr || data->size() == 0)
             {
@@ -95,7 +100,7 @@ namespace moon
                 return false;
             }
 
-            send_queue_.push_back(data);
+            send_queue_.emplace_back(data, bclose);
 
             if (send_queue_.size() >= WARN_NET_SEND_QUEUE_SIZE)
             {
@@ -150,13 +155,15 @@ namespace moon
             return id_;
         }
 
-        void timeout_check(time_t now, int timeout)
+        bool timeout_check(time_t now, int timeout)
         {
             if ((0 != timeout) && (0 != last_recv_time_) && (now - last_recv_time_ > timeout))
             {
                 logic_error_ = network_logic_error::timeout;
                 close();
+                return true;
             }
+            return false;
         }
 
         void set_no_delay()
@@ -181,10 +188,20 @@ namespace moon
             frame_flag_ = t;
         }
     protected:
-        virtual void message_framing(const_buffers_holder& holder, buffer_ptr_t&& buf)
+        void update_recv_time()
+        {
+            last_recv_time_ = std::time(nullptr);
+            if (nullptr != tcp_)
+            {
+                tcp_->idle_touch(this);
+            }
+        }
+
+        virtual void message_framing(const_buffers_holder& holder, buffer_ptr_t&& buf, bool bclose)
         {
 			(void)holder;
 			(void)buf;
+			(void)bclose;
         }
 
         void post_send()
@@ -195,14 +212,15 @@ namespace moon
 
             while ((send_queue_.size() != 0) && (buffers_holder_.size() < 50))
             {
-                auto& msg = send_queue_.front();
+                auto& msg = send_queue_.front().first;
+                bool bclose = send_queue_.front().second;
                 if (msg->has_flag(buffer_flag::framing))
                 {
-                    message_framing(buffers_holder_, std::move(msg));
+                    message_framing(buffers_holder_, std::move(msg), bclose);
                 }
                 else
                 {
-                    buffers_holder_.push_back(std::move(msg));
+                    buffers_holder_.push_back(std::move(msg), bclose);
                 }
                 send_queue_.pop_front();
             }
@@ -285,6 +303,14 @@ namespace moon
 				tcp_->handle_message(std::forward<TMsg>(msg));
 			}
 		}
+
+        void response(string_view_t data, string_view_t header, int32_t responseid, uint8_t mtype)
+        {
+            if (nullptr != tcp_)
+            {
+                tcp_->make_response(data, header, responseid, mtype);
+            }
+        }
     protected:
         bool sending_;
         frame_enable_flag frame_flag_;
@@ -292,12 +318,15 @@ namespace moon
         uint32_t id_;
 		tcp* tcp_;
         time_t last_recv_time_;
+        base_connection* idle_prev_;
+        base_connection* idle_next_;
         socket_t socket_;
         handler_allocator read_allocator_;
         handler_allocator write_allocator_;
         const_buffers_holder  buffers_holder_;
         std::string remote_addr_;
-        std::deque<buffer_ptr_t> send_queue_;
+        //data and close after written
+        std::deque<std::pair<buffer_ptr_t, bool>> send_queue_;
         moon::log* log_;
     };
 }
\ No newline at end of file
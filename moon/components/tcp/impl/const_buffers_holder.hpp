@@ -10,13 +10,11 @@ namespace moon
     public:
         const_buffers_holder() = default;
 
+        //bclose: close the connection after this write
         template<typename BufType>
-        void push_back(BufType&& buf)
+        void push_back(BufType&& buf, bool bclose)
         {
-            if (buf->has_flag(buffer_flag::close))
-            {
-                close_ = true;
-            }
+            close_ = close_ || bclose;
             buffers_.emplace_back(buf->data(), buf->size());
             datas_.push_back(std::forward<BufType>(buf));
         }
@@ -36,8 +34,9 @@ namespace moon
         }
 
         template<typename BufType>
-        void framing_end(BufType&& buf)
+        void framing_end(BufType&& buf, bool bclose)
         {
+            close_ = close_ || bclose;
             datas_.push_back(std::forward<BufType>(buf));
         }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "base_connection.hpp"
+#include "common/resp.hpp"
 
 namespace moon
 {
@@ -8,11 +9,12 @@ namespace moon
     public:
         using base_connection_t = base_connection;
 
+        static constexpr size_t RESPONSE_BUFFER_SIZE = 8192;
+
         template <typename... Args>
         explicit custom_connection(Args&&... args)
             :base_connection_t(std::forward<Args>(args)...)
-            , restore_write_offset_(0)
-            , prew_read_offset_(0)
+            , scan_offset_(0)
             , buffer_()
         {
         }
@@ -20,7 +22,7 @@ namespace moon
         void start(bool accepted, int32_t responseid = 0) override
         {
             base_connection_t::start(accepted, responseid);
-            response_msg_ = message::create(8192);
+            response_msg_ = message::create(RESPONSE_BUFFER_SIZE);
             read_some();
         }
 
@@ -29,7 +31,11 @@ namespace moon
             if (is_open() && read_request_.responseid == 0)
             {
                 read_request_ = ctx;
-                restore_buffer_offset();
+                scan_offset_ = 0;
+                if (ctx.delim != read_delim::RESP)
+                {
+                    framer_.reset();
+                }
                 if (response_msg_->size() > 0)
                 {
                     //guarantee read is async operation
@@ -66,21 +72,68 @@ namespace moon
 
                 //CONSOLE_DEBUG(logger(), "connection recv:%u %s",id_, moon::to_hex_string(string_view_t{ (char*)buffer_.data(), bytes_transferred }, " ").data(), "");
 
-                last_recv_time_ = std::time(nullptr);
-                restore_buffer_offset();
+                update_recv_time();
                 response_msg_->get_buffer()->write_back(buffer_.data(), 0, bytes_transferred);
                 handle_read_request();
-                read_some();
+                continue_read();
             }));
         }
 
-        void restore_buffer_offset()
+        //the rest of a FIXEDLEN request is read into response buffer directly, no copy from buffer_
+        void read_fixed(size_t n)
         {
             auto buf = response_msg_->get_buffer();
-            buf->offset_writepos(restore_write_offset_);
-            buf->seek(prew_read_offset_, buffer::Current);
-            restore_write_offset_ = 0;
-            prew_read_offset_ = 0;
+            buf->check_space(n);
+            asio::async_read(socket_, asio::buffer(std::addressof(*buf->end()), n),
+                make_custom_alloc_handler(read_allocator_,
+                    [this, self = shared_from_this()](const asio::error_code& e, std::size_t bytes_transferred)
+            {
+                if (e)
+                {
+                    error(e, int(logic_error_));
+                    return;
+                }
+
+                update_recv_time();
+                response_msg_->get_buffer()->offset_writepos(static_cast<int>(bytes_transferred));
+                handle_read_request();
+                continue_read();
+            }));
+        }
+
+        void continue_read()
+        {
+            if (read_request_.responseid != 0 && read_request_.delim == read_delim::FIXEDLEN)
+            {
+                size_t n = response_msg_->get_buffer()->size();
+                if (n < read_request_.size)
+                {
+                    read_fixed(read_request_.size - n);
+                    return;
+                }
+            }
+            read_some();
+        }
+
+        //find delim in data[start, size), memchr for the first byte of delim
+        static size_t find_delim(const char* data, size_t size, const string_view_t& delim, size_t start)
+        {
+            const size_t dlen = delim.size();
+            while (start + dlen <= size)
+            {
+                auto p = static_cast<const char*>(std::memchr(data + start, delim[0], size - start - dlen + 1));
+                if (nullptr == p)
+                {
+                    break;
+                }
+                size_t pos = static_cast<size_t>(p - data);
+                if (std::memcmp(p + 1, delim.data() + 1, dlen - 1) == 0)
+                {
+                    return pos;
+                }
+                start = pos + 1;
+            }
+            return string_view_t::npos;
         }
 
         void read_with_delim(buffer* buf, const string_view_t& delim)
@@ -93,17 +146,44 @@ namespace moon
                 return;
             }
 
-            string_view_t strref(buf->data(), dszie);
-            size_t pos = strref.find(delim);
+            //only the new data is scanned, the delim may cross the boundary of two reads
+            size_t pos = find_delim(buf->data(), dszie, delim, scan_offset_);
             if (pos != string_view_t::npos)
             {
-                buf->offset_writepos(-static_cast<int>(dszie - pos));
-                restore_write_offset_ = static_cast<int>(dszie - pos);
-                prew_read_offset_ = static_cast<int>(pos + delim.size());
-                make_response(response_msg_);
+                scan_offset_ = 0;
+                response_read(pos, pos + delim.size());
+            }
+            else if (dszie >= delim.size())
+            {
+                scan_offset_ = dszie - delim.size() + 1;
             }
         }
 
+        //responds all complete replies in the buffer, partial reply is scanned incrementally
+        void read_resp(buffer* buf)
+        {
+            size_t dszie = buf->size();
+            int64_t n = framer_.frame(buf->data(), dszie);
+            if (n < 0)
+            {
+                error(asio::error_code(), int(network_logic_error::protocol_error));
+                base_connection_t::close();
+                return;
+            }
+
+            if (n == 0)
+            {
+                if (read_request_.size != 0 && dszie > read_request_.size)
+                {
+                    error(asio::error_code(), int(network_logic_error::read_message_size_max));
+                    base_connection_t::close();
+                }
+                return;
+            }
+
+            response_read(static_cast<size_t>(n), static_cast<size_t>(n));
+        }
+
         void handle_read_request()
         {
             auto buf = response_msg_->get_buffer();
@@ -120,10 +200,7 @@ namespace moon
             {
                 if (buf->size() >= read_request_.size)
                 {
-                    buf->offset_writepos(-static_cast<int>(dszie - read_request_.size));
-                    restore_write_offset_ = static_cast<int>(dszie - read_request_.size);
-                    prew_read_offset_ = static_cast<int>(read_request_.size);
-                    make_response(response_msg_);
+                    response_read(read_request_.size, read_request_.size);
                     break;
                 }
                 else
@@ -146,6 +223,11 @@ namespace moon
                 read_with_delim(buf, STR_DCRLF);
                 break;
             }
+            case read_delim::RESP:
+            {
+                read_resp(buf);
+                break;
+            }
             default:
                 break;
             }
@@ -156,21 +238,45 @@ namespace moon
             (void)lerrmsg;
 
             response_msg_->get_buffer()->clear();
+            framer_.reset();
 
+            auto msg = message::create();
             if (e && e != asio::error::eof)
             {
-                response_msg_->set_header("closed");
-                response_msg_->write_string(moon::format("%s.(%d)", e.message().data(), e.value()));
+                msg->set_header("closed");
+                msg->write_string(moon::format("%s.(%d)", e.message().data(), e.value()));
             }
             else
             {
-                response_msg_->set_header(logic_errmsg(logicerr));
+                msg->set_header(logic_errmsg(logicerr));
             }
 
             if (read_request_.responseid != 0)
             {
-                make_response(response_msg_, PTYPE_ERROR);
+                make_response(msg, PTYPE_ERROR);
+            }
+        }
+
+        //responds the first n bytes of the read data and consumes count bytes. every response owns its buffer,
+        //lua may keep views of it (msg:view) after the next read
+        void response_read(size_t n, size_t count)
+        {
+            auto buf = response_msg_->get_buffer();
+            message_ptr_t msg;
+            if (buf->size() == count)
+            {
+                //no unread data: hand over the whole buffer, no copy
+                msg = std::move(response_msg_);
+                buf->offset_writepos(-static_cast<int>(count - n));
+                response_msg_ = message::create(RESPONSE_BUFFER_SIZE);
+            }
+            else
+            {
+                msg = message::create(n);
+                msg->get_buffer()->write_back(buf->data(), 0, n);
+                buf->seek(static_cast<int>(count), buffer::Current);
             }
+            make_response(msg);
         }
 
         void make_response(const message_ptr_t & msg, uint8_t mtype = PTYPE_TEXT)
@@ -181,8 +287,9 @@ namespace moon
             handle_message(msg);
         }
     protected:
-        int restore_write_offset_;
-        int prew_read_offset_;
+        //delimiter scan position of current read request, relative to the readable data
+        size_t scan_offset_;
+        resp::framer framer_;
         message_ptr_t  response_msg_;
         std::array<uint8_t, 8192> buffer_;
         read_request read_request_;
@@ -30,7 +30,7 @@ namespace moon
             read_header();
         }
 
-        bool send(const buffer_ptr_t & data) override
+        bool send(const buffer_ptr_t & data, bool bclose = false) override
         {
             if (!data->has_flag(buffer_flag::pack_size))
             {
@@ -57,11 +57,11 @@ namespace moon
                     }
                 }
             }
-            return base_connection_t::send(data);
+            return base_connection_t::send(data, bclose);
         }
 
     protected:
-        void message_framing(const_buffers_holder& holder, buffer_ptr_t&& buf) override
+        void message_framing(const_buffers_holder& holder, buffer_ptr_t&& buf, bool bclose) override
         {
             size_t n = buf->size();
             holder.framing_begin(n / MAX_NET_MSG_SIZE + 1);
@@ -82,7 +82,7 @@ namespace moon
                 host2net(header);
                 holder.push_framing(header, data, size);
             } while (n != 0);
-            holder.framing_end(std::forward<buffer_ptr_t>(buf));
+            holder.framing_end(std::forward<buffer_ptr_t>(buf), bclose);
         }
 
         void read_header()
@@ -103,7 +103,7 @@ namespace moon
                     return;
                 }
 
-                last_recv_time_ = std::time(nullptr);
+                update_recv_time();
                 net2host(header_);
 
                 bool enable = (static_cast<int>(frame_flag_)&static_cast<int>(frame_enable_flag::receive)) != 0;
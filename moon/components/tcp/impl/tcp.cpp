@@ -12,10 +12,13 @@ namespace moon
     tcp::tcp() noexcept
         :type_(PTYPE_SOCKET)
         , frame_flag_(frame_enable_flag::none)
-        , connuid_(1)
+        , connseq_(1)
         , timeout_(0)
+        , connnum_(0)
         , io_ctx_(nullptr)
         , parent_(nullptr)
+        , idle_head_(nullptr)
+        , idle_tail_(nullptr)
     {
     }
 
@@ -31,20 +34,42 @@ namespace moon
 
     void tcp::settimeout(int seconds)
     {
-        checker_ = std::make_unique<asio::steady_timer>(io_context());
-        timeout_ = seconds;
-        check();
+        bool enable = (0 == timeout_ && seconds > 0);
+        timeout_ = (seconds > 0) ? seconds : 0;
+        if (enable)
+        {
+            //link connections created before timeout enabled, keep the list ordered by last recv time
+            std::vector<base_connection*> v;
+            v.reserve(connnum_);
+            for (auto& conn : conns_)
+            {
+                if (nullptr != conn && 0 != conn->last_recv_time_)
+                {
+                    v.push_back(conn.get());
+                }
+            }
+            std::sort(v.begin(), v.end(), [](base_connection* a, base_connection* b) {
+                return a->last_recv_time_ < b->last_recv_time_;
+            });
+            for (auto c : v)
+            {
+                idle_touch(c);
+            }
+        }
+
+        if (nullptr == checker_)
+        {
+            checker_ = std::make_unique<asio::steady_timer>(io_context());
+            check();
+        }
     }
 
     void tcp::setnodelay(uint32_t connid)
     {
-        do
+        if (auto conn = find_connection(connid); nullptr != conn)
         {
-            auto iter = conns_.find(connid);
-            if (iter == conns_.end())
-                break;
-            iter->second->set_no_delay();
-        } while (0);
+            conn->set_no_delay();
+        }
     }
 
     void tcp::set_enable_frame(std::string flag)
@@ -79,6 +104,21 @@ namespace moon
         }
     }
 
+    void tcp::set_ws_deflate(const ws_deflate_options& opt)
+    {
+        ws_deflate_ = opt;
+        if (ws_deflate_.enable && !ws::permessage_deflate::supported())
+        {
+            ws_deflate_.enable = false;
+            CONSOLE_WARN(logger(), "tcp::set_ws_deflate permessage-deflate is not supported, build without zlib(MOON_ENABLE_ZLIB).");
+        }
+    }
+
+    const ws_deflate_options& tcp::ws_deflate() const
+    {
+        return ws_deflate_;
+    }
+
     bool tcp::listen(const std::string & ip, const std::string & port)
     {
         try
@@ -122,8 +162,7 @@ namespace moon
 
             if (!e)
             {
-                conn->set_id(make_connid());
-                conns_.emplace(conn->id(), conn);
+                add_connection(conn);
                 conn->start(true);
 
                 if (responseid != 0)
@@ -149,7 +188,7 @@ namespace moon
         });
     }
 
-    void tcp::async_connect(const std::string & ip, const std::string & port, int32_t responseid)
+    void tcp::async_connect(const std::string & ip, const std::string & port, int32_t responseid, const std::string& path)
     {
         try
         {
@@ -157,6 +196,10 @@ namespace moon
             asio::ip::tcp::resolver::query query(ip, port);
             asio::ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
             auto conn = create_connection();
+            if (type_ == PTYPE_SOCKET_WS)
+            {
+                std::static_pointer_cast<ws_connection>(conn)->set_client_request(ip + ":" + port, path);
+            }
             asio::async_connect(conn->socket(), endpoint_iterator,
                 [this, self = shared_from_this(), conn, ip, port, responseid](const asio::error_code& e, asio::ip::tcp::resolver::iterator)
             {
@@ -167,8 +210,13 @@ namespace moon
 
                 if (!e)
                 {
-                    conn->set_id(make_connid());
-                    conns_.emplace(conn->id(), conn);
+                    add_connection(conn);
+                    if (type_ == PTYPE_SOCKET_WS)
+                    {
+                        //response after websocket handshake
+                        conn->start(false, responseid);
+                        return;
+                    }
                     conn->start(false);
                     make_response(std::to_string(conn->id()), "", responseid, PTYPE_TEXT);
                 }
@@ -188,7 +236,7 @@ namespace moon
         }
     }
 
-    uint32_t tcp::connect(const std::string & ip, const std::string & port)
+    uint32_t tcp::connect(const std::string & ip, const std::string & port, const std::string& path)
     {
         try
         {
@@ -196,9 +244,12 @@ namespace moon
             asio::ip::tcp::resolver::query query(ip, port);
             asio::ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
             auto conn = create_connection();
+            if (type_ == PTYPE_SOCKET_WS)
+            {
+                std::static_pointer_cast<ws_connection>(conn)->set_client_request(ip + ":" + port, path);
+            }
             asio::connect(conn->socket(), endpoint_iterator);
-            conn->set_id(make_connid());
-            conns_.emplace(conn->id(), conn);
+            add_connection(conn);
             conn->start(false);
             return conn->id();
         }
@@ -213,11 +264,11 @@ namespace moon
     {
         do
         {
-            auto iter = conns_.find(connid);
-            if (iter == conns_.end())
+            auto conn = find_connection(connid);
+            if (nullptr == conn)
                 break;
 
-            if (!iter->second->read(moon::read_request{ delim, n, responseid }))
+            if (!conn->read(moon::read_request{ delim, n, responseid }))
             {
                 break;
             }
@@ -228,25 +279,37 @@ namespace moon
         });
     }
 
+    //connections write frame headers into the head reserved space of data:
+    //a buffer also held by lua buffer handles, messages or other connections is copied
+    static buffer_ptr_t owned_buffer(const buffer_ptr_t & data)
+    {
+        if (nullptr == data || data.use_count() <= 1)
+        {
+            return data;
+        }
+        auto buf = message::create_buffer(data->size());
+        buf->write_back(data->data(), 0, data->size());
+        return buf;
+    }
+
     bool tcp::send(uint32_t connid, const buffer_ptr_t & data)
     {
-        auto iter = conns_.find(connid);
-        if (iter == conns_.end())
+        auto conn = find_connection(connid);
+        if (nullptr == conn)
         {
             return false;
         }
-        return iter->second->send(data);
+        return conn->send(owned_buffer(data));
     }
 
     bool tcp::send_then_close(uint32_t connid, const buffer_ptr_t & data)
     {
-        auto iter = conns_.find(connid);
-        if (iter == conns_.end())
+        auto conn = find_connection(connid);
+        if (nullptr == conn)
         {
             return false;
         }
-        data->set_flag(buffer_flag::close);
-        return iter->second->send(data);
+        return conn->send(owned_buffer(data), true);
     }
 
     bool tcp::send_message(uint32_t connid, message * msg)
@@ -256,13 +319,13 @@ namespace moon
 
     bool tcp::close(uint32_t connid)
     {
-        auto iter = conns_.find(connid);
-        if (iter == conns_.end())
+        auto conn = find_connection(connid);
+        if (nullptr == conn)
         {
             return false;
         }
-        iter->second->close();
-        conns_.erase(connid);
+        conn->close();
+        remove_connection(connid);
         return true;
     }
 
@@ -281,8 +344,12 @@ namespace moon
 
         for (auto& conn : conns_)
         {
-            conn.second->close(true);
+            if (nullptr != conn)
+            {
+                conn->close(true);
+            }
         }
+        idle_head_ = idle_tail_ = nullptr;
 
         if (checker_ != nullptr)
         {
@@ -304,10 +371,16 @@ namespace moon
             {
                 return;
             }
+            //only the expired connections at the head of idle list are touched
             auto now = std::time(nullptr);
-            for (auto& conn : conns_)
+            while (nullptr != idle_head_)
             {
-                conn.second->timeout_check(now, timeout_);
+                auto conn = idle_head_;
+                if (!conn->timeout_check(now, timeout_))
+                {
+                    break;
+                }
+                idle_unlink(conn);
             }
             check();
         });
@@ -318,17 +391,6 @@ namespace moon
         return *io_ctx_;
     }
 
-    uint32_t tcp::make_connid()
-    {
-        if (connuid_ == 0xFFFF)
-            connuid_ = 1;
-        auto id = connuid_++;
-        while (conns_.find(id) != conns_.end())
-        {
-            id = connuid_++;
-        }
-        return id;
-    }
     void tcp::make_response(string_view_t data, string_view_t header, int32_t responseid, uint8_t mtype)
     {
         if (0 == responseid)
@@ -370,6 +432,106 @@ namespace moon
         conn->set_enable_frame(frame_flag_);
         return conn;
     }
-}
 
+    base_connection* tcp::find_connection(uint32_t connid) const
+    {
+        uint32_t slot = connid & CONNID_SLOT_MASK;
+        if (slot >= conns_.size())
+        {
+            return nullptr;
+        }
+        auto& conn = conns_[slot];
+        if (nullptr == conn || conn->id() != connid)
+        {
+            return nullptr;
+        }
+        return conn.get();
+    }
+
+    void tcp::add_connection(const connection_ptr_t& conn)
+    {
+        uint32_t slot = 0;
+        if (!free_slots_.empty())
+        {
+            slot = free_slots_.back();
+            free_slots_.pop_back();
+        }
+        else
+        {
+            MOON_CHECK(conns_.size() <= CONNID_SLOT_MASK, "tcp connection slots exhausted");
+            slot = static_cast<uint32_t>(conns_.size());
+            conns_.emplace_back();
+        }
+
+        if (connseq_ > CONNID_SEQ_MAX)
+        {
+            connseq_ = 1;
+        }
+        conn->set_id((connseq_++ << CONNID_SLOT_BITS) | slot);
+        conns_[slot] = conn;
+        ++connnum_;
+    }
+
+    void tcp::remove_connection(uint32_t connid)
+    {
+        auto conn = find_connection(connid);
+        if (nullptr == conn)
+        {
+            return;
+        }
+        idle_unlink(conn);
+        uint32_t slot = connid & CONNID_SLOT_MASK;
+        conns_[slot].reset();
+        free_slots_.push_back(slot);
+        --connnum_;
+    }
+
+    void tcp::idle_touch(base_connection* conn)
+    {
+        if (0 == timeout_ || idle_tail_ == conn || find_connection(conn->id()) != conn)
+        {
+            return;
+        }
+        idle_unlink(conn);
+        conn->idle_prev_ = idle_tail_;
+        conn->idle_next_ = nullptr;
+        if (nullptr != idle_tail_)
+        {
+            idle_tail_->idle_next_ = conn;
+        }
+        else
+        {
+            idle_head_ = conn;
+        }
+        idle_tail_ = conn;
+    }
+
+    void tcp::idle_unlink(base_connection* conn)
+    {
+        if (nullptr == conn->idle_prev_ && idle_head_ != conn)
+        {
+            //not linked
+            return;
+        }
 
+        if (nullptr != conn->idle_prev_)
+        {
+            conn->idle_prev_->idle_next_ = conn->idle_next_;
+        }
+        else
+        {
+            idle_head_ = conn->idle_next_;
+        }
+
+        if (nullptr != conn->idle_next_)
+        {
+            conn->idle_next_->idle_prev_ = conn->idle_prev_;
+        }
+        else
+        {
+            idle_tail_ = conn->idle_prev_;
+        }
+        conn->idle_prev_ = nullptr;
+        conn->idle_next_ = nullptr;
+    }
+}
@@ -4,6 +4,9 @@
 #include "common/base64.hpp"
 #include "common/byte_convert.hpp"
 #include "common/sha1.hpp"
+#include <random>
+#include "ws_mask.hpp"
+#include "ws_deflate.hpp"
 
 namespace moon
 {
@@ -110,6 +113,12 @@ namespace moon
         static constexpr size_t PAYLOAD_MID_LEN = 126;
         static constexpr size_t PAYLOAD_MAX_LEN = 127;
 
+        //2 bytes header + 8 bytes extended payload length + 4 bytes masking key
+        static constexpr size_t MAX_FRAME_HEADER_LEN = 14;
+
+        //payload size limit of a message received in fragments
+        static constexpr size_t MAX_FRAGMENTED_LEN = 16 * 1024 * 1024;
+
         static constexpr const string_view_t WEBSOCKET = "websocket"sv;
         static constexpr const string_view_t UPGRADE = "upgrade"sv;
         static constexpr const string_view_t WS_MAGICKEY = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"sv;
@@ -122,20 +131,67 @@ namespace moon
         {
         }
 
+        //client mode: request line and Host header of the opening handshake, call before start(false)
+        void set_client_request(std::string host, std::string path)
+        {
+            request_host_ = std::move(host);
+            request_path_ = path.empty() ? std::string("/") : std::move(path);
+        }
+
+        /*
+            accepted: server mode, wait the opening handshake of client.
+            otherwise client mode, send the opening handshake, socket_connect message (and the response
+            of async_connect when responseid != 0) is sent after server's handshake response verified.
+        */
         void start(bool accepted, int32_t responseid = 0) override
         {
             base_connection_t::start(accepted, responseid);
             if (socket_.is_open())
             {
                 response_msg_ = message::create(1024);
+                if (!accepted)
+                {
+                    client_ = true;
+                    responseid_ = responseid;
+                    send_response(handshake_request());
+                }
                 read_header();
             }
         }
 
-        bool send(const buffer_ptr_t & data) override
+        bool send(const buffer_ptr_t & data, bool bclose = false) override
         {
-            encode_frame(data);
-            return base_connection_t::send(data);
+            if (data == nullptr || data->size() == 0)
+            {
+                return false;
+            }
+
+            if (client_)
+            {
+                return client_send(data, bclose);
+            }
+
+            if (nullptr != deflate_ && data->size() >= tcp_->ws_deflate().min_size)
+            {
+                auto buf = message::create_buffer(data->size() / 2 + 64, MAX_FRAME_HEADER_LEN);
+                if (!deflate_->compress(data->data(), data->size(), buf.get()))
+                {
+                    CONSOLE_WARN(logger(), "websocket permessage-deflate compress failed");
+                    return false;
+                }
+                encode_frame(buf, true);
+                return base_connection_t::send(buf, bclose);
+            }
+
+            if (!encode_frame(data))
+            {
+                //no enough head reserved space, copy once
+                auto buf = message::create_buffer(data->size() + MAX_FRAME_HEADER_LEN, MAX_FRAME_HEADER_LEN);
+                buf->write_back(data->data(), 0, data->size());
+                encode_frame(buf);
+                return base_connection_t::send(buf, bclose);
+            }
+            return base_connection_t::send(data, bclose);
         }
 
     protected:
@@ -148,6 +204,11 @@ namespace moon
             {
                 if (e)
                 {
+                    if (client_ && !handshaked_)
+                    {
+                        client_handshake_failed(moon::format("%s(%d)", e.message().data(), e.value()).data());
+                        return;
+                    }
                     error(e, int(logic_error_));
                     return;
                 }
@@ -158,10 +219,29 @@ namespace moon
                     return;
                 }
 
-                last_recv_time_ = std::time(nullptr);
+                update_recv_time();
 
                 size_t num_additional_bytes = sbuf->size() - bytes_transferred;
-                if (handshake(sbuf))
+                if (client_)
+                {
+                    if (!client_handshake(sbuf, bytes_transferred))
+                    {
+                        client_handshake_failed("websocket handshake failed");
+                        return;
+                    }
+                    num_additional_bytes = sbuf->size();
+                    if (num_additional_bytes > 0)
+                    {
+                        auto data = asio::buffer_cast<const char*>(sbuf->data());
+                        cache_.write_back(data, 0, num_additional_bytes);
+                        if (!handle_frame())
+                        {
+                            return;
+                        }
+                    }
+                    read_some();
+                }
+                else if (handshake(sbuf))
                 {
                     if (num_additional_bytes > 0)
                     {
@@ -200,7 +280,7 @@ namespace moon
                     return;
                 }
 
-                last_recv_time_ = std::time(nullptr);
+                update_recv_time();
                 cache_.write_back(buffer_.data(), 0, bytes_transferred);
 
                 if (!handle_frame())
@@ -249,7 +329,12 @@ namespace moon
                 return false;
 
             handshaked_ = true;
-            auto answer = upgrade_response(sec_ws_key_, request.header("Sec-WebSocket-Protocol"sv));
+            std::string extensions;
+            if (nullptr != tcp_ && tcp_->ws_deflate().enable)
+            {
+                extensions = negotiate_deflate(request.header("sec-websocket-extensions"sv));
+            }
+            auto answer = upgrade_response(sec_ws_key_, request.header("Sec-WebSocket-Protocol"sv), extensions);
             send_response(answer);
             auto msg = message::create();
             msg->write_string(remote_addr_);
@@ -258,25 +343,269 @@ namespace moon
             return true;
         }
 
+        std::string handshake_request()
+        {
+            uint8_t key[16];
+            std::random_device rd;
+            for (size_t i = 0; i < sizeof(key); i += sizeof(uint32_t))
+            {
+                uint32_t v = rd();
+                std::memcpy(key + i, &v, sizeof(v));
+            }
+            client_key_ = base64_encode(key, sizeof(key));
+
+            std::string request;
+            request.append("GET ");
+            request.append(request_path_.empty() ? std::string("/") : request_path_);
+            request.append(" HTTP/1.1\r\n");
+            request.append("Host: ");
+            request.append(request_host_.empty() ? remote_addr_ : request_host_);
+            request.append(STR_CRLF.data(), STR_CRLF.size());
+            request.append("Upgrade: websocket\r\n");
+            request.append("Connection: Upgrade\r\n");
+            request.append("Sec-WebSocket-Key: ");
+            request.append(client_key_);
+            request.append(STR_CRLF.data(), STR_CRLF.size());
+            request.append("Sec-WebSocket-Version: 13\r\n");
+            if (nullptr != tcp_ && tcp_->ws_deflate().enable)
+            {
+                const auto& opt = tcp_->ws_deflate();
+                request.append("Sec-WebSocket-Extensions: ");
+                request.append(ws::permessage_deflate::EXTENSION_NAME.data(), ws::permessage_deflate::EXTENSION_NAME.size());
+                if (opt.server_no_context_takeover)
+                {
+                    request.append("; server_no_context_takeover");
+                }
+                if (opt.client_no_context_takeover)
+                {
+                    request.append("; client_no_context_takeover");
+                }
+                if (opt.server_max_window_bits < 15)
+                {
+                    request.append("; server_max_window_bits=");
+                    request.append(std::to_string(std::clamp(opt.server_max_window_bits, 9, 15)));
+                }
+                request.append("; client_max_window_bits");
+                if (opt.client_max_window_bits < 15)
+                {
+                    request.append("=");
+                    request.append(std::to_string(std::clamp(opt.client_max_window_bits, 9, 15)));
+                }
+                request.append(STR_CRLF.data(), STR_CRLF.size());
+            }
+            request.append(STR_CRLF.data(), STR_CRLF.size());
+            return request;
+        }
+
+        //client mode: verify server's opening handshake response
+        bool client_handshake(const std::shared_ptr<asio::streambuf>& buf, size_t header_size)
+        {
+            if (handshaked_)
+            {
+                return false;
+            }
+
+            http::response_parser parser;
+            if (!parser.parse(string_view_t{ asio::buffer_cast<const char*>(buf->data()), header_size }))
+            {
+                return false;
+            }
+            buf->consume(header_size);
+
+            if (parser.status_code.substr(0, 3) != "101"sv)
+                return false;
+
+            if (!iequal_string(parser.header("upgrade"sv), WEBSOCKET))
+                return false;
+
+            if (!iequal_string(parser.header("connection"sv), UPGRADE))
+                return false;
+
+            if (parser.header("sec-websocket-accept"sv) != accept_key(client_key_))
+                return false;
+
+            auto extensions = parser.header("sec-websocket-extensions"sv);
+            if (!extensions.empty() && !accept_deflate(extensions))
+            {
+                return false;
+            }
+
+            handshaked_ = true;
+            for (auto& it : pending_)
+            {
+                client_send(it.first, it.second);
+            }
+            pending_.clear();
+
+            auto msg = message::create();
+            msg->write_string(remote_addr_);
+            msg->set_subtype(static_cast<uint8_t>(socket_data_type::socket_connect));
+            handle_message(std::move(msg));
+
+            if (0 != responseid_)
+            {
+                response(std::to_string(id_), "", responseid_, PTYPE_TEXT);
+                responseid_ = 0;
+            }
+            return true;
+        }
+
+        void client_handshake_failed(const char* reason)
+        {
+            pending_.clear();
+            if (0 != responseid_)
+            {
+                //async_connect caller never sees this connection
+                auto responseid = responseid_;
+                responseid_ = 0;
+                response("", moon::format("error websocket connect %s", reason), responseid, PTYPE_ERROR);
+                if (nullptr != tcp_)
+                {
+                    tcp_->close(id_);
+                }
+                return;
+            }
+            error(asio::error_code(), int(ws::close_code::protocol_error), reason);
+            base_connection_t::close();
+        }
+
+        //client mode: server's permessage-deflate response, must be a subset of the offer
+        bool accept_deflate(string_view_t extensions)
+        {
+            if (nullptr == tcp_ || !tcp_->ws_deflate().enable)
+            {
+                return false;
+            }
+
+            auto offers = ws::parse_extensions(extensions);
+            if (offers.size() != 1 || offers[0].name != ws::permessage_deflate::EXTENSION_NAME)
+            {
+                return false;
+            }
+
+            const auto& opt = tcp_->ws_deflate();
+            bool server_no_context_takeover = false;
+            bool client_no_context_takeover = opt.client_no_context_takeover;
+            int server_bits = 15;
+            int client_bits = std::clamp(opt.client_max_window_bits, 9, 15);
+            for (auto&[key, value] : offers[0].params)
+            {
+                if (key == "server_no_context_takeover"sv && value.empty())
+                {
+                    server_no_context_takeover = true;
+                }
+                else if (key == "client_no_context_takeover"sv && value.empty())
+                {
+                    client_no_context_takeover = true;
+                }
+                else if (key == "server_max_window_bits"sv)
+                {
+                    server_bits = ws::parse_window_bits(value);
+                    if (0 == server_bits)
+                    {
+                        return false;
+                    }
+                }
+                else if (key == "client_max_window_bits"sv)
+                {
+                    int bits = ws::parse_window_bits(value);
+                    //zlib can not deflate with window bits 8
+                    if (bits < 9)
+                    {
+                        return false;
+                    }
+                    client_bits = std::min(client_bits, bits);
+                }
+                else
+                {
+                    return false;
+                }
+            }
+
+            auto pmd = std::make_unique<ws::permessage_deflate>();
+            if (!pmd->init(opt.level, opt.mem_level
+                , client_bits, client_no_context_takeover
+                , server_bits, server_no_context_takeover
+                , opt.max_message_size))
+            {
+                return false;
+            }
+            deflate_ = std::move(pmd);
+            return true;
+        }
+
+        //client mode: frames are masked, so the payload is always copied
+        bool client_send(const buffer_ptr_t& data, bool bclose)
+        {
+            if (!handshaked_)
+            {
+                if (!socket_.is_open())
+                {
+                    return false;
+                }
+                pending_.emplace_back(data, bclose);
+                return true;
+            }
+
+            string_view_t payload{ data->data(), data->size() };
+            auto buf = message::create_buffer(payload.size() + MAX_FRAME_HEADER_LEN, MAX_FRAME_HEADER_LEN);
+            bool compressed = false;
+            if (nullptr != deflate_ && payload.size() >= tcp_->ws_deflate().min_size)
+            {
+                if (!deflate_->compress(payload.data(), payload.size(), buf.get()))
+                {
+                    CONSOLE_WARN(logger(), "websocket permessage-deflate compress failed");
+                    return false;
+                }
+                compressed = true;
+            }
+            else
+            {
+                buf->write_back(payload.data(), 0, payload.size());
+            }
+
+            uint32_t key = mask_key();
+            ws::mask(reinterpret_cast<uint8_t*>(buf->data()), buf->size(), key);
+            encode_frame(buf, compressed, &key);
+            return base_connection_t::send(buf, bclose);
+        }
+
+        uint32_t mask_key()
+        {
+            if (nullptr == mask_rng_)
+            {
+                std::random_device rd;
+                mask_rng_ = std::make_unique<std::mt19937>(rd());
+            }
+            return static_cast<uint32_t>((*mask_rng_)());
+        }
+
         void send_response(const std::string& s, bool bclose = false)
         {
             auto buf = message::create_buffer();
             buf->write_back(s.data(), 0, s.size());
-            if (bclose)
-            {
-                buf->set_flag(buffer_flag::close);
-            }
-            base_connection::send(buf);
+            base_connection::send(buf, bclose);
         }
 
         bool handle_frame()
         {
-            auto close_code = decode_frame();
-            if (ws::close_code::none != close_code)
+            //one read may contain several frames
+            while (cache_.size() != 0)
             {
-                error(asio::error_code(), int(close_code), std::string(cache_.data(), cache_.size()).data());
-                base_connection::close();
-                return false;
+                size_t before = cache_.size();
+                auto close_code = decode_frame();
+                if (ws::close_code::none != close_code)
+                {
+                    error(asio::error_code(), int(close_code), std::string(cache_.data(), cache_.size()).data());
+                    base_connection::close();
+                    return false;
+                }
+
+                if (before == cache_.size())
+                {
+                    //need more data
+                    break;
+                }
             }
             return true;
         }
@@ -286,7 +615,8 @@ namespace moon
             const uint8_t* tmp = (const uint8_t*)(cache_.data());
             size_t len = cache_.size();
 
-            if (len < 3)
+            //2 bytes: empty unmasked frame, e.g. close, ping or pong from server
+            if (len < 2)
             {
                 return ws::close_code::none;
             }
@@ -304,8 +634,8 @@ namespace moon
             }
 
             fh.mask = (tmp[1] & 0x80) != 0;
-            //server must masked.
-            if (!fh.mask)
+            //frames from client must be masked, frames from server must not.
+            if (fh.mask == client_)
             {
                 return ws::close_code::protocol_error;
             }
@@ -332,9 +662,14 @@ namespace moon
             case ws::opcode::text:
             case ws::opcode::binary:
             case ws::opcode::incomplete:
-                if (fh.rsv1 || fh.rsv2 || fh.rsv3)
+                if ((fh.rsv1 && (nullptr == deflate_ || fh.op == ws::opcode::incomplete)) || fh.rsv2 || fh.rsv3)
                 {
-                    // reserved bits not cleared
+                    // reserved bits not cleared, rsv1 is used by permessage-deflate, only in the first frame of a message
+                    return ws::close_code::protocol_error;
+                }
+                if ((fh.op == ws::opcode::incomplete) != (nullptr != fragment_))
+                {
+                    // continuation without a started message, or a new message before the last one finished
                     return ws::close_code::protocol_error;
                 }
                 break;
@@ -395,22 +730,35 @@ namespace moon
 
             if (fh.mask)
             {
-                fh.key = *((int32_t*)(tmp + (need - sizeof(fh.key))));
+                std::memcpy(&fh.key, tmp + (need - sizeof(fh.key)), sizeof(fh.key));
                 // unmask data:
-                uint8_t* d = (uint8_t*)(tmp + need);
-                for (uint64_t i = 0; i < fh.len; i++)
-                {
-                    d[i] = d[i] ^ ((uint8_t*)(&fh.key))[i % 4];
-                }
+                ws::mask((uint8_t*)(tmp + need), static_cast<size_t>(fh.len), fh.key);
             }
 
-            if (fh.op != ws::opcode::close &&  fh.fin)
+            const char* payload = (const char*)(tmp + need);
+            size_t payload_len = static_cast<size_t>(fh.len);
+            bool is_data = (fh.op == ws::opcode::text || fh.op == ws::opcode::binary || fh.op == ws::opcode::incomplete);
+            if (is_data && (!fh.fin || nullptr != fragment_))
             {
-                message_ptr_t msg = message::create(static_cast<size_t>(fh.len));
-                msg->get_buffer()->write_back((tmp + need), 0, static_cast<size_t>(fh.len));
+                //fragmented message: collect the payloads until fin, then handle as one frame
+                if (nullptr == fragment_)
+                {
+                    fragment_ = std::make_unique<buffer>(payload_len);
+                    fragment_compressed_ = fh.rsv1;
+                }
+                if (fragment_->size() + payload_len > MAX_FRAGMENTED_LEN)
+                {
+                    return ws::close_code::too_big;
+                }
+                fragment_->write_back(payload, 0, payload_len);
                 cache_.seek(int(need + fh.len), buffer::Current);
-                msg->set_subtype(static_cast<uint8_t>(socket_data_type::socket_recv));
-                handle_message(std::move(msg));
+                if (!fh.fin)
+                {
+                    return ws::close_code::none;
+                }
+                auto close_code = receive(fragment_->data(), fragment_->size(), fragment_compressed_);
+                fragment_.reset();
+                return close_code;
             }
 
             if (fh.op == ws::opcode::close)
@@ -420,37 +768,203 @@ namespace moon
                 return ws::close_code::normal;
             }
 
+            if (fh.op == ws::opcode::ping)
+            {
+                send_control(ws::opcode::pong, payload, payload_len);
+                cache_.seek(int(need + fh.len), buffer::Current);
+                return ws::close_code::none;
+            }
+
+            if (fh.op == ws::opcode::pong)
+            {
+                //keepalive only, receive time is updated by the read handler
+                cache_.seek(int(need + fh.len), buffer::Current);
+                return ws::close_code::none;
+            }
+
+            auto close_code = receive(payload, payload_len, fh.rsv1);
+            cache_.seek(int(need + fh.len), buffer::Current);
+            return close_code;
+        }
+
+        //one complete message, compressed: permessage-deflate payload
+        ws::close_code receive(const char* data, size_t size, bool compressed)
+        {
+            message_ptr_t msg;
+            if (compressed)
+            {
+                msg = message::create(size * 2);
+                if (!deflate_->decompress(data, size, msg->get_buffer()))
+                {
+                    return ws::close_code::too_big;
+                }
+            }
+            else
+            {
+                msg = message::create(size);
+                msg->get_buffer()->write_back(data, 0, size);
+            }
+            msg->set_subtype(static_cast<uint8_t>(socket_data_type::socket_recv));
+            handle_message(std::move(msg));
             return ws::close_code::none;
         }
 
-        void encode_frame(const buffer_ptr_t& data)
+        //control frame, payload at most 125 bytes. masked in client mode
+        void send_control(ws::opcode op, const char* data, size_t size)
+        {
+            auto buf = message::create_buffer(size + MAX_FRAME_HEADER_LEN, MAX_FRAME_HEADER_LEN);
+            buf->write_back(data, 0, size);
+            if (client_)
+            {
+                uint32_t key = mask_key();
+                ws::mask(reinterpret_cast<uint8_t*>(buf->data()), buf->size(), key);
+                encode_frame(buf, false, &key, op);
+            }
+            else
+            {
+                encode_frame(buf, false, nullptr, op);
+            }
+            base_connection_t::send(buf);
+        }
+
+        //write frame header into the head reserved space of data, payload is not copied.
+        //data is owned by this send, see tcp::send. key: masking key of client frame, the payload must be masked already.
+        bool encode_frame(const buffer_ptr_t& data, bool compressed = false, const uint32_t* key = nullptr, ws::opcode op = ws::opcode::text)
         {
+            uint8_t header[MAX_FRAME_HEADER_LEN];
+            size_t n = 0;
             uint64_t size = data->size();
-            uint8_t m = 0x81;
-            if (size <= 125)
+            header[n++] = static_cast<uint8_t>(0x80 | (compressed ? 0x40 : 0) | static_cast<uint8_t>(op));
+            const uint8_t maskbit = (nullptr != key) ? 0x80 : 0;
+            if (size <= PAYLOAD_MIN_LEN)
             {
-                data->write_front((uint8_t*)&size, 0, 1);
+                header[n++] = static_cast<uint8_t>(size) | maskbit;
             }
             else if (size <= UINT16_MAX)
             {
-                uint8_t tmp = 126;
-                uint16_t n = (uint16_t)size;
-                moon::host2net(n);
-                data->write_front((uint16_t*)&n, 0, 1);
-                data->write_front(&tmp, 0, 1);
+                header[n++] = PAYLOAD_MID_LEN | maskbit;
+                uint16_t len = static_cast<uint16_t>(size);
+                moon::host2net(len);
+                std::memcpy(header + n, &len, sizeof(len));
+                n += sizeof(len);
             }
             else
             {
-                uint8_t tmp = 127;
+                header[n++] = PAYLOAD_MAX_LEN | maskbit;
                 moon::host2net(size);
-                data->write_back(&size, 0, 1);
-                data->write_back(&tmp, 0, 1);
+                std::memcpy(header + n, &size, sizeof(size));
+                n += sizeof(size);
             }
 
-            data->write_front(&m, 0, 1);
+            if (nullptr != key)
+            {
+                std::memcpy(header + n, key, sizeof(*key));
+                n += sizeof(*key);
+            }
+
+            return data->write_front(header, 0, n);
+        }
+
+        //RFC 7692 server side negotiation, accept the first acceptable offer. return the response extension
+        std::string negotiate_deflate(string_view_t offers)
+        {
+            const auto& opt = tcp_->ws_deflate();
+            for (auto& offer : ws::parse_extensions(offers))
+            {
+                if (offer.name != ws::permessage_deflate::EXTENSION_NAME)
+                {
+                    continue;
+                }
+
+                bool valid = true;
+                bool server_no_context_takeover = opt.server_no_context_takeover;
+                bool client_no_context_takeover = opt.client_no_context_takeover;
+                bool server_bits_requested = false;
+                bool client_bits_allowed = false;
+                int server_bits = std::clamp(opt.server_max_window_bits, 9, 15);
+                int client_bits = 15;
+                for (auto&[key, value] : offer.params)
+                {
+                    if (key == "server_no_context_takeover"sv && value.empty())
+                    {
+                        server_no_context_takeover = true;
+                    }
+                    else if (key == "client_no_context_takeover"sv && value.empty())
+                    {
+                        client_no_context_takeover = true;
+                    }
+                    else if (key == "server_max_window_bits"sv)
+                    {
+                        int bits = ws::parse_window_bits(value);
+                        //zlib can not deflate with window bits 8, decline
+                        if (bits < 9)
+                        {
+                            valid = false;
+                            break;
+                        }
+                        server_bits_requested = true;
+                        server_bits = std::min(server_bits, bits);
+                    }
+                    else if (key == "client_max_window_bits"sv)
+                    {
+                        int bits = value.empty() ? 15 : ws::parse_window_bits(value);
+                        if (0 == bits)
+                        {
+                            valid = false;
+                            break;
+                        }
+                        client_bits_allowed = true;
+                        client_bits = std::min(std::clamp(opt.client_max_window_bits, 9, 15), bits);
+                    }
+                    else
+                    {
+                        valid = false;
+                        break;
+                    }
+                }
+
+                if (!valid)
+                {
+                    continue;
+                }
+
+                auto pmd = std::make_unique<ws::permessage_deflate>();
+                if (!pmd->init(opt.level, opt.mem_level
+                    , server_bits, server_no_context_takeover
+                    , client_bits, client_no_context_takeover
+                    , opt.max_message_size))
+                {
+                    CONSOLE_WARN(logger(), "websocket permessage-deflate init failed");
+                    return std::string{};
+                }
+                deflate_ = std::move(pmd);
+
+                std::string res{ ws::permessage_deflate::EXTENSION_NAME };
+                if (server_no_context_takeover)
+                {
+                    res.append("; server_no_context_takeover");
+                }
+                if (client_no_context_takeover)
+                {
+                    res.append("; client_no_context_takeover");
+                }
+                if (server_bits_requested || server_bits < 15)
+                {
+                    res.append("; server_max_window_bits=");
+                    res.append(std::to_string(server_bits));
+                }
+                if (client_bits_allowed && client_bits < 15)
+                {
+                    res.append("; client_max_window_bits=");
+                    res.append(std::to_string(client_bits));
+                }
+                return res;
+            }
+            return std::string{};
         }
 
-        std::string upgrade_response(string_view_t seckey, string_view_t wsprotocol)
+        //Sec-WebSocket-Accept of a Sec-WebSocket-Key
+        static std::string accept_key(string_view_t seckey)
         {
             uint8_t keybuf[60];
             std::memcpy(keybuf, seckey.data(), seckey.size());
@@ -461,7 +975,12 @@ namespace moon
             sha1::init(ctx);
             sha1::update(ctx, keybuf, sizeof(keybuf));
             sha1::finish(ctx, shakey);
-            std::string sha1str = base64_encode(shakey, sizeof(shakey));
+            return base64_encode(shakey, sizeof(shakey));
+        }
+
+        std::string upgrade_response(string_view_t seckey, string_view_t wsprotocol, string_view_t extensions)
+        {
+            std::string sha1str = accept_key(seckey);
 
             std::string response;
             response.append("HTTP/1.1 101 Switching Protocols\r\n");
@@ -469,18 +988,37 @@ namespace moon
             response.append("Connection: Upgrade\r\n");
             response.append("Sec-WebSocket-Accept: ");
             response.append(sha1str);
-            response.append(header_delim_);
+            response.append(STR_CRLF.data(), STR_CRLF.size());
             if (!wsprotocol.empty())
             {
                 response.append("Sec-WebSocket-Protocol: ");
                 response.append(wsprotocol.data(), wsprotocol.size());
-                response.append(header_delim_);
+                response.append(STR_CRLF.data(), STR_CRLF.size());
+            }
+            if (!extensions.empty())
+            {
+                response.append("Sec-WebSocket-Extensions: ");
+                response.append(extensions.data(), extensions.size());
+                response.append(STR_CRLF.data(), STR_CRLF.size());
             }
+            response.append(STR_CRLF.data(), STR_CRLF.size());
             return response;
         }
 
     protected:
         bool handshaked_ = false;
+        bool client_ = false;
+        int32_t responseid_ = 0;
+        bool fragment_compressed_ = false;
+        std::unique_ptr<ws::permessage_deflate> deflate_;
+        //payloads of a fragmented message received so far
+        std::unique_ptr<buffer> fragment_;
+        std::unique_ptr<std::mt19937> mask_rng_;
+        std::string request_host_;
+        std::string request_path_;
+        std::string client_key_;
+        //client sends before handshake finished, with close flag
+        std::vector<std::pair<buffer_ptr_t, bool>> pending_;
         const std::string header_delim_;
         message_ptr_t  response_msg_;
         std::array<uint8_t, 1024> buffer_;
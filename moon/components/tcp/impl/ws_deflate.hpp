@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include "config.h"
+#include "common/buffer.hpp"
+#include "common/string.hpp"
+
+#ifdef MOON_ENABLE_ZLIB
+#include "zlib.h"
+#endif
+
+namespace moon
+{
+    namespace ws
+    {
+        //one offer of Sec-WebSocket-Extensions, e.g. "permessage-deflate; client_max_window_bits"
+        struct extension_offer
+        {
+            string_view_t name;
+            std::vector<std::pair<string_view_t, string_view_t>> params;
+        };
+
+        inline std::vector<extension_offer> parse_extensions(string_view_t s)
+        {
+            std::vector<extension_offer> res;
+            for (auto& offer : moon::split<string_view_t>(s, ","))
+            {
+                auto items = moon::split<string_view_t>(offer, ";");
+                if (items.empty())
+                {
+                    continue;
+                }
+
+                extension_offer eo;
+                eo.name = moon::trim_surrounding(items[0]);
+                for (size_t i = 1; i < items.size(); ++i)
+                {
+                    auto item = moon::trim_surrounding(items[i]);
+                    auto pos = item.find('=');
+                    if (pos == string_view_t::npos)
+                    {
+                        eo.params.emplace_back(item, string_view_t{});
+                        continue;
+                    }
+                    auto value = moon::trim_surrounding(item.substr(pos + 1));
+                    if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                    {
+                        value = value.substr(1, value.size() - 2);
+                    }
+                    eo.params.emplace_back(moon::trim_surrounding(item.substr(0, pos)), value);
+                }
+                res.push_back(std::move(eo));
+            }
+            return res;
+        }
+
+        //window bits param of permessage-deflate, 8~15. return 0 if invalid
+        inline int parse_window_bits(string_view_t v)
+        {
+            if (v.empty() || v.size() > 2 || !std::all_of(v.begin(), v.end(), [](char c) { return c >= '0' && c <= '9'; }))
+            {
+                return 0;
+            }
+            int n = moon::string_convert<int32_t>(v);
+            return (n >= 8 && n <= 15) ? n : 0;
+        }
+
+        /*
+            RFC 7692 permessage-deflate compressor/decompressor of one connection.
+            zlib memory of one connection:
+                deflate (1 << (deflate_window_bits + 2)) + (1 << (mem_level + 9))
+                inflate (1 << inflate_window_bits) + about 7KB
+            max_message_size limits the inflated size of one message.
+        */
+        class permessage_deflate
+        {
+        public:
+            static constexpr string_view_t EXTENSION_NAME = "permessage-deflate"sv;
+
+            static constexpr bool supported()
+            {
+#ifdef MOON_ENABLE_ZLIB
+                return true;
+#else
+                return false;
+#endif
+            }
+
+            permessage_deflate() = default;
+
+            permessage_deflate(const permessage_deflate&) = delete;
+
+            permessage_deflate& operator=(const permessage_deflate&) = delete;
+
+            ~permessage_deflate()
+            {
+#ifdef MOON_ENABLE_ZLIB
+                if (deflate_init_)
+                {
+                    deflateEnd(&dstream_);
+                }
+                if (inflate_init_)
+                {
+                    inflateEnd(&istream_);
+                }
+#endif
+            }
+
+            bool init(int level, int mem_level
+                , int deflate_window_bits, bool deflate_no_context_takeover
+                , int inflate_window_bits, bool inflate_no_context_takeover
+                , size_t max_message_size)
+            {
+#ifdef MOON_ENABLE_ZLIB
+                deflate_no_context_takeover_ = deflate_no_context_takeover;
+                inflate_no_context_takeover_ = inflate_no_context_takeover;
+                max_message_size_ = max_message_size;
+
+                //zlib does not support deflate window bits 8
+                deflate_window_bits = std::clamp(deflate_window_bits, 9, 15);
+                inflate_window_bits = std::clamp(inflate_window_bits, 9, 15);
+
+                std::memset(&dstream_, 0, sizeof(dstream_));
+                if (Z_OK != deflateInit2(&dstream_, level, Z_DEFLATED, -deflate_window_bits, mem_level, Z_DEFAULT_STRATEGY))
+                {
+                    return false;
+                }
+                deflate_init_ = true;
+
+                std::memset(&istream_, 0, sizeof(istream_));
+                if (Z_OK != inflateInit2(&istream_, -inflate_window_bits))
+                {
+                    return false;
+                }
+                inflate_init_ = true;
+                return true;
+#else
+                (void)level;
+                (void)mem_level;
+                (void)deflate_window_bits;
+                (void)deflate_no_context_takeover;
+                (void)inflate_window_bits;
+                (void)inflate_no_context_takeover;
+                (void)max_message_size;
+                return false;
+#endif
+            }
+
+            //compress one message, append to out
+            bool compress(const char* data, size_t size, buffer* out)
+            {
+#ifdef MOON_ENABLE_ZLIB
+                dstream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+                dstream_.avail_in = static_cast<uInt>(size);
+                size_t chunk = deflateBound(&dstream_, static_cast<uLong>(size)) + 16;
+                do
+                {
+                    out->check_space(chunk);
+                    dstream_.next_out = reinterpret_cast<Bytef*>(std::addressof(*out->end()));
+                    dstream_.avail_out = static_cast<uInt>(chunk);
+                    int ret = deflate(&dstream_, Z_SYNC_FLUSH);
+                    if (ret != Z_OK && ret != Z_BUF_ERROR)
+                    {
+                        return false;
+                    }
+                    out->offset_writepos(static_cast<int>(chunk - dstream_.avail_out));
+                } while (dstream_.avail_out == 0);
+
+                //RFC 7692 7.2.1 remove the tail 0x00 0x00 0xff 0xff
+                if (out->size() >= 4 && std::memcmp(out->data() + out->size() - 4, TAIL, 4) == 0)
+                {
+                    out->offset_writepos(-4);
+                }
+
+                if (deflate_no_context_takeover_)
+                {
+                    deflateReset(&dstream_);
+                }
+                return true;
+#else
+                (void)data;
+                (void)size;
+                (void)out;
+                return false;
+#endif
+            }
+
+            //decompress one message, append to out. false: corrupt data or message too big
+            bool decompress(const char* data, size_t size, buffer* out)
+            {
+#ifdef MOON_ENABLE_ZLIB
+                size_t begin = out->size();
+                if (!inflate_some(reinterpret_cast<const Bytef*>(data), size, out, begin))
+                {
+                    return false;
+                }
+
+                if (!inflate_some(reinterpret_cast<const Bytef*>(TAIL), sizeof(TAIL), out, begin))
+                {
+                    return false;
+                }
+
+                if (inflate_no_context_takeover_)
+                {
+                    inflateReset(&istream_);
+                }
+                return true;
+#else
+                (void)data;
+                (void)size;
+                (void)out;
+                return false;
+#endif
+            }
+        private:
+#ifdef MOON_ENABLE_ZLIB
+            bool inflate_some(const Bytef* data, size_t size, buffer* out, size_t begin)
+            {
+                istream_.next_in = const_cast<Bytef*>(data);
+                istream_.avail_in = static_cast<uInt>(size);
+                do
+                {
+                    size_t chunk = std::max<size_t>(size * 2, 1024);
+                    out->check_space(chunk);
+                    istream_.next_out = reinterpret_cast<Bytef*>(std::addressof(*out->end()));
+                    istream_.avail_out = static_cast<uInt>(chunk);
+                    int ret = inflate(&istream_, Z_SYNC_FLUSH);
+                    if (ret != Z_OK && ret != Z_BUF_ERROR && ret != Z_STREAM_END)
+                    {
+                        return false;
+                    }
+                    out->offset_writepos(static_cast<int>(chunk - istream_.avail_out));
+                    if (out->size() - begin > max_message_size_)
+                    {
+                        return false;
+                    }
+
+                    if (ret == Z_STREAM_END)
+                    {
+                        //peer sent a final block, following data starts a new stream
+                        inflateReset(&istream_);
+                    }
+                    else if (ret == Z_BUF_ERROR && istream_.avail_out != 0)
+                    {
+                        //no progress possible
+                        break;
+                    }
+                } while (istream_.avail_in != 0 || istream_.avail_out == 0);
+                return true;
+            }
+
+            static constexpr char TAIL[4] = { 0x00, 0x00, static_cast<char>(0xFF), static_cast<char>(0xFF) };
+
+            bool deflate_init_ = false;
+            bool inflate_init_ = false;
+            z_stream dstream_;
+            z_stream istream_;
+#endif
+            bool deflate_no_context_takeover_ = false;
+            bool inflate_no_context_takeover_ = false;
+            size_t max_message_size_ = 0;
+        };
+    }
+}
@@ -25,6 +25,7 @@ namespace moon
         send_message_size_max = 2, // send message size too long
         timeout = 3, //socket read time out
         send_message_queue_size_max = 4, // send message queue size too long
+        protocol_error = 5, // malformed data of read delim RESP
     };
 
 	inline const char* logic_errmsg(int logic_errcode)
@@ -34,7 +35,8 @@ namespace moon
 			"read message size too long",
 			"send message size too long",
 			"timeout",
-            "send message queue size too long"
+            "send message queue size too long",
+            "protocol error"
 		};
         if (logic_errcode >= static_cast<int>(array_szie(errmsg)))
         {
@@ -49,6 +51,7 @@ namespace moon
         CRLF,//\r\n
         DCRLF,// \r\n\r\n
         LF,// \n
+        RESP,// complete redis replies, see common/resp.hpp
     };
 
     enum class frame_enable_flag :std::uint8_t
@@ -59,6 +62,20 @@ namespace moon
         both = 3,
     };
 
+    //websocket permessage-deflate(RFC 7692) options, see ws::permessage_deflate
+    struct ws_deflate_options
+    {
+        bool enable = false;
+        bool server_no_context_takeover = false;
+        bool client_no_context_takeover = false;
+        int server_max_window_bits = 15;// 9~15, compress window of server
+        int client_max_window_bits = 15;// 9~15, only used when client offers client_max_window_bits
+        int mem_level = 8;// 1~9
+        int level = 1;// zlib compress level
+        size_t min_size = 64;// send uncompressed when message size less than this
+        size_t max_message_size = 16 * 1024 * 1024;// inflated message size limit
+    };
+
 	class base_connection;
 
     class tcp:public component
@@ -80,13 +97,18 @@ namespace moon
 
         void set_enable_frame(std::string flag);
 
+        void set_ws_deflate(const ws_deflate_options& opt);
+
+        const ws_deflate_options& ws_deflate() const;
+
         bool listen(const std::string& ip, const std::string& port);
 
         void async_accept(int32_t responseid);
 
-        void async_connect(const std::string & ip, const std::string & port,int32_t responseid);
+        //path: request path of websocket client opening handshake, ignored by other protocols
+        void async_connect(const std::string & ip, const std::string & port,int32_t responseid, const std::string& path = "/");
 
-        uint32_t connect(const std::string & ip, const std::string & port);
+        uint32_t connect(const std::string & ip, const std::string & port, const std::string& path = "/");
 
         void read(uint32_t connid,size_t n, read_delim delim,int32_t responseid);
 
@@ -110,22 +132,42 @@ namespace moon
 
 		asio::io_context& io_context();
 
-		uint32_t make_connid();
-
 		void make_response(string_view_t data, string_view_t header, int32_t responseid, uint8_t mtype);
 
 		connection_ptr_t create_connection();
+
+        //connection id: low CONNID_SLOT_BITS is the index of conns_, high bits is a sequence number,
+        //so a stale id never hits a reused slot.
+        base_connection* find_connection(uint32_t connid) const;
+
+        void add_connection(const connection_ptr_t& conn);
+
+        void remove_connection(uint32_t connid);
+
+        //idle list: connections ordered by last recv time, the head is the oldest one.
+        void idle_touch(base_connection* conn);
+
+        void idle_unlink(base_connection* conn);
     private:
+        static constexpr uint32_t CONNID_SLOT_BITS = 20;
+        static constexpr uint32_t CONNID_SLOT_MASK = (1 << CONNID_SLOT_BITS) - 1;
+        static constexpr uint32_t CONNID_SEQ_MAX = (0xFFFFFFFF >> CONNID_SLOT_BITS);
+
         uint8_t type_;
         frame_enable_flag frame_flag_;
-		uint32_t connuid_;
+		uint32_t connseq_;
 		uint32_t timeout_;
+        size_t connnum_;
         asio::io_context* io_ctx_;
 		service* parent_;
+        base_connection* idle_head_;
+        base_connection* idle_tail_;
 		std::unique_ptr<asio::ip::tcp::acceptor> acceptor_;
 		std::unique_ptr<asio::steady_timer> checker_;
 		message_ptr_t  response_msg_;
-		std::unordered_map<uint32_t, connection_ptr_t> conns_;
+        ws_deflate_options ws_deflate_;
+		std::vector<connection_ptr_t> conns_;
+        std::vector<uint32_t> free_slots_;
     };
 
     template<typename TMsg>
@@ -150,7 +192,7 @@ namespace moon
         parent_->handle_message(std::forward<TMsg>(msg));
         if (t == PTYPE_ERROR || st == static_cast<uint8_t>(socket_data_type::socket_close))
         {
-            conns_.erase(sender);
+            remove_connection(sender);
         }
     }
 }
@@ -0,0 +1,1213 @@
+#include "cluster.h"
+#include "common/byte_convert.hpp"
+#include "common/string.hpp"
+#include "common/log.hpp"
+#include "common/file.hpp"
+#include "rapidjson/document.h"
+#include "rapidjson/error/en.h"
+#include "message.hpp"
+#include "router.h"
+
+namespace moon
+{
+    template<typename T>
+    static char* write_net(char* p, T v)
+    {
+        host2net(v);
+        memcpy(p, &v, sizeof(T));
+        return p + sizeof(T);
+    }
+
+    template<typename T>
+    static const char* read_net(const char* p, T& v)
+    {
+        memcpy(&v, p, sizeof(T));
+        net2host(v);
+        return p + sizeof(T);
+    }
+
+    //one tcp connection between two nodes. outgoing: created by this node to call node(), incoming: accepted
+    class cluster::link :public std::enable_shared_from_this<cluster::link>
+    {
+    public:
+        static constexpr size_t READ_BUFFER_SIZE = 64 * 1024;
+
+        link(cluster* c, uint32_t id, const std::string& node)
+            :connected_(false)
+            , sending_(false)
+            , closed_(false)
+            , draining_(false)
+            , timer_armed_(false)
+            , id_(id)
+            , unanswered_(0)
+            , tokens_(0)
+            , queued_calls_(0)
+            , queued_(0)
+            , rpos_(0)
+            , wpos_(0)
+            , owner_(c)
+            , node_(node)
+            , socket_(c->io_ctx_)
+            , timer_(c->io_ctx_)
+            , rbuf_(READ_BUFFER_SIZE)
+        {
+        }
+
+        link(const link&) = delete;
+
+        link& operator=(const link&) = delete;
+
+        uint32_t id() const
+        {
+            return id_;
+        }
+
+        const std::string& node() const
+        {
+            return node_;
+        }
+
+        asio::ip::tcp::socket& socket()
+        {
+            return socket_;
+        }
+
+        bool closed() const
+        {
+            return closed_;
+        }
+
+        //outgoing link of a departed node
+        bool draining() const
+        {
+            return draining_;
+        }
+
+        void set_draining()
+        {
+            draining_ = true;
+        }
+
+        //no call waiting response and nothing to write
+        bool idle() const
+        {
+            return inflight_.empty() && 0 == queued_ && !sending_;
+        }
+
+        //outgoing calls waiting response, key: sender << 32 | session
+        std::unordered_map<uint64_t, call_state>& inflight()
+        {
+            return inflight_;
+        }
+
+        //incoming requests waiting response of local service
+        uint32_t& unanswered()
+        {
+            return unanswered_;
+        }
+
+        //first token slot of the incoming requests, linked by pending::next
+        uint32_t& tokens()
+        {
+            return tokens_;
+        }
+
+        void start()
+        {
+            connected_ = true;
+            asio::error_code ec;
+            socket_.set_option(asio::ip::tcp::no_delay(true), ec);
+            read();
+            flush();
+        }
+
+        //queue a frame, written by flush. false: frame too large
+        bool push(uint8_t kind, uint8_t type, uint32_t serviceid, int32_t session, const string_view_t& name, const buffer_ptr_t& data, uint32_t timeout = 0)
+        {
+            size_t datasize = data ? data->size() : 0;
+            size_t size = FRAME_HEAD_SIZE - sizeof(uint32_t) + name.size() + datasize;
+            if (size > MAX_FRAME_SIZE || name.size() > std::numeric_limits<uint16_t>::max())
+            {
+                return false;
+            }
+
+            char head[FRAME_HEAD_SIZE];
+            char* p = write_net(head, static_cast<uint32_t>(size));
+            p = write_net(p, kind);
+            p = write_net(p, type);
+            p = write_net(p, static_cast<uint16_t>(name.size()));
+            p = write_net(p, serviceid);
+            p = write_net(p, session);
+            write_net(p, timeout);
+            wbuf_.append(head, FRAME_HEAD_SIZE);
+            wbuf_.append(name.data(), name.size());
+            if (datasize <= COPY_PAYLOAD_SIZE)
+            {
+                if (datasize != 0)
+                {
+                    wbuf_.append(data->data(), datasize);
+                }
+            }
+            else
+            {
+                refs_.emplace_back(wbuf_.size(), data);
+            }
+            queued_ += sizeof(uint32_t) + size;
+            if (kind == FRAME_REQUEST && session != 0)
+            {
+                ++queued_calls_;
+            }
+            return true;
+        }
+
+        //write queued frames now, or wait for more while other calls of the link are outstanding:
+        //at most one write each flush_delay, a link idle for flush_delay writes at once
+        void flush()
+        {
+            if (!connected_ || sending_ || closed_ || 0 == queued_)
+            {
+                return;
+            }
+
+            auto deadline = last_write_ + std::chrono::microseconds(owner_->flush_delay_);
+            if (queued_ >= owner_->flush_size_ || !outstanding() || deadline <= std::chrono::steady_clock::now())
+            {
+                write();
+                return;
+            }
+
+            if (!timer_armed_)
+            {
+                timer_armed_ = true;
+                timer_.expires_at(deadline);
+                timer_.async_wait([this, self = shared_from_this()](const asio::error_code&)
+                {
+                    timer_armed_ = false;
+                    write();
+                });
+            }
+        }
+
+        void close()
+        {
+            closed_ = true;
+            asio::error_code ignore_ec;
+            timer_.cancel(ignore_ec);
+            if (socket_.is_open())
+            {
+                socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignore_ec);
+                socket_.close(ignore_ec);
+            }
+        }
+    private:
+        //calls sent and waiting response, or requests received and not answered
+        bool outstanding() const
+        {
+            return inflight_.size() > queued_calls_ || unanswered_ != 0;
+        }
+
+        //all queued frames with one gather write, small payloads are already in wbuf_
+        void write()
+        {
+            if (!connected_ || sending_ || closed_ || 0 == queued_)
+            {
+                return;
+            }
+
+            last_write_ = std::chrono::steady_clock::now();
+            writing_buf_.swap(wbuf_);
+            writing_refs_.swap(refs_);
+            queued_ = 0;
+            queued_calls_ = 0;
+            wbufs_.clear();
+            size_t pos = 0;
+            for (auto& r : writing_refs_)
+            {
+                wbufs_.emplace_back(writing_buf_.data() + pos, r.first - pos);
+                wbufs_.emplace_back(r.second->data(), r.second->size());
+                pos = r.first;
+            }
+            if (pos < writing_buf_.size())
+            {
+                wbufs_.emplace_back(writing_buf_.data() + pos, writing_buf_.size() - pos);
+            }
+
+            sending_ = true;
+            asio::async_write(socket_, wbufs_, [this, self = shared_from_this()](const asio::error_code& e, std::size_t)
+            {
+                sending_ = false;
+                writing_buf_.clear();
+                writing_refs_.clear();
+                if (e)
+                {
+                    owner_->close_link(self, e.message());
+                    return;
+                }
+                flush();
+            });
+        }
+
+        void read()
+        {
+            socket_.async_read_some(asio::buffer(rbuf_.data() + wpos_, rbuf_.size() - wpos_),
+                [this, self = shared_from_this()](const asio::error_code& e, std::size_t n)
+            {
+                if (closed_)
+                {
+                    return;
+                }
+
+                if (e)
+                {
+                    owner_->close_link(self, (e == asio::error::eof) ? "closed by peer" : e.message());
+                    return;
+                }
+
+                wpos_ += n;
+                if (parse())
+                {
+                    read();
+                }
+            });
+        }
+
+        //handle complete frames, keep room for the next one
+        bool parse()
+        {
+            auto self = shared_from_this();
+            while (wpos_ - rpos_ >= sizeof(uint32_t))
+            {
+                uint32_t size = 0;
+                read_net(rbuf_.data() + rpos_, size);
+                if (size < FRAME_HEAD_SIZE - sizeof(uint32_t) || size > MAX_FRAME_SIZE)
+                {
+                    owner_->close_link(self, "invalid frame size");
+                    return false;
+                }
+
+                size_t total = sizeof(uint32_t) + size;
+                if (wpos_ - rpos_ < total)
+                {
+                    if (rbuf_.size() - rpos_ < total)
+                    {
+                        compact();
+                        if (rbuf_.size() < total)
+                        {
+                            rbuf_.resize(total);
+                        }
+                    }
+                    return true;
+                }
+
+                owner_->on_frame(self, rbuf_.data() + rpos_ + sizeof(uint32_t), size);
+                if (closed_)
+                {
+                    return false;
+                }
+                rpos_ += total;
+            }
+
+            if (rpos_ == wpos_)
+            {
+                rpos_ = wpos_ = 0;
+                if (rbuf_.size() > READ_BUFFER_SIZE)
+                {
+                    std::vector<char>(READ_BUFFER_SIZE).swap(rbuf_);
+                }
+            }
+            else if (wpos_ == rbuf_.size())
+            {
+                compact();
+            }
+            return true;
+        }
+
+        void compact()
+        {
+            size_t n = wpos_ - rpos_;
+            if (rpos_ != 0 && n != 0)
+            {
+                memmove(rbuf_.data(), rbuf_.data() + rpos_, n);
+            }
+            rpos_ = 0;
+            wpos_ = n;
+        }
+    private:
+        bool connected_;
+        bool sending_;
+        bool closed_;
+        bool draining_;
+        bool timer_armed_;
+        uint32_t id_;
+        uint32_t unanswered_;
+        uint32_t tokens_;
+        //requests with session in wbuf_, inflight but not sent
+        size_t queued_calls_;
+        //bytes of queued frames
+        size_t queued_;
+        size_t rpos_;
+        size_t wpos_;
+        cluster* owner_;
+        std::string node_;
+        asio::ip::tcp::socket socket_;
+        asio::steady_timer timer_;
+        std::chrono::steady_clock::time_point last_write_;
+        std::vector<char> rbuf_;
+        //queued frames, refs_: (offset in wbuf_, large payload written there)
+        std::string wbuf_;
+        std::vector<std::pair<size_t, buffer_ptr_t>> refs_;
+        std::string writing_buf_;
+        std::vector<std::pair<size_t, buffer_ptr_t>> writing_refs_;
+        std::vector<asio::const_buffer> wbufs_;
+        std::unordered_map<uint64_t, call_state> inflight_;
+    };
+
+    cluster::cluster(router* r, log* logger)
+        :started_(false)
+        , linkuid_(0)
+        , flush_size_(DEFAULT_FLUSH_SIZE)
+        , flush_delay_(DEFAULT_FLUSH_DELAY)
+        , router_(r)
+        , logger_(logger)
+        , io_ctx_(1)
+        , work_(asio::make_work_guard(io_ctx_))
+        , drain_timer_(io_ctx_)
+        , registry_interval_(DEFAULT_REGISTRY_INTERVAL)
+        , registry_timer_(io_ctx_)
+        , call_timeout_(0)
+        , deadline_armed_(time_point::max())
+        , deadline_timer_(io_ctx_)
+    {
+    }
+
+    cluster::~cluster()
+    {
+        stop();
+    }
+
+    bool cluster::start(const std::string& name, const std::string& host, const std::string& port)
+    {
+        if (started_.load())
+        {
+            return false;
+        }
+
+        try
+        {
+            acceptor_ = std::make_unique<asio::ip::tcp::acceptor>(io_ctx_);
+            asio::ip::tcp::resolver resolver(io_ctx_);
+            asio::ip::tcp::resolver::query query(host, port);
+            asio::ip::tcp::endpoint endpoint = *resolver.resolve(query);
+            acceptor_->open(endpoint.protocol());
+#if TARGET_PLATFORM != PLATFORM_WINDOWS
+            acceptor_->set_option(asio::ip::tcp::acceptor::reuse_address(true));
+#endif
+            acceptor_->bind(endpoint);
+            acceptor_->listen(std::numeric_limits<int>::max());
+        }
+        catch (asio::system_error& e)
+        {
+            CONSOLE_ERROR(logger_, "cluster listen %s:%s %s(%d)", host.data(), port.data(), e.what(), e.code().value());
+            return false;
+        }
+
+        name_ = name;
+        accept();
+        if (!registry_.empty())
+        {
+            //after nodes of config file
+            post([this]() {
+                load_registry();
+                check_registry();
+            });
+        }
+        thread_ = std::thread([this]() {
+            CONSOLE_INFO(logger_, "CLUSTER %s START", name_.data());
+            io_ctx_.run();
+            CONSOLE_INFO(logger_, "CLUSTER %s STOP", name_.data());
+        });
+        started_.store(true);
+        return true;
+    }
+
+    void cluster::stop()
+    {
+        if (!started_.exchange(false))
+        {
+            return;
+        }
+
+        post([this]() {
+            asio::error_code ignore_ec;
+            acceptor_->close(ignore_ec);
+            registry_timer_.cancel(ignore_ec);
+            deadline_timer_.cancel(ignore_ec);
+            drain_timer_.cancel(ignore_ec);
+            draining_.clear();
+            auto links = links_;
+            for (auto& it : links)
+            {
+                close_link(it.second, "cluster stop");
+            }
+        });
+        //run until all pending handlers are done
+        work_.reset();
+        if (thread_.joinable())
+        {
+            thread_.join();
+        }
+    }
+
+    bool cluster::started() const
+    {
+        return started_.load();
+    }
+
+    void cluster::set_flush(size_t size, int64_t delay)
+    {
+        flush_size_ = size;
+        flush_delay_ = delay;
+    }
+
+    void cluster::watch_registry(const std::string& path, int64_t interval)
+    {
+        registry_ = path;
+        registry_interval_ = interval;
+    }
+
+    void cluster::add_node(const std::string& name, const std::string& host, const std::string& port)
+    {
+        post([this, name, host, port]() {
+            set_node(name, node_address{ host, port });
+        });
+    }
+
+    void cluster::remove_node(const std::string& name)
+    {
+        post([this, name]() {
+            erase_node(name);
+        });
+    }
+
+    void cluster::set_call_timeout(int64_t timeout)
+    {
+        call_timeout_ = timeout;
+    }
+
+    void cluster::send(uint32_t sender, const string_view_t& node, const string_view_t& service, const buffer_ptr_t& data, int32_t session, uint8_t type, int64_t timeout)
+    {
+        request req;
+        req.sender = sender;
+        req.session = session;
+        req.type = type;
+        req.timeout = timeout;
+        req.node.assign(node.data(), node.size());
+        req.service.assign(service.data(), service.size());
+        req.data = data;
+        if (requests_.push_back(std::move(req)) == 1)
+        {
+            post([this]() {
+                swap_requests_.clear();
+                requests_.swap(swap_requests_);
+                for (auto& r : swap_requests_)
+                {
+                    handle_request(r);
+                }
+                for (auto& it : outgoing_)
+                {
+                    it.second->flush();
+                }
+            });
+        }
+    }
+
+    void cluster::response(message_ptr_t&& msg)
+    {
+        if (responses_.push_back(std::move(msg)) == 1)
+        {
+            post([this]() {
+                swap_responses_.clear();
+                responses_.swap(swap_responses_);
+                for (auto& m : swap_responses_)
+                {
+                    handle_response(m);
+                }
+                for (auto& it : links_)
+                {
+                    it.second->flush();
+                }
+            });
+        }
+    }
+
+    void cluster::runcmd(uint32_t sender, const std::string& cmd, int32_t responseid)
+    {
+        post([this, sender, cmd, responseid]() {
+            auto params = moon::split<std::string>(cmd, ".");
+            if (params.size() < 3 || params[2] != "stats")
+            {
+                router_->make_response(sender, "cluster::runcmd "sv, moon::format("invalid cmd: %s.", cmd.data()), responseid, PTYPE_ERROR);
+                return;
+            }
+
+            std::unordered_map<std::string, size_t> inflight;
+            for (auto& it : outgoing_)
+            {
+                inflight[it.first] = it.second->inflight().size();
+            }
+
+            std::string content;
+            content.append("{");
+            for (auto& it : stats_)
+            {
+                if (params[1] != "*" && params[1] != it.first)
+                {
+                    continue;
+                }
+                auto& st = it.second;
+                if (content.size() > 1)
+                {
+                    content.append(",");
+                }
+                //latency microseconds
+                content.append(moon::format(R"("%s":{"calls":%llu,"responses":%llu,"timeouts":%llu,"failures":%llu,"inflight":%zu,"latency_avg":%llu,"latency_max":%llu})"
+                    , it.first.data()
+                    , static_cast<unsigned long long>(st.calls)
+                    , static_cast<unsigned long long>(st.responses)
+                    , static_cast<unsigned long long>(st.timeouts)
+                    , static_cast<unsigned long long>(st.failures)
+                    , inflight[it.first]
+                    , static_cast<unsigned long long>((st.responses != 0) ? st.latency_sum / st.responses : 0)
+                    , static_cast<unsigned long long>(st.latency_max)));
+            }
+            content.append("}");
+            router_->make_response(sender, ""sv, content, responseid);
+        });
+    }
+
+    void cluster::accept()
+    {
+        auto l = std::make_shared<link>(this, ++linkuid_, std::string{});
+        acceptor_->async_accept(l->socket(), [this, l](const asio::error_code& e)
+        {
+            if (e)
+            {
+                if (e != asio::error::operation_aborted)
+                {
+                    CONSOLE_WARN(logger_, "cluster accept error %s(%d)", e.message().data(), e.value());
+                    accept();
+                }
+                return;
+            }
+            links_.emplace(l->id(), l);
+            l->start();
+            accept();
+        });
+    }
+
+    void cluster::set_node(const std::string& name, const node_address& addr)
+    {
+        auto iter = nodes_.find(name);
+        if (iter != nodes_.end())
+        {
+            if (iter->second == addr)
+            {
+                return;
+            }
+            //calls already sent finish on the old connection
+            drain(name);
+        }
+        nodes_[name] = addr;
+        if (started_.load())
+        {
+            CONSOLE_INFO(logger_, "cluster node %s join %s:%s", name.data(), addr.host.data(), addr.port.data());
+        }
+    }
+
+    void cluster::erase_node(const std::string& name)
+    {
+        if (nodes_.erase(name) == 0)
+        {
+            return;
+        }
+        drain(name);
+        CONSOLE_INFO(logger_, "cluster node %s leave", name.data());
+    }
+
+    void cluster::drain(const std::string& node)
+    {
+        auto iter = outgoing_.find(node);
+        if (iter == outgoing_.end())
+        {
+            return;
+        }
+        auto l = iter->second;
+        outgoing_.erase(iter);
+        l->set_draining();
+        if (l->idle())
+        {
+            close_link(l, "node leave");
+            return;
+        }
+
+        draining_.emplace_back(l, std::chrono::steady_clock::now() + std::chrono::milliseconds(DRAIN_TIMEOUT));
+        if (draining_.size() == 1)
+        {
+            check_drain();
+        }
+    }
+
+    void cluster::check_drain()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (auto iter = draining_.begin(); iter != draining_.end();)
+        {
+            auto& l = iter->first;
+            if (l->closed() || l->idle() || iter->second <= now)
+            {
+                //calls not responded in time get error
+                close_link(l, "node leave");
+                iter = draining_.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+
+        if (draining_.empty())
+        {
+            return;
+        }
+
+        drain_timer_.expires_after(std::chrono::milliseconds(DRAIN_CHECK_INTERVAL));
+        drain_timer_.async_wait([this](const asio::error_code& e) {
+            if (!e)
+            {
+                check_drain();
+            }
+        });
+    }
+
+    void cluster::load_registry()
+    {
+        auto content = moon::file::read_all(registry_);
+        if (content.empty() || content == registry_content_)
+        {
+            //a missing file keeps the nodes: may be replaced by an editor
+            return;
+        }
+        registry_content_ = content;
+
+        rapidjson::Document doc;
+        doc.Parse(content.data(), content.size());
+        if (doc.HasParseError() || !doc.IsArray())
+        {
+            CONSOLE_ERROR(logger_, "cluster registry %s format error: %s", registry_.data()
+                , doc.HasParseError() ? rapidjson::GetParseError_En(doc.GetParseError()) : "must be array");
+            return;
+        }
+
+        std::unordered_map<std::string, node_address> nodes;
+        for (auto& v : doc.GetArray())
+        {
+            if (!v.IsObject() || !v.HasMember("name") || !v["name"].IsString() || !v.HasMember("port") || !v["port"].IsString())
+            {
+                CONSOLE_ERROR(logger_, "cluster registry %s format error: node must have name and port", registry_.data());
+                return;
+            }
+            node_address addr;
+            addr.host = (v.HasMember("host") && v["host"].IsString()) ? v["host"].GetString() : "127.0.0.1";
+            addr.port = v["port"].GetString();
+            nodes.emplace(v["name"].GetString(), std::move(addr));
+        }
+
+        //only nodes from registry leave, nodes of config file stay
+        for (auto iter = registry_nodes_.begin(); iter != registry_nodes_.end();)
+        {
+            if (nodes.find(*iter) == nodes.end())
+            {
+                erase_node(*iter);
+                iter = registry_nodes_.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+
+        for (auto& it : nodes)
+        {
+            set_node(it.first, it.second);
+            registry_nodes_.emplace(it.first);
+        }
+    }
+
+    void cluster::check_registry()
+    {
+        registry_timer_.expires_after(std::chrono::milliseconds(registry_interval_));
+        registry_timer_.async_wait([this](const asio::error_code& e) {
+            if (e)
+            {
+                return;
+            }
+            load_registry();
+            check_registry();
+        });
+    }
+
+    cluster::link_ptr_t cluster::get_link(const std::string& node)
+    {
+        if (auto iter = outgoing_.find(node); iter != outgoing_.end())
+        {
+            return iter->second;
+        }
+
+        auto iter = nodes_.find(node);
+        if (iter == nodes_.end())
+        {
+            return nullptr;
+        }
+
+        auto l = std::make_shared<link>(this, ++linkuid_, node);
+        outgoing_.emplace(node, l);
+        links_.emplace(l->id(), l);
+        connect(l, iter->second);
+        return l;
+    }
+
+    void cluster::connect(const link_ptr_t& l, const node_address& addr)
+    {
+        try
+        {
+            asio::ip::tcp::resolver resolver(io_ctx_);
+            asio::ip::tcp::resolver::query query(addr.host, addr.port);
+            asio::ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
+            asio::async_connect(l->socket(), endpoint_iterator, [this, l](const asio::error_code& e, asio::ip::tcp::resolver::iterator)
+            {
+                if (l->closed())
+                {
+                    return;
+                }
+
+                if (e)
+                {
+                    close_link(l, moon::format("connect node %s failed: %s", l->node().data(), e.message().data()));
+                    return;
+                }
+                l->start();
+            });
+        }
+        catch (const asio::system_error& e)
+        {
+            auto reason = moon::format("connect node %s failed: %s", l->node().data(), e.what());
+            post([this, l, reason]() {
+                close_link(l, reason);
+            });
+        }
+    }
+
+    void cluster::close_link(const link_ptr_t& l, const string_view_t& reason)
+    {
+        if (l->closed())
+        {
+            return;
+        }
+        l->close();
+
+        links_.erase(l->id());
+        if (!l->node().empty() && !l->draining() && started_.load())
+        {
+            if (auto iter = outgoing_.find(l->node()); iter != outgoing_.end() && iter->second == l)
+            {
+                outgoing_.erase(iter);
+            }
+            CONSOLE_WARN(logger_, "cluster link to %s closed: %s", l->node().data(), std::string{ reason }.data());
+        }
+
+        //nobody waits the responses of requests received from this link
+        if (l->unanswered() != 0)
+        {
+            release_tokens(*l);
+            l->unanswered() = 0;
+        }
+
+        //only calls of this link, deadline entries of them are dropped when expired
+        auto& inflight = l->inflight();
+        if (!inflight.empty())
+        {
+            stats_[l->node()].failures += inflight.size();
+            auto content = moon::format("link to %s closed: %s", l->node().data(), std::string{ reason }.data());
+            for (auto& it : inflight)
+            {
+                fail_call(static_cast<uint32_t>(it.first >> 32), static_cast<int32_t>(it.first & 0xFFFFFFFF), content);
+            }
+            inflight.clear();
+        }
+    }
+
+    void cluster::handle_request(request& req)
+    {
+        auto l = get_link(req.node);
+        if (nullptr == l)
+        {
+            fail_call(req.sender, req.session, moon::format("send to unknown node %s", req.node.data()));
+            return;
+        }
+
+        int64_t timeout = (req.timeout > 0) ? req.timeout : call_timeout_;
+        timeout = std::min<int64_t>(std::max<int64_t>(timeout, 0), std::numeric_limits<uint32_t>::max());
+        //the receiver node releases the request when the caller gives up
+        if (!l->push(FRAME_REQUEST, req.type, req.sender, req.session, req.service, req.data, (req.session != 0) ? static_cast<uint32_t>(timeout) : 0))
+        {
+            fail_call(req.sender, req.session, "send message too large");
+            return;
+        }
+
+        if (req.session != 0)
+        {
+            auto key = (static_cast<uint64_t>(req.sender) << 32) | static_cast<uint32_t>(req.session);
+            auto now = std::chrono::steady_clock::now();
+            auto expire = (timeout > 0) ? now + std::chrono::milliseconds(timeout) : time_point::max();
+            l->inflight()[key] = call_state{ now, expire };
+            ++stats_[req.node].calls;
+            if (timeout > 0)
+            {
+                add_deadline(l->id(), key, expire);
+            }
+        }
+    }
+
+    void cluster::handle_response(message_ptr_t& msg)
+    {
+        pending p;
+        if (!take_token(msg->responseid(), p))
+        {
+            return;
+        }
+
+        auto iter = links_.find(p.linkid);
+        if (iter == links_.end())
+        {
+            return;
+        }
+        --iter->second->unanswered();
+
+        buffer_ptr_t data = *msg;
+        if (msg->type() == PTYPE_ERROR)
+        {
+            //error text is header + content, same as lua side
+            auto header = msg->header();
+            data = message::create_buffer(header.size() + msg->size());
+            data->write_back(header.data(), 0, header.size());
+            data->write_back(msg->data(), 0, msg->size());
+        }
+
+        if (!iter->second->push(FRAME_RESPONSE, msg->type(), p.sender, p.session, string_view_t{}, data))
+        {
+            string_view_t content = "cluster response message too large"sv;
+            auto err = message::create_buffer(content.size());
+            err->write_back(content.data(), 0, content.size());
+            iter->second->push(FRAME_RESPONSE, PTYPE_ERROR, p.sender, p.session, string_view_t{}, err);
+        }
+    }
+
+    void cluster::on_frame(const link_ptr_t& l, const char* data, size_t size)
+    {
+        uint8_t kind = 0, type = 0;
+        uint16_t namesize = 0;
+        uint32_t serviceid = 0;
+        int32_t session = 0;
+        uint32_t timeout = 0;
+        const char* p = read_net(data, kind);
+        p = read_net(p, type);
+        p = read_net(p, namesize);
+        p = read_net(p, serviceid);
+        p = read_net(p, session);
+        p = read_net(p, timeout);
+        size_t headsize = FRAME_HEAD_SIZE - sizeof(uint32_t);
+        if (headsize + namesize > size)
+        {
+            close_link(l, "invalid frame");
+            return;
+        }
+        string_view_t name{ p, namesize };
+        string_view_t payload{ p + namesize, size - headsize - namesize };
+
+        if (kind == FRAME_RESPONSE)
+        {
+            auto& inflight = l->inflight();
+            auto iter = inflight.find((static_cast<uint64_t>(serviceid) << 32) | static_cast<uint32_t>(session));
+            if (iter == inflight.end())
+            {
+                //timeout already
+                return;
+            }
+            auto& st = stats_[l->node()];
+            auto latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - iter->second.start).count());
+            ++st.responses;
+            st.latency_sum += latency;
+            st.latency_max = std::max(st.latency_max, latency);
+            inflight.erase(iter);
+            //the last outstanding call is done, held frames need not wait
+            l->flush();
+            auto msg = message::create(payload.size());
+            msg->write_data(payload);
+            msg->set_sender(CLUSTER_SERVICE_ID);
+            msg->set_receiver(serviceid);
+            msg->set_responseid(session);
+            msg->set_type(type);
+            router_->send_message(std::move(msg));
+            if (l->draining() && l->idle())
+            {
+                close_link(l, "node leave");
+            }
+            return;
+        }
+
+        if (kind != FRAME_REQUEST)
+        {
+            close_link(l, "invalid frame kind");
+            return;
+        }
+
+        std::string error;
+        uint32_t receiver = router_->get_unique_service(name);
+        int32_t token = 0;
+        auto expire = (timeout != 0) ? std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout) : time_point::max();
+        if (0 == receiver)
+        {
+            error = moon::format("cluster: node %s has no unique service %s", name_.data(), std::string{ name }.data());
+        }
+        else if (session != 0 && 0 == (token = make_token(*l, serviceid, session, expire)))
+        {
+            error = moon::format("cluster: node %s too many requests waiting response", name_.data());
+        }
+
+        if (!error.empty())
+        {
+            if (session != 0)
+            {
+                auto err = message::create_buffer(error.size());
+                err->write_back(error.data(), 0, error.size());
+                l->push(FRAME_RESPONSE, PTYPE_ERROR, serviceid, session, string_view_t{}, err);
+                l->flush();
+            }
+            return;
+        }
+
+        if (token != 0)
+        {
+            ++l->unanswered();
+            if (timeout != 0)
+            {
+                add_deadline(0, static_cast<uint64_t>(token), expire);
+            }
+        }
+
+        auto msg = message::create(payload.size());
+        msg->write_data(payload);
+        msg->set_sender(CLUSTER_SERVICE_ID);
+        msg->set_receiver(receiver);
+        msg->set_type(type);
+        //request: negative responseid, see router::send
+        msg->set_responseid(-token);
+        router_->send_message(std::move(msg));
+    }
+
+    void cluster::add_deadline(uint32_t linkid, uint64_t key, time_point expire)
+    {
+        deadlines_.push(deadline{ expire, linkid, key });
+        if (expire < deadline_armed_)
+        {
+            arm_deadline(expire);
+        }
+    }
+
+    void cluster::arm_deadline(time_point expire)
+    {
+        deadline_armed_ = expire;
+        deadline_timer_.expires_at(expire);
+        deadline_timer_.async_wait([this](const asio::error_code& e) {
+            if (e)
+            {
+                return;
+            }
+            deadline_armed_ = time_point::max();
+            check_deadline();
+        });
+    }
+
+    void cluster::check_deadline()
+    {
+        auto now = std::chrono::steady_clock::now();
+        while (!deadlines_.empty() && deadlines_.top().expire <= now)
+        {
+            auto d = deadlines_.top();
+            deadlines_.pop();
+            if (0 == d.linkid)
+            {
+                expire_token(static_cast<int32_t>(d.key), d.expire);
+                continue;
+            }
+
+            auto iter = links_.find(d.linkid);
+            if (iter == links_.end())
+            {
+                continue;
+            }
+
+            auto l = iter->second;
+            auto& inflight = l->inflight();
+            auto it = inflight.find(d.key);
+            //responded, or same session used by a new call
+            if (it == inflight.end() || it->second.deadline != d.expire)
+            {
+                continue;
+            }
+            inflight.erase(it);
+            ++stats_[l->node()].timeouts;
+            fail_call(static_cast<uint32_t>(d.key >> 32), static_cast<int32_t>(d.key & 0xFFFFFFFF), moon::format("call node %s timeout", l->node().data()));
+            if (l->draining() && l->idle())
+            {
+                close_link(l, "node leave");
+            }
+        }
+
+        if (!deadlines_.empty())
+        {
+            arm_deadline(deadlines_.top().expire);
+        }
+    }
+
+    void cluster::fail_call(uint32_t sender, int32_t session, const string_view_t& reason)
+    {
+        router_->make_response(sender, "cluster "sv, reason, session, PTYPE_ERROR);
+    }
+
+    int32_t cluster::make_token(link& l, uint32_t sender, int32_t session, time_point expire)
+    {
+        uint32_t slot;
+        if (!free_tokens_.empty())
+        {
+            slot = free_tokens_.back();
+            free_tokens_.pop_back();
+        }
+        else
+        {
+            //slot 0 is not used: token is never 0
+            if (pendings_.empty())
+            {
+                pendings_.emplace_back();
+            }
+            slot = static_cast<uint32_t>(pendings_.size());
+            if (slot > TOKEN_SLOT_MASK)
+            {
+                return 0;
+            }
+            pendings_.emplace_back();
+        }
+
+        auto& p = pendings_[slot];
+        p.linkid = l.id();
+        p.sender = sender;
+        p.session = session;
+        p.used = true;
+        p.expire = expire;
+        p.prev = 0;
+        p.next = l.tokens();
+        if (p.next != 0)
+        {
+            pendings_[p.next].prev = slot;
+        }
+        l.tokens() = slot;
+        return static_cast<int32_t>((static_cast<uint32_t>(p.gen) << TOKEN_SLOT_BITS) | slot);
+    }
+
+    bool cluster::take_token(int32_t token, pending& out)
+    {
+        if (token <= 0)
+        {
+            return false;
+        }
+
+        uint32_t slot = static_cast<uint32_t>(token) & TOKEN_SLOT_MASK;
+        if (slot >= pendings_.size())
+        {
+            return false;
+        }
+
+        auto& p = pendings_[slot];
+        if (!p.used || p.gen != (static_cast<uint32_t>(token) >> TOKEN_SLOT_BITS))
+        {
+            return false;
+        }
+        unlink_token(slot);
+        out = p;
+        p.used = false;
+        p.gen = (p.gen + 1) & TOKEN_GEN_MASK;
+        free_tokens_.push_back(slot);
+        return true;
+    }
+
+    void cluster::unlink_token(uint32_t slot)
+    {
+        auto& p = pendings_[slot];
+        if (p.prev != 0)
+        {
+            pendings_[p.prev].next = p.next;
+        }
+        else if (auto iter = links_.find(p.linkid); iter != links_.end())
+        {
+            iter->second->tokens() = p.next;
+        }
+
+        if (p.next != 0)
+        {
+            pendings_[p.next].prev = p.prev;
+        }
+        p.prev = 0;
+        p.next = 0;
+    }
+
+    void cluster::expire_token(int32_t token, time_point expire)
+    {
+        uint32_t slot = static_cast<uint32_t>(token) & TOKEN_SLOT_MASK;
+        //responded, or slot reused by a new request
+        if (slot >= pendings_.size() || pendings_[slot].expire != expire)
+        {
+            return;
+        }
+
+        pending p;
+        if (!take_token(token, p))
+        {
+            return;
+        }
+
+        //the caller failed with timeout, a late response of local service is dropped
+        if (auto iter = links_.find(p.linkid); iter != links_.end())
+        {
+            --iter->second->unanswered();
+            iter->second->flush();
+        }
+    }
+
+    void cluster::release_tokens(link& l)
+    {
+        //only the tokens of this link
+        uint32_t slot = l.tokens();
+        while (slot != 0)
+        {
+            auto& p = pendings_[slot];
+            uint32_t next = p.next;
+            p.used = false;
+            p.gen = (p.gen + 1) & TOKEN_GEN_MASK;
+            p.prev = 0;
+            p.next = 0;
+            free_tokens_.push_back(slot);
+            slot = next;
+        }
+        l.tokens() = 0;
+    }
+}
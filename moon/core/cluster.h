@@ -0,0 +1,265 @@
+#pragma once
+#include "config.h"
+#include "asio.hpp"
+#include "common/concurrent_queue.hpp"
+#include "common/spinlock.hpp"
+
+namespace moon
+{
+    class router;
+    class log;
+
+    /*
+        Native cluster transport: calls unique services of other nodes (processes) without a relay service.
+        Runs on its own io thread. Each peer node has one persistent outgoing connection, created at the first
+        call, all calls to the node are multiplexed on it by (sender, session) and responses come back on the
+        same connection. A request is delivered straight to the mailbox of the receiver's worker, with sender
+        CLUSTER_SERVICE_ID: router sends the response of the local service back here.
+    */
+    class cluster
+    {
+    public:
+        //frame: | size u32 | kind u8 | type u8 | name size u16 | serviceid u32 | session i32 | timeout u32 | name | payload |
+        //size counts the bytes after itself, integers are network byte order.
+        //request: serviceid is the caller, name is the receiver unique service, timeout is the caller's call timeout
+        //milliseconds, 0: none. response: caller's serviceid and session, timeout 0.
+        static constexpr size_t FRAME_HEAD_SIZE = 20;
+        static constexpr uint32_t MAX_FRAME_SIZE = 64 * 1024 * 1024;
+        static constexpr uint8_t FRAME_REQUEST = 1;
+        static constexpr uint8_t FRAME_RESPONSE = 2;
+        //payloads up to this size are copied into the write buffer, larger ones are written in place
+        static constexpr size_t COPY_PAYLOAD_SIZE = 4096;
+        static constexpr size_t DEFAULT_FLUSH_SIZE = 16 * 1024;
+        static constexpr int64_t DEFAULT_FLUSH_DELAY = 100;
+        static constexpr int64_t DEFAULT_REGISTRY_INTERVAL = 1000;
+        //calls of a departed node not responded in this time fail
+        static constexpr int64_t DRAIN_TIMEOUT = 10000;
+        static constexpr int64_t DRAIN_CHECK_INTERVAL = 100;
+
+        using time_point = std::chrono::steady_clock::time_point;
+
+        //outgoing call waiting response
+        struct call_state
+        {
+            time_point start;
+            //time_point::max(): no timeout
+            time_point deadline;
+        };
+
+        cluster(router* r, log* logger);
+
+        ~cluster();
+
+        cluster(const cluster&) = delete;
+
+        cluster& operator=(const cluster&) = delete;
+
+        //name: this node. listen host:port for other nodes and start io thread
+        bool start(const std::string& name, const std::string& host, const std::string& port);
+
+        //close all connections, calls waiting response get error
+        void stop();
+
+        bool started() const;
+
+        /*
+            Write coalescing of each link, must be called before start.
+            While other calls of a link are outstanding, a link writes at most once each delay microseconds,
+            unless size bytes are queued: many small frames go out with one write. A lone call, or a call on
+            a link idle for delay, is written at once. delay 0: write every batch of frames at once.
+        */
+        void set_flush(size_t size, int64_t delay);
+
+        /*
+            Registry file of nodes, must be called before start. Checked each interval milliseconds and
+            reloaded when modified: nodes added to the file join, nodes removed from it leave.
+            format: [{"name": "server_1", "host": "127.0.0.1", "port": "10001"}, ...]
+        */
+        void watch_registry(const std::string& path, int64_t interval);
+
+        //add a node or change its address, may be called before start. thread safe
+        void add_node(const std::string& name, const std::string& host, const std::string& port);
+
+        //new calls to the node fail, the connection is closed after calls waiting response are done. thread safe
+        void remove_node(const std::string& name);
+
+        //timeout of calls sent with timeout 0, milliseconds. 0: no timeout. must be called before start
+        void set_call_timeout(int64_t timeout);
+
+        //send to unique service of node, session 0: no response. timeout milliseconds, 0: default. thread safe
+        void send(uint32_t sender, const string_view_t& node, const string_view_t& service, const buffer_ptr_t& data, int32_t session, uint8_t type, int64_t timeout);
+
+        //cmd: cluster.<node>.stats, node * for all nodes. responds json of call counters per node. thread safe
+        void runcmd(uint32_t sender, const std::string& cmd, int32_t responseid);
+
+        //response of a local service to a remote request, msg->responseid() is the request token. thread safe
+        void response(message_ptr_t&& msg);
+    private:
+        class link;
+
+        using link_ptr_t = std::shared_ptr<link>;
+
+        struct request
+        {
+            uint32_t sender = 0;
+            int32_t session = 0;
+            uint8_t type = 0;
+            int64_t timeout = 0;
+            std::string node;
+            std::string service;
+            buffer_ptr_t data;
+        };
+
+        //remote request waiting the response of local service
+        struct pending
+        {
+            uint32_t linkid = 0;
+            uint32_t sender = 0;
+            int32_t session = 0;
+            uint16_t gen = 0;
+            bool used = false;
+            //caller's deadline, time_point::max(): no timeout
+            time_point expire;
+            //slots of the same link, 0: none
+            uint32_t prev = 0;
+            uint32_t next = 0;
+        };
+
+        struct node_address
+        {
+            std::string host;
+            std::string port;
+
+            bool operator==(const node_address& other) const
+            {
+                return host == other.host && port == other.port;
+            }
+        };
+
+        //counters of calls to a node, kept when connections change
+        struct peer_stats
+        {
+            uint64_t calls = 0;
+            uint64_t responses = 0;
+            uint64_t timeouts = 0;
+            //failed by connection close
+            uint64_t failures = 0;
+            uint64_t latency_sum = 0;
+            uint64_t latency_max = 0;
+        };
+
+        struct deadline
+        {
+            time_point expire;
+            //0: key is the token of a remote request, link ids start from 1
+            uint32_t linkid;
+            uint64_t key;
+
+            bool operator<(const deadline& other) const
+            {
+                //earliest on top of priority_queue
+                return expire > other.expire;
+            }
+        };
+
+        //token = gen << TOKEN_SLOT_BITS | slot, positive int32 like lua sessions
+        static constexpr uint32_t TOKEN_SLOT_BITS = 20;
+        static constexpr uint32_t TOKEN_SLOT_MASK = (1 << TOKEN_SLOT_BITS) - 1;
+        static constexpr uint16_t TOKEN_GEN_MASK = 0x3FF;
+
+        template<typename THandler>
+        void post(THandler&& h)
+        {
+            asio::post(io_ctx_, std::forward<THandler>(h));
+        }
+
+        void accept();
+
+        void set_node(const std::string& name, const node_address& addr);
+
+        void erase_node(const std::string& name);
+
+        //stop using the outgoing link of a node, close it when drained
+        void drain(const std::string& node);
+
+        void check_drain();
+
+        void load_registry();
+
+        void check_registry();
+
+        void add_deadline(uint32_t linkid, uint64_t key, time_point expire);
+
+        void arm_deadline(time_point expire);
+
+        //fail calls past deadline, release tokens of remote requests the caller gave up
+        void check_deadline();
+
+        link_ptr_t get_link(const std::string& node);
+
+        void connect(const link_ptr_t& l, const node_address& addr);
+
+        void close_link(const link_ptr_t& l, const string_view_t& reason);
+
+        void handle_request(request& req);
+
+        void handle_response(message_ptr_t& msg);
+
+        void on_frame(const link_ptr_t& l, const char* data, size_t size);
+
+        void fail_call(uint32_t sender, int32_t session, const string_view_t& reason);
+
+        //0: no free slot
+        int32_t make_token(link& l, uint32_t sender, int32_t session, time_point expire);
+
+        bool take_token(int32_t token, pending& p);
+
+        //remove the slot from the token list of its link
+        void unlink_token(uint32_t slot);
+
+        //caller's deadline of a remote request passed, expire: entry of the deadline queue
+        void expire_token(int32_t token, time_point expire);
+
+        //tokens of a closed link, responses of them are dropped
+        void release_tokens(link& l);
+    private:
+        std::atomic_bool started_;
+        uint32_t linkuid_;
+        size_t flush_size_;
+        int64_t flush_delay_;
+        router* router_;
+        log* logger_;
+        std::string name_;
+        std::thread thread_;
+        asio::io_context io_ctx_;
+        asio::executor_work_guard<asio::io_context::executor_type> work_;
+        std::unique_ptr<asio::ip::tcp::acceptor> acceptor_;
+        std::unordered_map<std::string, node_address> nodes_;
+        std::unordered_map<std::string, link_ptr_t> outgoing_;
+        std::unordered_map<uint32_t, link_ptr_t> links_;
+        std::vector<pending> pendings_;
+        std::vector<uint32_t> free_tokens_;
+        //outgoing links of departed nodes, with drain deadline
+        std::vector<std::pair<link_ptr_t, std::chrono::steady_clock::time_point>> draining_;
+        asio::steady_timer drain_timer_;
+        std::string registry_;
+        int64_t registry_interval_;
+        std::string registry_content_;
+        std::unordered_set<std::string> registry_nodes_;
+        asio::steady_timer registry_timer_;
+        int64_t call_timeout_;
+        //deadlines of calls and remote requests, entries of responded ones are dropped when expired
+        std::priority_queue<deadline> deadlines_;
+        time_point deadline_armed_;
+        asio::steady_timer deadline_timer_;
+        std::unordered_map<std::string, peer_stats> stats_;
+
+        using request_queue_t = concurrent_queue<request, moon::spin_lock, std::vector>;
+        request_queue_t requests_;
+        request_queue_t::container_type swap_requests_;
+
+        using response_queue_t = concurrent_queue<message_ptr_t, moon::spin_lock, std::vector>;
+        response_queue_t responses_;
+        response_queue_t::container_type swap_responses_;
+    };
+}
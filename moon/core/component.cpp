@@ -113,6 +113,11 @@ namespace moon
         return component_imp_->start_;
     }
 
+    void component::started(bool v)
+    {
+        component_imp_->start_ = v;
+    }
+
     bool component::ok() const
     {
         return component_imp_->ok_;
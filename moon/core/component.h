@@ -64,6 +64,8 @@ namespace moon
 
         bool started() const;
 
+        void started(bool v);
+
         bool ok() const;
 
         void ok(bool v);
@@ -5,7 +5,9 @@ namespace moon
 {
     constexpr int32_t WORKER_ID_SHIFT = 24;
     constexpr int64_t UPDATE_INTERVAL = 10; //ms
-    constexpr int32_t BUFFER_HEAD_RESERVED = 8;
+    constexpr int32_t BUFFER_HEAD_RESERVED = 16;
+    //sender of cluster requests, receiver of their responses. worker id 0 is never used by services
+    constexpr uint32_t CLUSTER_SERVICE_ID = 0x00FFFFFF;
 
     DECLARE_UNIQUE_PTR(message);
     DECLARE_SHARED_PTR(buffer);
@@ -32,7 +34,6 @@ namespace moon
     enum class buffer_flag :uint8_t
     {
         pack_size = 1 << 0,
-        close = 1 << 1,
         framing = 1 << 2,
         broadcast = 1 << 3,
     };
@@ -170,6 +170,18 @@ namespace moon
             return data_.get();
         }
 
+        //for writing the data in place: a buffer also held by lua buffer handles or other messages is copied first
+        buffer* get_writable_buffer()
+        {
+            if (data_ && data_.use_count() > 1)
+            {
+                auto buf = create_buffer(data_->size());
+                buf->write_back(data_->data(), 0, data_->size());
+                data_ = std::move(buf);
+            }
+            return data_.get();
+        }
+
         bool broadcast() const
         {
             return data_?data_->has_flag(buffer_flag::broadcast):false;
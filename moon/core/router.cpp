@@ -5,6 +5,7 @@
 #include "worker.h"
 #include "message.hpp"
 #include "service.h"
+#include "cluster.h"
 
 namespace moon
 {
@@ -12,6 +13,7 @@ namespace moon
         :next_workerid_(0)
         , workers_(workers)
         , logger_(logger)
+        , cluster_(nullptr)
     {
     }
 
@@ -35,7 +37,7 @@ namespace moon
             return 0;
         }
 
-        auto s = iter->second();
+        auto s = iter->second(config);
 
         worker* wk;
         if (workerid_valid(workerid))
@@ -124,6 +126,15 @@ namespace moon
             }
             break;
         }
+        case "cluster"_csh:
+        {
+            if (nullptr != cluster_ && cluster_->started())
+            {
+                cluster_->runcmd(sender, cmd, responseid);
+                return;
+            }
+            break;
+        }
         }
 
         auto content = moon::format("invalid cmd: %s.", cmd.data());
@@ -134,6 +145,14 @@ namespace moon
     {
         MOON_CHECK(msg->type() != PTYPE_UNKNOWN, "invalid message type.");
         MOON_CHECK(msg->receiver() != 0, "message receiver serviceid is 0.");
+        if (msg->receiver() == CLUSTER_SERVICE_ID)
+        {
+            if (nullptr != cluster_)
+            {
+                cluster_->response(std::forward<message_ptr_t>(msg));
+            }
+            return;
+        }
         int32_t id = worker_id(msg->receiver());
         MOON_CHECK(workerid_valid(id), "invalid message receiver serviceid.");
         workers_[id - 1]->send(std::forward<message_ptr_t>(msg));
@@ -154,6 +173,14 @@ namespace moon
         send_message(std::move(msg));
     }
 
+    void router::multicast(uint32_t sender, const std::vector<uint32_t>& receivers, const buffer_ptr_t& buf, const string_view_t& header, uint8_t type) const
+    {
+        for (auto receiver : receivers)
+        {
+            send(sender, receiver, buf, header, 0, type);
+        }
+    }
+
     void router::broadcast(uint32_t sender, const buffer_ptr_t& buf, const string_view_t& header, uint8_t type)
     {
         for (auto& w : workers_)
@@ -167,6 +194,16 @@ namespace moon
         }
     }
 
+    void router::cluster_send(uint32_t sender, const string_view_t& node, const string_view_t& service, const buffer_ptr_t& buf, int32_t responseid, uint8_t type, int64_t timeout) const
+    {
+        if (nullptr == cluster_ || !cluster_->started())
+        {
+            make_response(sender, "router::cluster_send "sv, "cluster is not started"sv, responseid, PTYPE_ERROR);
+            return;
+        }
+        cluster_->send(sender, node, service, buf, responseid, type, timeout);
+    }
+
     bool router::register_service(const std::string & type, register_func f)
     {
         auto ret = regservices_.emplace(type, f);
@@ -15,12 +15,15 @@ namespace moon
 
     class worker;
 
+    class cluster;
+
     class router
     {
     public:
         friend class server;
 
-        using register_func = service_ptr_t(*)();
+        //config: the config of new service, factory may return a reused service object
+        using register_func = service_ptr_t(*)(const string_view_t& config);
 
         router(std::vector<std::unique_ptr<worker>>& workers, log* logger);
 
@@ -44,6 +47,12 @@ namespace moon
 
         void broadcast(uint32_t sender, const buffer_ptr_t& buf, const string_view_t& header, uint8_t type);
 
+        //send to unique service of cluster node, responseid 0: no response. timeout milliseconds, 0: node default. see cluster
+        void cluster_send(uint32_t sender, const string_view_t& node, const string_view_t& service, const buffer_ptr_t& buf, int32_t responseid, uint8_t type, int64_t timeout) const;
+
+        //send one buffer to many receivers, the buffer is shared by all messages
+        void multicast(uint32_t sender, const std::vector<uint32_t>& receivers, const buffer_ptr_t& buf, const string_view_t& header, uint8_t type) const;
+
         bool register_service(const std::string& type, register_func func);
 
         std::shared_ptr<std::string> get_env(const std::string& name) const;
@@ -90,6 +99,7 @@ namespace moon
         env_t env_;
         unique_service_db_t unique_services_;
         log* logger_;
+        cluster* cluster_;
         std::function<void()> stop_;
     };
 }
\ No newline at end of file
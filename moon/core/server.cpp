@@ -8,6 +8,7 @@ namespace moon
         , workers_()
         , default_log_()
         , router_(workers_, &default_log_)
+        , cluster_(&router_, &default_log_)
     {
     }
 
@@ -26,6 +27,7 @@ namespace moon
         router_.set_stop([this]() {
             stop();
         });
+        router_.cluster_ = &cluster_;
 
         CONSOLE_INFO(logger(), "INIT with %d workers.", worker_num);
 
@@ -117,6 +119,11 @@ namespace moon
         return &router_;
     }
 
+    cluster* server::get_cluster()
+    {
+        return &cluster_;
+    }
+
     size_t server::workernum() const
     {
         return workers_.size();
@@ -134,6 +141,7 @@ namespace moon
         {
             (*iter)->wait();
         }
+        cluster_.stop();
         CONSOLE_INFO(logger(), "STOP");
         default_log_.wait();
         state_.store(state::exited);
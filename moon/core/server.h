@@ -1,6 +1,7 @@
 #pragma once
 #include "config.h"
 #include "router.h"
+#include "cluster.h"
 #include "common/log.hpp"
 
 namespace moon
@@ -28,6 +29,8 @@ namespace moon
 
         router* get_router();
 
+        cluster* get_cluster();
+
         size_t workernum() const;
 
         bool stoped();
@@ -38,6 +41,7 @@ namespace moon
         std::vector<std::unique_ptr<worker>> workers_;
         log default_log_;
         router router_;
+        cluster cluster_;
     };
 };
 
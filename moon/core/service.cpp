@@ -63,6 +63,11 @@ namespace moon
         CONSOLE_WARN(logger(), "service::runcmd [%s] not Implemented: sender[%u] responseid[%d]", cmd.data(), sender, responseid);
     }
 
+    bool service::recycle()
+    {
+        return false;
+    }
+
     void service::set_unique(bool v)
     {
         unique_ = v;
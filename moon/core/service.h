@@ -39,6 +39,12 @@ namespace moon
         virtual void dispatch(message* msg) = 0;
 
         virtual void runcmd(uint32_t sender, const std::string& cmd, int32_t responseid);
+
+        //called after the service removed. return true: the object is kept by a pool for reuse, caller must not delete it
+        virtual bool recycle();
+
+        //called when worker's message queue is drained, if the service handled messages since last call
+        virtual void idle() {}
     protected:
         void set_unique(bool v);
 
@@ -1,4 +1,5 @@
 #include "worker.h"
+#include <algorithm>
 #include "common/time.hpp"
 #include "common/string.hpp"
 #include "common/hash.hpp"
@@ -102,7 +103,7 @@ namespace moon
             if (auto iter = services_.find(id); services_.end() != iter)
             {
                 std::string response_content;
-                auto& s = iter->second;
+                auto s = std::move(iter->second);
                 s->destroy();
                 if (services_.size() == 0)
                 {
@@ -131,6 +132,11 @@ namespace moon
                     buf->write_back(str.data(), str.size());
                 }
                 router_->broadcast(id, buf, header, PTYPE_SYSTEM);
+
+                if (!crashed && s->recycle())
+                {
+                    s.release();
+                }
             }
             else
             {
@@ -164,9 +170,19 @@ namespace moon
                     count = swapqueue_.size();
                     for (auto& msg : swapqueue_)
                     {
+                        if (active_services_.empty() || active_services_.back() != msg->receiver())
+                        {
+                            active_services_.push_back(msg->receiver());
+                        }
                         handle_one(ser, std::move(msg));
                     }
                 }
+
+                //no more queued message: another post is not pending
+                if (mqueue_.size() == 0)
+                {
+                    idle();
+                }
                 auto difftime = time::millsecond() - begin_time;
                 work_time_ += difftime;
                 if (difftime > 1000)
@@ -187,6 +203,24 @@ namespace moon
         workerid_ = id;
     }
 
+    void worker::idle()
+    {
+        if (active_services_.empty())
+        {
+            return;
+        }
+        std::sort(active_services_.begin(), active_services_.end());
+        active_services_.erase(std::unique(active_services_.begin(), active_services_.end()), active_services_.end());
+        for (auto id : active_services_)
+        {
+            if (auto s = find_service(id); s != nullptr)
+            {
+                s->idle();
+            }
+        }
+        active_services_.clear();
+    }
+
     service * worker::find_service(uint32_t serviceid) const
     {
         auto iter = services_.find(serviceid);
@@ -67,6 +67,9 @@ namespace moon
 
         void handle_one(service* ser, message_ptr_t&& msg);
 
+        //call service::idle of services handled messages since last idle
+        void idle();
+
         void register_commands();
     private:
         //To prevent post too many update event
@@ -87,6 +90,8 @@ namespace moon
         using queue_t = concurrent_queue<message_ptr_t, moon::spin_lock, std::vector>;
         queue_t::container_type swapqueue_;
         queue_t mqueue_;
+        //receivers of handled messages, see idle()
+        std::vector<uint32_t> active_services_;
 
         using command_hander_t = std::function<std::string(const std::vector<std::string>&)>;
         std::unordered_map<std::string, command_hander_t> commands_;
@@ -11,6 +11,8 @@
 #include "router.h"
 #include "lua_buffer.hpp"
 #include "lua_serialize.hpp"
+#include "lua_buffer_view.hpp"
+#include "lua_buffer_handle.hpp"
 
 #include "services/lua_service.h"
 
@@ -55,23 +57,27 @@ std::string make_cluster_message(string_view_t header, string_view_t data)
 void pack_cluster_message(string_view_t header, message* msg)
 {
     uint16_t len = static_cast<uint16_t>(msg->size());
-    msg->get_buffer()->write_front(&len, 0, 1);
-    msg->get_buffer()->write_back(header.data(), 0, header.size());
+    auto buf = msg->get_writable_buffer();
+    buf->write_front(&len, 0, 1);
+    buf->write_back(header.data(), 0, header.size());
 }
 
 string_view_t unpack_cluster_message(message* msg)
 {
     uint16_t len = 0;
-    msg->get_buffer()->read(&len, 0, 1);
+    auto buf = msg->get_writable_buffer();
+    buf->read(&len, 0, 1);
     size_t header_size = msg->size() - len;
     const char* header = msg->data() + len;
     int tmp = (int)header_size;
-    msg->get_buffer()->offset_writepos(-tmp);
+    buf->offset_writepos(-tmp);
     return string_view_t{ header,header_size };
 }
 
 static int my_lua_print(lua_State *L) {
     moon::log* logger = (moon::log*)lua_touserdata(L, lua_upvalueindex(1));
+    if (!logger->enabled(moon::LogLevel::Info))
+        return 0;
     int n = lua_gettop(L);  /* number of arguments */
     int i;
     lua_getglobal(L, "tostring");
@@ -125,6 +131,7 @@ const lua_bind & lua_bind::bind_util() const
 const lua_bind & lua_bind::bind_log(moon::log* logger) const
 {
     lua.set_function("LOGV", &moon::log::logstring, logger);
+    lua.set_function("get_loglevel", [logger]() { return static_cast<int>(logger->get_level()); });
     register_lua_print(lua, logger);
     return *this;
 }
@@ -156,6 +163,21 @@ static void* message_get_buffer(message* m)
     return m->get_buffer();
 }
 
+//msg:view([pos [, len]]) payload view without copy, pos starts from 0 like substr
+static int message_view(lua_State* L)
+{
+    message* m = sol::stack::get<message*>(L, 1);
+    auto pos = static_cast<size_t>(luaL_optinteger(L, 2, 0));
+    auto len = static_cast<size_t>(luaL_optinteger(L, 3, static_cast<lua_Integer>(m->size())));
+    if (pos > m->size())
+    {
+        pos = m->size();
+    }
+    len = std::min(len, m->size() - pos);
+    lua_buffer_view::push(L, *m, m->data() + pos, len);
+    return 1;
+}
+
 const lua_bind & lua_bind::bind_message() const
 {
     lua.new_usertype<message>("message"
@@ -169,6 +191,7 @@ const lua_bind & lua_bind::bind_message() const
         , "bytes", (&message::bytes)
         , "size", (&message::size)
         , "substr", (&message::substr)
+        , "view", message_view
         , "buffer", message_get_buffer
         , "redirect", (redirect_message)
         , "resend", resend
@@ -176,6 +199,23 @@ const lua_bind & lua_bind::bind_message() const
     return *this;
 }
 
+//make_cache(data) shared payload can be sent many times, across yields and timers. released on last use
+static int make_cache(lua_State* L)
+{
+    if (lua_buffer_handle::test(L, 1) != nullptr)
+    {
+        lua_settop(L, 1);
+        return 1;
+    }
+    size_t len = 0;
+    const char* data = luaL_checklstring(L, 1, &len);
+    auto h = lua_buffer_handle::push(L);
+    h->buf = message::create_buffer(len);
+    h->buf->write_back(data, 0, len);
+    lua_buffer_handle::account(L, len);
+    return 1;
+}
+
 const lua_bind& lua_bind::bind_service(lua_service* s) const
 {
     auto router_ = s->get_router();
@@ -185,7 +225,7 @@ const lua_bind& lua_bind::bind_service(lua_service* s) const
     lua.set_function("name", &lua_service::name, s);
     lua.set_function("id", &lua_service::id, s);
     lua.set_function("send_cache", &lua_service::send_cache, s);
-    lua.set_function("make_cache", &lua_service::make_cache, s);
+    lua.set_function("make_cache", make_cache);
     lua.set_function("get_tcp", &lua_service::get_tcp, s);
     lua.set_function("remove_component", &lua_service::remove, s);
     lua.set_function("set_init", &lua_service::set_init, s);
@@ -193,15 +233,28 @@ const lua_bind& lua_bind::bind_service(lua_service* s) const
     lua.set_function("set_exit", &lua_service::set_exit, s);
     lua.set_function("set_dispatch", &lua_service::set_dispatch, s);
     lua.set_function("set_destroy", &lua_service::set_destroy, s);
+    lua.set_function("set_reset", &lua_service::set_reset, s);
     lua.set_function("set_on_timer", &lua_service::set_on_timer, s);
     lua.set_function("set_remove_timer", &lua_service::set_remove_timer, s);
     lua.set_function("register_command", &lua_service::register_command, s);
     lua.set_function("memory_use", &lua_service::memory_use, s);
+    lua.set_function("gc_time", &lua_service::gc_time, s);
     lua.set_function("send", &router::send, router_);
     lua.set_function("new_service", &router::new_service, router_);
     lua.set_function("remove_service", &router::remove_service, router_);
     lua.set_function("runcmd", &router::runcmd, router_);
     lua.set_function("broadcast", &router::broadcast, router_);
+    lua.set_function("cluster_send", &router::cluster_send, router_);
+    lua.set("CLUSTER_SERVICE_ID", CLUSTER_SERVICE_ID);
+    lua.set_function("multicast", [router_](uint32_t sender, const sol::table& receivers, const buffer_ptr_t& buf, const string_view_t& header, uint8_t type) {
+        std::vector<uint32_t> v;
+        v.reserve(receivers.size());
+        for (size_t i = 1; i <= receivers.size(); ++i)
+        {
+            v.emplace_back(receivers.raw_get<uint32_t>(i));
+        }
+        router_->multicast(sender, v, buf, header, type);
+    });
     lua.set_function("workernum", &router::workernum, router_);
     lua.set_function("unique_service", &router::get_unique_service, router_);
     lua.set_function("set_unique_service", &router::set_unique_service, router_);
@@ -217,8 +270,12 @@ const lua_bind & lua_bind::bind_socket() const
     lua.new_usertype<moon::tcp>("tcp"
         , sol::call_constructor, sol::no_constructor
         , "async_accept", (&moon::tcp::async_accept)
-        , "connect", (&moon::tcp::connect)
-        , "async_connect", (&moon::tcp::async_connect)
+        , "connect", sol::overload(
+            [](moon::tcp& t, const std::string& ip, const std::string& port) { return t.connect(ip, port); },
+            &moon::tcp::connect)
+        , "async_connect", sol::overload(
+            [](moon::tcp& t, const std::string& ip, const std::string& port, int32_t responseid) { t.async_connect(ip, port, responseid); },
+            &moon::tcp::async_connect)
         , "listen", (&moon::tcp::listen)
         , "close", (&moon::tcp::close)
         , "read", (&moon::tcp::read)
@@ -258,6 +315,42 @@ const lua_bind & lua_bind::bind_http() const
 }
 
 
+static int lazy_bind_index(lua_State* L)
+{
+    size_t len = 0;
+    const char* key = lua_tolstring(L, 2, &len);
+    if (nullptr == key)
+    {
+        return 0;
+    }
+
+    string_view_t name{ key, len };
+    if (name == "http_request_parser"sv || name == "http_response_parser"sv)
+    {
+        sol::table module(L, 1);
+        lua_bind(module).bind_http();
+    }
+    else
+    {
+        return 0;
+    }
+
+    lua_settop(L, 2);
+    lua_rawget(L, 1);
+    return 1;
+}
+
+const lua_bind & lua_bind::bind_lazy() const
+{
+    lua.push();
+    lua_createtable(lua.lua_state(), 0, 1);
+    lua_pushcfunction(lua.lua_state(), lazy_bind_index);
+    lua_setfield(lua.lua_state(), -2, "__index");
+    lua_setmetatable(lua.lua_state(), -2);
+    lua_pop(lua.lua_state(), 1);
+    return *this;
+}
+
 static void traverse_folder(const std::string& dir, int depth, sol::protected_function func, sol::this_state s)
 {
     directory::traverse_folder(dir, depth, [func, s](const fs::path& path, bool isdir)->bool {
@@ -31,6 +31,9 @@ public:
     const lua_bind& bind_socket()const;
 
     const lua_bind& bind_http() const;
+
+    //usertypes used by few services, bind them when first accessed
+    const lua_bind& bind_lazy() const;
 private:
     sol::table& lua;
 };
@@ -13,14 +13,14 @@ namespace sol
             template <typename Handler>
             static bool check(lua_State* L, int index, Handler&& handler, record& tracking) {
                 type t = type_of(L, index);
-                if (t == type::nil || t == type::userdata || t == type::lightuserdata || t == type::string)
+                if (t == type::nil || t == type::string || moon::lua_buffer_handle::test(L, index) != nullptr)
                 {
                     tracking.use(1);
                     return true;
                 }
                 else
                 {
-                    handler(L, index, type::lightuserdata, t, "expected a nil or a userdata(buffer*) or a string");
+                    handler(L, index, type::userdata, t, "expected a nil or a buffer(seri.pack) or a string");
                     return false;
                 }
             }
@@ -46,15 +46,22 @@ namespace sol
                     return buf;
                 }
                 case sol::type::userdata:
-                case sol::type::lightuserdata:
                 {
-                    moon::buffer* p = static_cast<moon::buffer*>(lua_touserdata(L, index));
-                    return moon::buffer_ptr_t(p);
+                    //shared with the handle, no copy
+                    if (auto h = moon::lua_buffer_handle::test(L, index); h != nullptr)
+                    {
+                        if (nullptr == h->buf)
+                        {
+                            luaL_error(L, "buffer is released");
+                        }
+                        return h->buf;
+                    }
+                    break;
                 }
                 default:
                     break;
                 }
-                luaL_error(L, "get buffer only support string or void*(buffer*)");
+                luaL_error(L, "get buffer only support string or buffer(seri.pack)");
                 return nullptr;
             }
         };
@@ -0,0 +1,139 @@
+#pragma once
+#include "lua.hpp"
+#include "config.h"
+#include "common/buffer.hpp"
+#include "lua_buffer_view.hpp"
+
+namespace moon
+{
+    /*
+        Lua userdata owns a reference of buffer, e.g. result of seri.pack and seri.concat.
+        Released by __gc. Sending it to services shares the buffer without copy, so one handle can be
+        sent many times; receivers must treat the payload as read only (like broadcast). Socket sends
+        copy it, connections write frame headers into the buffer.
+        Lua API:
+            #b, b:size()
+            b:bytes([i [, j]])  copy to lua string
+            b:view([i [, j]])   buffer view, see lua_buffer_view
+            b:release()         drop this reference now instead of at gc
+    */
+    class lua_buffer_handle
+    {
+    public:
+        static constexpr const char* METANAME = "moon.buffer";
+
+        buffer_ptr_t buf;
+
+        //push an empty handle, fill buf after: a lua memory error raised here must not leak buffer
+        static lua_buffer_handle* push(lua_State* L)
+        {
+            void* p = lua_newuserdata(L, sizeof(lua_buffer_handle));
+            auto h = new (p) lua_buffer_handle{};
+            if (luaL_newmetatable(L, METANAME))
+            {
+                init_metatable(L);
+            }
+            lua_setmetatable(L, -2);
+            return h;
+        }
+
+        //buffer memory is not allocated by lua: add it to gc debt, or gc runs too late to release handles
+        static void account(lua_State* L, size_t size)
+        {
+            if (lua_gc(L, LUA_GCISRUNNING, 0))
+            {
+                //in KB, at least 1
+                lua_gc(L, LUA_GCSTEP, static_cast<int>((size >> 10) + 1));
+            }
+        }
+
+        static lua_buffer_handle* test(lua_State* L, int index)
+        {
+            return static_cast<lua_buffer_handle*>(luaL_testudata(L, index, METANAME));
+        }
+
+        static lua_buffer_handle* check(lua_State* L, int index)
+        {
+            return static_cast<lua_buffer_handle*>(luaL_checkudata(L, index, METANAME));
+        }
+    private:
+        static void init_metatable(lua_State* L)
+        {
+            luaL_Reg methods[] = {
+                { "size", lsize },
+                { "bytes", lbytes },
+                { "view", lview },
+                { "release", lrelease },
+                { NULL, NULL },
+            };
+            luaL_newlib(L, methods);
+            lua_setfield(L, -2, "__index");
+            lua_pushcfunction(L, lsize);
+            lua_setfield(L, -2, "__len");
+            lua_pushcfunction(L, lgc);
+            lua_setfield(L, -2, "__gc");
+        }
+
+        static buffer* get(lua_State* L)
+        {
+            auto h = check(L, 1);
+            luaL_argcheck(L, h->buf != nullptr, 1, "buffer is released");
+            return h->buf.get();
+        }
+
+        //string.sub style position to 0-based offset [begin, end)
+        static void range(lua_State* L, size_t size, size_t& begin, size_t& end)
+        {
+            lua_Integer n = static_cast<lua_Integer>(size);
+            lua_Integer b = luaL_optinteger(L, 2, 1);
+            lua_Integer e = luaL_optinteger(L, 3, -1);
+            if (b < 0) b = (-b > n) ? 1 : n + b + 1;
+            else if (b == 0) b = 1;
+            if (e < 0) e = n + e + 1;
+            else if (e > n) e = n;
+            if (b > e)
+            {
+                begin = end = 0;
+                return;
+            }
+            begin = static_cast<size_t>(b - 1);
+            end = static_cast<size_t>(e);
+        }
+
+        static int lgc(lua_State* L)
+        {
+            check(L, 1)->~lua_buffer_handle();
+            return 0;
+        }
+
+        static int lrelease(lua_State* L)
+        {
+            check(L, 1)->buf.reset();
+            return 0;
+        }
+
+        static int lsize(lua_State* L)
+        {
+            lua_pushinteger(L, static_cast<lua_Integer>(get(L)->size()));
+            return 1;
+        }
+
+        static int lbytes(lua_State* L)
+        {
+            auto b = get(L);
+            size_t begin, end;
+            range(L, b->size(), begin, end);
+            lua_pushlstring(L, b->data() + begin, end - begin);
+            return 1;
+        }
+
+        static int lview(lua_State* L)
+        {
+            auto b = get(L);
+            size_t begin, end;
+            range(L, b->size(), begin, end);
+            lua_buffer_view::push(L, check(L, 1)->buf, b->data() + begin, end - begin);
+            return 1;
+        }
+    };
+}
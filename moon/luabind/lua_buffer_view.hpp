@@ -0,0 +1,235 @@
+#pragma once
+#include "lua.hpp"
+#include "config.h"
+#include "common/buffer.hpp"
+
+namespace moon
+{
+    /*
+        Lua userdata refers to a part of buffer without copy, e.g. msg:view().
+        holder keeps the buffer alive, the buffer must not be written while views exist.
+        Lua API (positions start from 1 like string):
+            #v, v:size()
+            v:sub(i [, j])              view of v, same as string.sub
+            v:bytes([i [, j]])          copy to lua string
+            v:byte(i)
+            v:find(s [, init])          plain find, return position or nil
+            v:int(i, n [, bigendian])   read n(1~8) bytes signed integer
+            v:uint(i, n [, bigendian])  read n(1~8) bytes unsigned integer
+            v:float(i), v:double(i)
+            v:pointer()                 lightuserdata, for decoders accept (pointer, size)
+    */
+    class lua_buffer_view
+    {
+    public:
+        static constexpr const char* METANAME = "moon.buffer_view";
+
+        const char* data;
+        size_t size;
+        buffer_ptr_t holder;
+
+        static lua_buffer_view* push(lua_State* L, const buffer_ptr_t& holder, const char* data, size_t size)
+        {
+            void* p = lua_newuserdata(L, sizeof(lua_buffer_view));
+            auto v = new (p) lua_buffer_view{ data, size, holder };
+            if (luaL_newmetatable(L, METANAME))
+            {
+                init_metatable(L);
+            }
+            lua_setmetatable(L, -2);
+            return v;
+        }
+
+        static lua_buffer_view* test(lua_State* L, int index)
+        {
+            return static_cast<lua_buffer_view*>(luaL_testudata(L, index, METANAME));
+        }
+
+        static lua_buffer_view* check(lua_State* L, int index)
+        {
+            return static_cast<lua_buffer_view*>(luaL_checkudata(L, index, METANAME));
+        }
+    private:
+        static void init_metatable(lua_State* L)
+        {
+            luaL_Reg methods[] = {
+                { "size", lsize },
+                { "sub", lsub },
+                { "bytes", lbytes },
+                { "byte", lbyte },
+                { "find", lfind },
+                { "int", lint },
+                { "uint", luint },
+                { "float", lfloat },
+                { "double", ldouble },
+                { "pointer", lpointer },
+                { NULL, NULL },
+            };
+            luaL_newlib(L, methods);
+            lua_setfield(L, -2, "__index");
+            lua_pushcfunction(L, lsize);
+            lua_setfield(L, -2, "__len");
+            lua_pushcfunction(L, lgc);
+            lua_setfield(L, -2, "__gc");
+        }
+
+        //string.sub style position to 0-based offset [begin, end)
+        static void range(lua_State* L, lua_buffer_view* v, int i, int j, size_t& begin, size_t& end)
+        {
+            lua_Integer size = static_cast<lua_Integer>(v->size);
+            lua_Integer b = luaL_optinteger(L, i, 1);
+            lua_Integer e = luaL_optinteger(L, j, -1);
+            if (b < 0) b = (-b > size) ? 1 : size + b + 1;
+            else if (b == 0) b = 1;
+            if (e < 0) e = size + e + 1;
+            else if (e > size) e = size;
+            if (b > e)
+            {
+                begin = end = 0;
+                return;
+            }
+            begin = static_cast<size_t>(b - 1);
+            end = static_cast<size_t>(e);
+        }
+
+        //offset of n bytes at position i
+        static size_t offset(lua_State* L, lua_buffer_view* v, int i, size_t n)
+        {
+            lua_Integer pos = luaL_checkinteger(L, i);
+            luaL_argcheck(L, pos >= 1 && static_cast<size_t>(pos - 1) + n <= v->size, i, "out of range");
+            return static_cast<size_t>(pos - 1);
+        }
+
+        static int lgc(lua_State* L)
+        {
+            check(L, 1)->~lua_buffer_view();
+            return 0;
+        }
+
+        static int lsize(lua_State* L)
+        {
+            lua_pushinteger(L, static_cast<lua_Integer>(check(L, 1)->size));
+            return 1;
+        }
+
+        static int lsub(lua_State* L)
+        {
+            auto v = check(L, 1);
+            size_t begin, end;
+            range(L, v, 2, 3, begin, end);
+            push(L, v->holder, v->data + begin, end - begin);
+            return 1;
+        }
+
+        static int lbytes(lua_State* L)
+        {
+            auto v = check(L, 1);
+            size_t begin, end;
+            range(L, v, 2, 3, begin, end);
+            lua_pushlstring(L, v->data + begin, end - begin);
+            return 1;
+        }
+
+        static int lbyte(lua_State* L)
+        {
+            auto v = check(L, 1);
+            size_t pos = offset(L, v, 2, 1);
+            lua_pushinteger(L, static_cast<uint8_t>(v->data[pos]));
+            return 1;
+        }
+
+        static int lfind(lua_State* L)
+        {
+            auto v = check(L, 1);
+            size_t len = 0;
+            const char* s = luaL_checklstring(L, 2, &len);
+            lua_Integer init = luaL_optinteger(L, 3, 1);
+            luaL_argcheck(L, init >= 1, 3, "out of range");
+            size_t pos = static_cast<size_t>(init - 1);
+            if (pos + len > v->size)
+            {
+                return 0;
+            }
+            if (len == 0)
+            {
+                lua_pushinteger(L, init);
+                return 1;
+            }
+            const char* end = v->data + v->size - len + 1;
+            for (const char* p = v->data + pos; p < end; ++p)
+            {
+                p = static_cast<const char*>(memchr(p, s[0], end - p));
+                if (p == nullptr)
+                {
+                    break;
+                }
+                if (memcmp(p, s, len) == 0)
+                {
+                    lua_pushinteger(L, static_cast<lua_Integer>(p - v->data) + 1);
+                    return 1;
+                }
+            }
+            return 0;
+        }
+
+        static uint64_t read_uint(lua_State* L, lua_buffer_view* v, size_t& n)
+        {
+            n = static_cast<size_t>(luaL_checkinteger(L, 3));
+            luaL_argcheck(L, n >= 1 && n <= 8, 3, "integer size must be 1~8");
+            size_t pos = offset(L, v, 2, n);
+            bool bigendian = lua_toboolean(L, 4);
+            auto p = reinterpret_cast<const uint8_t*>(v->data + pos);
+            uint64_t res = 0;
+            for (size_t k = 0; k < n; ++k)
+            {
+                res |= static_cast<uint64_t>(p[bigendian ? (n - 1 - k) : k]) << (k * 8);
+            }
+            return res;
+        }
+
+        static int lint(lua_State* L)
+        {
+            size_t n = 0;
+            uint64_t res = read_uint(L, check(L, 1), n);
+            if (n < 8)
+            {
+                //sign extend
+                uint64_t mask = uint64_t{ 1 } << (n * 8 - 1);
+                res = (res ^ mask) - mask;
+            }
+            lua_pushinteger(L, static_cast<lua_Integer>(res));
+            return 1;
+        }
+
+        static int luint(lua_State* L)
+        {
+            size_t n = 0;
+            lua_pushinteger(L, static_cast<lua_Integer>(read_uint(L, check(L, 1), n)));
+            return 1;
+        }
+
+        static int lfloat(lua_State* L)
+        {
+            auto v = check(L, 1);
+            float f;
+            memcpy(&f, v->data + offset(L, v, 2, sizeof(f)), sizeof(f));
+            lua_pushnumber(L, f);
+            return 1;
+        }
+
+        static int ldouble(lua_State* L)
+        {
+            auto v = check(L, 1);
+            double d;
+            memcpy(&d, v->data + offset(L, v, 2, sizeof(d)), sizeof(d));
+            lua_pushnumber(L, d);
+            return 1;
+        }
+
+        static int lpointer(lua_State* L)
+        {
+            lua_pushlightuserdata(L, const_cast<char*>(check(L, 1)->data));
+            return 1;
+        }
+    };
+}
@@ -0,0 +1,216 @@
+#pragma once
+#include <algorithm>
+#include "lua.hpp"
+#include "common/resp.hpp"
+
+namespace moon
+{
+    /*
+        lua module "resp": decodes RESP2/RESP3 replies into lua values.
+        null (nil bulk, nil array, RESP3 null) is resp.null, error reply is false and the message,
+        error element of an aggregate is {false, message}, map is a table, attribute is skipped.
+    */
+    class lua_resp
+    {
+    public:
+        static int open(lua_State* L)
+        {
+            luaL_Reg l[] = {
+                {"decode",decode},
+                {NULL,NULL},
+            };
+
+            luaL_newlibtable(L, l);
+            //null sentinel, upvalue of all functions
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, -3, "null");
+            luaL_setfuncs(L, l, 1);
+            return 1;
+        }
+
+    private:
+        /*
+            decode(data, values, errors): decode all replies of data, the i-th reply is values[i],
+            errors[i] is the message of an error reply, else nil. returns the number of replies.
+            malformed or incomplete data raises error.
+        */
+        static int decode(lua_State* L)
+        {
+            size_t size = 0;
+            const char* data = luaL_checklstring(L, 1, &size);
+            luaL_checktype(L, 2, LUA_TTABLE);
+            luaL_checktype(L, 3, LUA_TTABLE);
+            lua_settop(L, 3);
+
+            size_t pos = 0;
+            lua_Integer n = 0;
+            while (pos < size)
+            {
+                bool error = false;
+                pos = decode_value(L, data, size, pos, 0, error);
+                ++n;
+                if (error)
+                {
+                    lua_rawseti(L, 3, n);
+                    lua_pushboolean(L, 0);
+                }
+                else
+                {
+                    lua_pushnil(L);
+                    lua_rawseti(L, 3, n);
+                }
+                lua_rawseti(L, 2, n);
+            }
+            lua_pushinteger(L, n);
+            return 1;
+        }
+
+        //push the value of the element at pos, error reply pushes its message and sets error. returns next pos
+        static size_t decode_value(lua_State* L, const char* data, size_t size, size_t pos, size_t depth, bool& error)
+        {
+            resp::element e;
+            auto res = resp::parse_element(data, size, pos, e);
+            if (res != resp::parse_result::ok)
+            {
+                luaL_error(L, "resp: %s at %d", (res == resp::parse_result::more) ? "incomplete reply" : "protocol error", static_cast<int>(pos));
+            }
+
+            //element is validated by parse_element
+            error = false;
+            switch (e.type)
+            {
+            case '+':
+            case '(':
+                lua_pushlstring(L, e.data, e.size);
+                break;
+            case '-':
+                lua_pushlstring(L, e.data, e.size);
+                error = true;
+                break;
+            case ':':
+            {
+                int64_t v = 0;
+                resp::parse_integer(e.data, e.data + e.size, v);
+                lua_pushinteger(L, static_cast<lua_Integer>(v));
+                break;
+            }
+            case ',':
+            {
+                double v = 0;
+                resp::parse_double(e.data, e.data + e.size, v);
+                lua_pushnumber(L, v);
+                break;
+            }
+            case '#':
+                lua_pushboolean(L, *e.data == 't');
+                break;
+            case '_':
+                push_null(L);
+                break;
+            case '$':
+                if (e.count < 0)
+                {
+                    push_null(L);
+                }
+                else
+                {
+                    lua_pushlstring(L, e.data, e.size);
+                }
+                break;
+            case '!':
+                lua_pushlstring(L, e.data, e.size);
+                error = true;
+                break;
+            case '=':
+                //skip format, as "txt:"
+                lua_pushlstring(L, e.data + 4, e.size - 4);
+                break;
+            default:
+                return decode_aggregate(L, data, size, e, depth);
+            }
+            return e.next;
+        }
+
+        static size_t decode_aggregate(lua_State* L, const char* data, size_t size, const resp::element& e, size_t depth)
+        {
+            if (e.count < 0)
+            {
+                push_null(L);
+                return e.next;
+            }
+            if (depth == resp::MAX_NESTING)
+            {
+                luaL_error(L, "resp: nested too deep");
+            }
+            luaL_checkstack(L, LUA_MINSTACK, NULL);
+
+            size_t pos = e.next;
+            bool error = false;
+            //count is not trusted before its elements are parsed
+            int hint = static_cast<int>(std::min<int64_t>(e.count, static_cast<int64_t>((size - pos) / resp::MIN_ELEMENT_SIZE)));
+            if (e.type == '|')
+            {
+                //skip attribute pairs, decode the value
+                for (int64_t i = 1; i < e.count; ++i)
+                {
+                    pos = decode_value(L, data, size, pos, depth + 1, error);
+                    lua_pop(L, 1);
+                }
+                pos = decode_value(L, data, size, pos, depth + 1, error);
+                if (error)
+                {
+                    wrap_error(L);
+                }
+                return pos;
+            }
+
+            if (e.type == '%')
+            {
+                lua_createtable(L, 0, hint / 2);
+                for (int64_t i = 0; i < e.count; i += 2)
+                {
+                    pos = decode_value(L, data, size, pos, depth + 1, error);
+                    if (error)
+                    {
+                        wrap_error(L);
+                    }
+                    pos = decode_value(L, data, size, pos, depth + 1, error);
+                    if (error)
+                    {
+                        wrap_error(L);
+                    }
+                    lua_rawset(L, -3);
+                }
+                return pos;
+            }
+
+            lua_createtable(L, hint, 0);
+            for (int64_t i = 1; i <= e.count; ++i)
+            {
+                pos = decode_value(L, data, size, pos, depth + 1, error);
+                if (error)
+                {
+                    wrap_error(L);
+                }
+                lua_rawseti(L, -2, static_cast<lua_Integer>(i));
+            }
+            return pos;
+        }
+
+        static void push_null(lua_State* L)
+        {
+            lua_pushvalue(L, lua_upvalueindex(1));
+        }
+
+        //error message on top -> {false, message}
+        static void wrap_error(lua_State* L)
+        {
+            lua_createtable(L, 2, 0);
+            lua_pushboolean(L, 0);
+            lua_rawseti(L, -2, 1);
+            lua_insert(L, -2);
+            lua_rawseti(L, -2, 2);
+        }
+    };
+}
@@ -3,6 +3,7 @@
 #include "config.h"
 #include "common/buffer.hpp"
 #include "common/buffer_view.hpp"
+#include "lua_buffer_handle.hpp"
 
 #define TYPE_NIL 0
 #define TYPE_BOOLEAN 1
@@ -21,6 +22,8 @@
 // hibits 0~31 : len
 #define TYPE_LONG_STRING 5
 #define TYPE_TABLE 6
+// hibits as TYPE_TABLE, then uint32 hash count, hash part has no nil end
+#define TYPE_TABLE_HASH 7
 
 #define MAX_COOKIE 32
 #define COMBINE_TYPE(t,v) ((t) | (v) << 3)
@@ -33,30 +36,25 @@ namespace moon
     class lua_serialize
     {
     public:
-        static constexpr int32_t HEAP_BUFFER = 1;
-        
+        //scratch buffer is being used, pack reentered by __pairs metamethod or __gc
+        static constexpr int32_t SCRATCH_BUSY = 1;
+        //scratch buffer grows larger than this is released after pack
+        static constexpr size_t MAX_SCRATCH_SIZE = 1024 * 1024;
+        //type byte + qword
+        static constexpr size_t MAX_NUMBER_SIZE = 9;
+        //numbers of array fast path check space once
+        static constexpr int NUMBER_RUN = 1024;
+        //pack/concat result not larger than this is a lua string: cheaper than a buffer handle, which needs __gc
+        static constexpr size_t MAX_STRING_RESULT = 4096;
+
         static int pack(lua_State* L)
         {
-            auto buf = new buffer(64, BUFFER_HEAD_RESERVED);
-            buf->set_flag(HEAP_BUFFER);
-            int n = lua_gettop(L);
-            for (int i = 1; i <= n; i++) {
-                pack_one(L, buf, i, 0);
-            }
-            buf->clear_flag(HEAP_BUFFER);
-            lua_pushlightuserdata(L, buf);
-            return 1;
+            return write_all(L, pack_one, false);
         }
 
         static int packstring(lua_State* L)
         {
-            buffer buf;
-            int n = lua_gettop(L);
-            for (int i = 1; i <= n; i++) {
-                pack_one(L, &buf, i, 0);
-            }
-            lua_pushlstring(L, buf.data(), buf.size());
-            return 1;
+            return write_all(L, pack_one, true);
         }
 
         static int unpack(lua_State* L)
@@ -72,12 +70,30 @@ namespace moon
                 pdata = lua_tolstring(L, 1, &sz);
                 len = (int)sz;
             }
-            else
+            else if (auto h = lua_buffer_handle::test(L, 1); h != nullptr)
+            {
+                if (nullptr == h->buf) {
+                    return 0;
+                }
+                pdata = h->buf->data();
+                len = (int)h->buf->size();
+            }
+            else if (auto v = lua_buffer_view::test(L, 1); v != nullptr)
+            {
+                pdata = v->data;
+                len = (int)v->size;
+            }
+            else if (lua_type(L, 1) == LUA_TLIGHTUSERDATA)
             {
+                //message:buffer()
                 buffer* buf = (buffer*)lua_touserdata(L, 1);
                 pdata = buf->data();
                 len = (int)buf->size();
             }
+            else
+            {
+                return luaL_argerror(L, 1, "string, buffer, buffer view or message:buffer() expected");
+            }
 
             if (len == 0) {
                 return 0;
@@ -110,26 +126,12 @@ namespace moon
 
         static int concat(lua_State* L)
         {
-            auto buf = new buffer(64, BUFFER_HEAD_RESERVED);
-            buf->set_flag(HEAP_BUFFER);
-            int n = lua_gettop(L);
-            for (int i = 1; i <= n; i++) {
-                concat_one(L, buf, i, 0);
-            }
-            buf->clear_flag(HEAP_BUFFER);
-            lua_pushlightuserdata(L, buf);
-            return 1;
+            return write_all(L, concat_one, false);
         }
 
         static int concatstring(lua_State *L)
         {
-            buffer buf;
-            int n = lua_gettop(L);
-            for (int i = 1; i <= n; i++) {
-                concat_one(L, &buf, i, 0);
-            }
-            lua_pushlstring(L, buf.data(), buf.size());
-            return 1;
+            return write_all(L, concat_one, true);
         }
 
         static int open(lua_State *L)
@@ -143,10 +145,104 @@ namespace moon
                 {NULL,NULL},
             };
 
-            luaL_newlib(L, l);
+            luaL_newlibtable(L, l);
+            //per lua state scratch buffer, upvalue of all functions
+            new (lua_newuserdata(L, sizeof(buffer))) buffer(BLOCK_SIZE);
+            lua_createtable(L, 0, 1);
+            lua_pushcfunction(L, scratch_gc);
+            lua_setfield(L, -2, "__gc");
+            lua_setmetatable(L, -2);
+            luaL_setfuncs(L, l, 1);
+            return 1;
+        }
+
+    private:
+        using write_one = void(*)(lua_State*, buffer*, int, int);
+
+        //write all args, push a lua string or a buffer handle
+        static int write_all(lua_State* L, write_one fn, bool string)
+        {
+            int n = lua_gettop(L);
+            buffer* scratch = acquire_scratch(L);
+            if (nullptr == scratch)
+            {
+                if (string)
+                {
+                    buffer buf;
+                    for (int i = 1; i <= n; i++) {
+                        fn(L, &buf, i, 0);
+                    }
+                    lua_pushlstring(L, buf.data(), buf.size());
+                    return 1;
+                }
+                //handle owns the buffer before writing, lua errors can't leak it
+                auto h = lua_buffer_handle::push(L);
+                h->buf = std::make_shared<buffer>(64, BUFFER_HEAD_RESERVED);
+                for (int i = 1; i <= n; i++) {
+                    fn(L, h->buf.get(), i, 0);
+                }
+                lua_buffer_handle::account(L, h->buf->size());
+                return 1;
+            }
+
+            for (int i = 1; i <= n; i++) {
+                fn(L, scratch, i, 0);
+            }
+            //a lua memory error here leaves scratch busy, later calls use the fallback above
+            if (string || scratch->size() <= MAX_STRING_RESULT)
+            {
+                lua_pushlstring(L, scratch->data(), scratch->size());
+            }
+            else
+            {
+                auto h = lua_buffer_handle::push(L);
+                //one allocation of the exact size
+                h->buf = std::make_shared<buffer>(scratch->size(), BUFFER_HEAD_RESERVED);
+                h->buf->write_back(scratch->data(), 0, scratch->size());
+            }
+            size_t size = scratch->size();
+            release_scratch(scratch);
+            if (!string && size > MAX_STRING_RESULT)
+            {
+                lua_buffer_handle::account(L, size);
+            }
             return 1;
         }
 
+        static int scratch_gc(lua_State* L)
+        {
+            static_cast<buffer*>(lua_touserdata(L, 1))->~buffer();
+            return 0;
+        }
+
+        //nullptr if no scratch buffer or it is being used
+        static buffer* acquire_scratch(lua_State* L)
+        {
+            auto scratch = static_cast<buffer*>(lua_touserdata(L, lua_upvalueindex(1)));
+            if (nullptr == scratch || scratch->has_flag(SCRATCH_BUSY))
+            {
+                return nullptr;
+            }
+            scratch->clear();
+            scratch->set_flag(SCRATCH_BUSY);
+            return scratch;
+        }
+
+        static void release_scratch(buffer* scratch)
+        {
+            scratch->clear_flag(SCRATCH_BUSY);
+            if (scratch->max_size() > MAX_SCRATCH_SIZE)
+            {
+                *scratch = buffer(BLOCK_SIZE);
+            }
+        }
+
+        //before raise lua error
+        static void release(buffer* b)
+        {
+            b->clear_flag(SCRATCH_BUSY);
+        }
+
     public:
         static void wb_nil(buffer* buf)
         {
@@ -160,48 +256,51 @@ namespace moon
             buf->write_back(&n);
         }
 
-        static void wb_integer(buffer* buf, lua_Integer v) {
+        //write type byte and value to p, space is checked by caller. return end of written
+        template<typename T>
+        static char* put(char* p, uint8_t type, T v) {
+            *p = (char)type;
+            memcpy(p + 1, &v, sizeof(T));
+            return p + 1 + sizeof(T);
+        }
+
+        static char* put_integer(char* p, lua_Integer v) {
             int type = TYPE_NUMBER;
             if (v == 0) {
-                uint8_t n = (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_ZERO);
-                buf->write_back(&n);
+                *p = (char)COMBINE_TYPE(type, TYPE_NUMBER_ZERO);
+                return p + 1;
             }
             else if (v != (int32_t)v) {
-                uint8_t n = (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_QWORD);
-                int64_t v64 = v;
-                buf->write_back(&n);
-                buf->write_back(&v64);
+                return put(p, (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_QWORD), (int64_t)v);
             }
             else if (v < 0) {
-                int32_t v32 = (int32_t)v;
-                uint8_t n = (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_DWORD);
-                buf->write_back(&n);
-                buf->write_back(&v32);
+                return put(p, (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_DWORD), (int32_t)v);
             }
             else if (v < 0x100) {
-                uint8_t n = (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_BYTE);
-                buf->write_back(&n);
-                uint8_t byte = (uint8_t)v;
-                buf->write_back(&byte);
+                return put(p, (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_BYTE), (uint8_t)v);
             }
             else if (v < 0x10000) {
-                uint8_t n = (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_WORD);
-                buf->write_back(&n);
-                uint16_t word = (uint16_t)v;
-                buf->write_back(&word);
+                return put(p, (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_WORD), (uint16_t)v);
             }
             else {
-                uint8_t n = (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_DWORD);
-                buf->write_back(&n);
-                uint32_t v32 = (uint32_t)v;
-                buf->write_back(&v32);
+                return put(p, (uint8_t)COMBINE_TYPE(type, TYPE_NUMBER_DWORD), (uint32_t)v);
             }
         }
 
+        static char* put_real(char* p, double v) {
+            return put(p, (uint8_t)COMBINE_TYPE(TYPE_NUMBER, TYPE_NUMBER_REAL), v);
+        }
+
+        static void wb_integer(buffer* buf, lua_Integer v) {
+            buf->check_space(MAX_NUMBER_SIZE);
+            char* p = std::addressof(*buf->end());
+            buf->offset_writepos((int)(put_integer(p, v) - p));
+        }
+
         static void wb_real(buffer* buf, double v) {
-            uint8_t n = COMBINE_TYPE(TYPE_NUMBER, TYPE_NUMBER_REAL);
-            buf->write_back(&n);
-            buf->write_back(&v);
+            buf->check_space(MAX_NUMBER_SIZE);
+            char* p = std::addressof(*buf->end());
+            buf->offset_writepos((int)(put_real(p, v) - p));
         }
 
         static void wb_pointer(buffer* buf, void *v) {
@@ -238,7 +337,7 @@ namespace moon
 
         static void pack_one(lua_State *L, buffer* b, int index, int depth) {
             if (depth > MAX_DEPTH) {
-                if(b->has_flag(HEAP_BUFFER)) delete b;
+                release(b);
                 luaL_error(L, "serialize can't pack too depth table");
                 return;
             }
@@ -278,26 +377,56 @@ namespace moon
                 break;
             }
             default:
-                if (b->has_flag(HEAP_BUFFER)) delete b;
+                release(b);
                 luaL_error(L, "Unsupport type %s to serialize", lua_typename(L, type));
             }
         }
 
-        static int wb_table_array(lua_State *L, buffer* buf, int index, int depth) {
+        //pack numbers from array[i] until a non number value, check space once. return last packed index
+        static int wb_number_run(lua_State *L, buffer* buf, int index, int i, int array_size) {
+            int last = std::min(array_size, i + NUMBER_RUN - 1);
+            buf->check_space((size_t)(last - i + 1) * MAX_NUMBER_SIZE);
+            char* begin = std::addressof(*buf->end());
+            char* p = begin;
+            for (;;) {
+                //array[i] is number, on stack top
+                p = lua_isinteger(L, -1) ? put_integer(p, lua_tointeger(L, -1)) : put_real(p, lua_tonumber(L, -1));
+                lua_pop(L, 1);
+                if (i == last) {
+                    break;
+                }
+                if (lua_rawgeti(L, index, i + 1) != LUA_TNUMBER) {
+                    lua_pop(L, 1);
+                    break;
+                }
+                ++i;
+            }
+            buf->offset_writepos((int)(p - begin));
+            return i;
+        }
+
+        //write table header and array part, hash count slot offset is returned by hash_slot
+        static int wb_table_array(lua_State *L, buffer* buf, int index, int depth, size_t& hash_slot) {
             int array_size = (int)lua_rawlen(L, index);
             if (array_size >= MAX_COOKIE - 1) {
-                uint8_t n = (uint8_t)COMBINE_TYPE(TYPE_TABLE, MAX_COOKIE - 1);
+                uint8_t n = (uint8_t)COMBINE_TYPE(TYPE_TABLE_HASH, MAX_COOKIE - 1);
                 buf->write_back(&n);
                 wb_integer(buf, array_size);
             }
             else {
-                uint8_t n = (uint8_t)COMBINE_TYPE(TYPE_TABLE, array_size);
+                uint8_t n = (uint8_t)COMBINE_TYPE(TYPE_TABLE_HASH, array_size);
                 buf->write_back(&n);
             }
 
-            int i;
-            for (i = 1; i <= array_size; i++) {
-                lua_rawgeti(L, index, i);
+            hash_slot = buf->size();
+            uint32_t hash_size = 0;
+            buf->write_back(&hash_size);
+
+            for (int i = 1; i <= array_size; i++) {
+                if (lua_rawgeti(L, index, i) == LUA_TNUMBER) {
+                    i = wb_number_run(L, buf, index, i, array_size);
+                    continue;
+                }
                 pack_one(L, buf, -1, depth);
                 lua_pop(L, 1);
             }
@@ -305,7 +434,8 @@ namespace moon
             return array_size;
         }
 
-        static void wb_table_hash(lua_State *L, buffer* buf, int index, int depth, int array_size) {
+        static void wb_table_hash(lua_State *L, buffer* buf, int index, int depth, int array_size, size_t hash_slot) {
+            uint32_t hash_size = 0;
             lua_pushnil(L);
             while (lua_next(L, index) != 0) {
                 if (lua_type(L, -2) == LUA_TNUMBER) {
@@ -320,20 +450,29 @@ namespace moon
                 pack_one(L, buf, -2, depth);
                 pack_one(L, buf, -1, depth);
                 lua_pop(L, 1);
+                ++hash_size;
+            }
+            memcpy(buf->data() + hash_slot, &hash_size, sizeof(hash_size));
+        }
+
+        //lua_call, release buffer before rethrow error
+        static void call(lua_State *L, buffer* buf, int nargs, int nresults) {
+            if (lua_pcall(L, nargs, nresults, 0) != LUA_OK) {
+                release(buf);
+                lua_error(L);
             }
-            wb_nil(buf);
         }
 
         static void wb_table_metapairs(lua_State *L, buffer* buf, int index, int depth) {
             uint8_t n = COMBINE_TYPE(TYPE_TABLE, 0);
             buf->write_back(&n, 0, 1);
             lua_pushvalue(L, index);
-            lua_call(L, 1, 3);
+            call(L, buf, 1, 3);
             for (;;) {
                 lua_pushvalue(L, -2);
                 lua_pushvalue(L, -2);
                 lua_copy(L, -5, -3);
-                lua_call(L, 2, 2);
+                call(L, buf, 2, 2);
                 int type = lua_type(L, -2);
                 if (type == LUA_TNIL) {
                     lua_pop(L, 4);
@@ -356,8 +495,9 @@ namespace moon
                 wb_table_metapairs(L, buf, index, depth);
             }
             else {
-                int array_size = wb_table_array(L, buf, index, depth);
-                wb_table_hash(L, buf, index, depth, array_size);
+                size_t hash_slot = 0;
+                int array_size = wb_table_array(L, buf, index, depth, hash_slot);
+                wb_table_hash(L, buf, index, depth, array_size, hash_slot);
             }
         }
 
@@ -431,7 +571,7 @@ namespace moon
             push_value(L, buf, type & 0x7, type >> 3);
         }
 
-        static void unpack_table(lua_State *L, buffer_view* buf, int array_size) {
+        static int get_array_size(lua_State *L, buffer_view* buf, int array_size) {
             if (array_size == MAX_COOKIE - 1) {
                 uint8_t type{};
                 if (!buf->read(&type))
@@ -442,6 +582,34 @@ namespace moon
                 }
                 array_size = (int)get_integer(L, buf, cookie);
             }
+            //every value takes one byte at least
+            if (array_size < 0 || (size_t)array_size > buf->size()) {
+                invalid_stream(L, buf);
+            }
+            return array_size;
+        }
+
+        static void unpack_table_hash(lua_State *L, buffer_view* buf, int array_size) {
+            array_size = get_array_size(L, buf, array_size);
+            uint32_t hash_size{};
+            if (!buf->read(&hash_size) || hash_size > buf->size() / 2) {
+                invalid_stream(L, buf);
+            }
+            luaL_checkstack(L, LUA_MINSTACK, NULL);
+            lua_createtable(L, array_size, (int)hash_size);
+            for (int i = 1; i <= array_size; i++) {
+                unpack_one(L, buf);
+                lua_rawseti(L, -2, i);
+            }
+            for (uint32_t i = 0; i < hash_size; i++) {
+                unpack_one(L, buf);
+                unpack_one(L, buf);
+                lua_rawset(L, -3);
+            }
+        }
+
+        static void unpack_table(lua_State *L, buffer_view* buf, int array_size) {
+            array_size = get_array_size(L, buf, array_size);
             luaL_checkstack(L, LUA_MINSTACK, NULL);
             lua_createtable(L, array_size, 0);
             int i;
@@ -505,6 +673,10 @@ namespace moon
                 unpack_table(L, buf, cookie);
                 break;
             }
+            case TYPE_TABLE_HASH: {
+                unpack_table_hash(L, buf, cookie);
+                break;
+            }
             default: {
                 invalid_stream(L, buf);
                 break;
@@ -541,7 +713,7 @@ namespace moon
         static void concat_one(lua_State *L, buffer* b, int index, int depth)
         {
             if (depth > MAX_DEPTH) {
-                if(b->has_flag(HEAP_BUFFER)) delete b;
+                release(b);
                 luaL_error(L, "serialize can't concat too depth table");
                 return;
             }
@@ -587,7 +759,7 @@ namespace moon
                 break;
             }
             default:
-                if (b->has_flag(HEAP_BUFFER)) delete b;
+                release(b);
                 luaL_error(L, "Unsupport type %s to concat", lua_typename(L, type));
             }
         }
@@ -54,6 +54,14 @@ namespace moon
             }
         }
 
+        //remove all timers without callback
+        void clear()
+        {
+            clear_wheels();
+            timers_.clear();
+            uuid_ = 0;
+        }
+
         void set_remove_timer(const std::function<void(timer_id_t)>& v)
         {
             on_remove_ = v;
@@ -120,8 +120,8 @@ int main(int argc, char*argv[])
 
             lua["package"]["loaded"]["moon_core"] = module;
 
-            router_->register_service("lua", []()->service_ptr_t {
-                return std::make_unique<lua_service>();
+            router_->register_service("lua", [](const string_view_t& config)->service_ptr_t {
+                return lua_service::create(config);
             });
 
 #if TARGET_PLATFORM == PLATFORM_WINDOWS
@@ -140,9 +140,34 @@ int main(int argc, char*argv[])
             router_->set_env("outer_host", c->outer_host);
             router_->set_env("server_config", scfg.config());
 
+            server_->logger()->set_rotate(static_cast<size_t>(c->log_max_size) * 1024 * 1024, c->log_rotate_interval);
+            server_->logger()->set_drop_level(c->log_drop_level);
+            server_->logger()->set_binary(c->log_binary);
             server_->init(static_cast<uint8_t>(c->thread), c->log);
             server_->logger()->set_level(c->loglevel);
 
+            if (!c->cluster_port.empty())
+            {
+                auto cluster_ = server_->get_cluster();
+                if (!c->cluster_registry.empty())
+                {
+                    //nodes come from registry instead of config file
+                    cluster_->watch_registry(c->cluster_registry, c->cluster_registry_interval);
+                }
+                else
+                {
+                    scfg.for_all([cluster_](const server_config& n) {
+                        if (!n.cluster_port.empty())
+                        {
+                            cluster_->add_node(n.name, n.cluster_host, n.cluster_port);
+                        }
+                    });
+                }
+                cluster_->set_flush(static_cast<size_t>(c->cluster_flush_size), c->cluster_flush_delay);
+                cluster_->set_call_timeout(c->cluster_call_timeout);
+                MOON_CHECK(cluster_->start(c->name, c->cluster_host, c->cluster_port), "start cluster failed");
+            }
+
             if (!c->startup.empty())
             {
                 MOON_CHECK(fs::path(c->startup).extension() == ".lua", "startup file must be lua script.");
@@ -157,6 +182,7 @@ int main(int argc, char*argv[])
                 MOON_CHECK(0 != router_->new_service(s.type, s.unique, s.shared, s.threadid, s.config), "new_service failed");
             }
             server_->run();
+            lua_service::clear_pool();
         }
         catch (std::exception& e)
         {
@@ -1,5 +1,6 @@
 #pragma once
 #include "config.h"
+#include "cluster.h"
 #include "common/string.hpp"
 #include "common/exception.hpp"
 #include "rapidjson/cursorstreamwrapper.h"
@@ -32,7 +33,25 @@ namespace moon
         std::string inner_host;
         std::string startup;
         std::string log;
+        //log rotation, see log::set_rotate. MB and seconds, 0: no limit
+        int64_t log_max_size = 0;
+        int64_t log_rotate_interval = 0;
+        //level dropped when logging faster than the log file is written
+        std::string log_drop_level;
+        //binary log file, read with tools/log_decoder
+        bool log_binary = false;
         std::string path;
+        //native cluster listen address, empty: not a cluster node
+        std::string cluster_host;
+        std::string cluster_port;
+        //write coalescing of cluster links, see cluster::set_flush
+        int64_t cluster_flush_size = cluster::DEFAULT_FLUSH_SIZE;
+        int64_t cluster_flush_delay = cluster::DEFAULT_FLUSH_DELAY;
+        //file of nodes joining and leaving at runtime, see cluster::watch_registry
+        std::string cluster_registry;
+        int64_t cluster_registry_interval = cluster::DEFAULT_REGISTRY_INTERVAL;
+        //milliseconds, 0: calls wait response forever
+        int64_t cluster_call_timeout = 0;
         std::vector<service_config> services;
     };
 
@@ -126,6 +145,26 @@ namespace moon
                     scfg.startup = rapidjson::get_value<std::string>(&c, "startup");
                     scfg.log = rapidjson::get_value<std::string>(&c, "log");
                     scfg.loglevel = rapidjson::get_value<std::string>(&c, "loglevel", "DEBUG");
+                    scfg.log_max_size = rapidjson::get_value<int64_t>(&c, "log_max_size", 0);
+                    scfg.log_rotate_interval = rapidjson::get_value<int64_t>(&c, "log_rotate_interval", 0);
+                    MOON_CHECK(scfg.log_max_size >= 0 && scfg.log_rotate_interval >= 0, "Server config format error: log_max_size and log_rotate_interval must >= 0");
+                    scfg.log_drop_level = rapidjson::get_value<std::string>(&c, "log_drop_level", "DEBUG");
+                    scfg.log_binary = rapidjson::get_value<bool>(&c, "log_binary", false);
+                    if (auto cluster = rapidjson::get_value<rapidjson::Value*>(&c, "cluster", nullptr); nullptr != cluster)
+                    {
+                        MOON_CHECK(cluster->IsObject(), "Server config format error: cluster must be object");
+                        scfg.cluster_host = rapidjson::get_value<std::string>(cluster, "host", scfg.inner_host);
+                        scfg.cluster_port = rapidjson::get_value<std::string>(cluster, "port");
+                        MOON_CHECK(!scfg.cluster_port.empty(), "Server config format error: cluster must has port");
+                        scfg.cluster_flush_size = rapidjson::get_value<int64_t>(cluster, "flush_size", scfg.cluster_flush_size);
+                        scfg.cluster_flush_delay = rapidjson::get_value<int64_t>(cluster, "flush_delay", scfg.cluster_flush_delay);
+                        MOON_CHECK(scfg.cluster_flush_size > 0 && scfg.cluster_flush_delay >= 0, "Server config format error: cluster flush_size must > 0, flush_delay must >= 0");
+                        scfg.cluster_registry = rapidjson::get_value<std::string>(cluster, "registry");
+                        scfg.cluster_registry_interval = rapidjson::get_value<int64_t>(cluster, "registry_interval", scfg.cluster_registry_interval);
+                        MOON_CHECK(scfg.cluster_registry_interval > 0, "Server config format error: cluster registry_interval must > 0");
+                        scfg.cluster_call_timeout = rapidjson::get_value<int64_t>(cluster, "call_timeout", scfg.cluster_call_timeout);
+                        MOON_CHECK(scfg.cluster_call_timeout >= 0, "Server config format error: cluster call_timeout must >= 0");
+                    }
                     auto array_path  = rapidjson::get_value<std::vector<std::string_view>>(&c, "path");
                     auto array_cpath = rapidjson::get_value<std::vector<std::string_view>>(&c, "cpath");
 
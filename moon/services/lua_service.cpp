@@ -1,9 +1,11 @@
 #include "lua_service.h"
+#include <mutex>
 #include "message.hpp"
 #include "router.h"
 #include "common/hash.hpp"
 #include "rapidjson/document.h"
 #include "luabind/lua_serialize.hpp"
+#include "luabind/lua_resp.hpp"
 #include "service_config.hpp"
 
 using namespace moon;
@@ -31,20 +33,110 @@ void * lua_service::lalloc(void * ud, void *ptr, size_t osize, size_t nsize) {
         CONSOLE_WARN(l->logger(), "%s Memory warning %.2f M", l->name().data(), (float)l->mem / (1024 * 1024));
     }
 
+#ifdef MOON_LUA_SYSTEM_ALLOC
     if (nsize == 0)
     {
         free(ptr);
         return NULL;
     }
-    else
+    void* res = realloc(ptr, nsize);
+#else
+    if (nsize == 0)
+    {
+        l->allocator_.deallocate(ptr, osize);
+        return NULL;
+    }
+    //osize is object type if ptr is NULL
+    void* res = l->allocator_.reallocate(ptr, (ptr != NULL) ? osize : 0, nsize);
+#endif
+    if (res == NULL)
+    {
+        l->mem = mem;
+    }
+    return res;
+}
+
+//process-wide memo of luafile lookups, key: luafile and search paths
+static std::mutex find_file_mutex;
+static std::unordered_map<std::string, std::string> find_file_memo;
+
+std::string lua_service::find_luafile(const std::string& luafile, const std::vector<std::string_view>& paths)
+{
+    std::string key = luafile;
+    for (auto& p : paths)
+    {
+        key.append(";");
+        key.append(p.data(), p.size());
+    }
+
+    {
+        std::unique_lock<std::mutex> lck(find_file_mutex);
+        if (auto iter = find_file_memo.find(key); iter != find_file_memo.end())
+        {
+            //file may be moved or removed
+            if (directory::exists(iter->second))
+            {
+                return iter->second;
+            }
+            find_file_memo.erase(iter);
+        }
+    }
+
+    std::string file;
+    for (auto& p : paths)
+    {
+        file = directory::find_file(fs::path(p).parent_path().string(), luafile);
+        if (!file.empty())
+        {
+            break;
+        }
+    }
+
+    if (!file.empty())
+    {
+        std::unique_lock<std::mutex> lck(find_file_mutex);
+        find_file_memo.emplace(key, file);
+    }
+    return file;
+}
+
+void lua_service::clear_script_cache()
+{
     {
-        return realloc(ptr, nsize);
+        std::unique_lock<std::mutex> lck(find_file_mutex);
+        find_file_memo.clear();
+    }
+
+    //pooled services run the old scripts
+    clear_pool();
+
+    sol::optional<sol::table> cc = lua_["package"]["loaded"]["codecache"];
+    if (cc)
+    {
+        (*cc)["clear"]();
     }
 }
 
 void lua_service::runcmd(uint32_t sender, const std::string & cmd, int32_t responseid)
 {
     auto params = moon::split<std::string>(cmd, ".");
+    //builtin: service.sid.clear_script_cache, for hot reload
+    if (params[2] == "clear_script_cache")
+    {
+        clear_script_cache();
+        get_router()->make_response(sender, "", "ok", responseid);
+        return;
+    }
+
+    //builtin: service.sid.gc, memory and gc time(ms)
+    if (params[2] == "gc")
+    {
+        auto[total, idle] = gc_time();
+        auto content = moon::format(R"({"name":"%s","serviceid":%u,"mem":%zu,"gctime":%.3f,"idle_gctime":%.3f})", name().data(), id(), mem, total, idle);
+        get_router()->make_response(sender, "", content, responseid);
+        return;
+    }
+
     if (auto iter = commands_.find(params[2]); iter != commands_.end())
     {
         get_router()->make_response(sender, "", iter->second(params), responseid);
@@ -60,7 +152,6 @@ const fs::path& lua_service::work_path()
 lua_service::lua_service()
     :error_(true)
     , lua_(sol::default_at_panic, lalloc, this)
-    , cache_uuid_(0)
 {
 }
 
@@ -68,6 +159,100 @@ lua_service::~lua_service()
 {
 }
 
+//process-wide idle services, key: luafile
+static std::mutex service_pool_mutex;
+static std::unordered_map<std::string, std::vector<lua_service*>> service_pool;
+
+service_ptr_t lua_service::create(const string_view_t& config)
+{
+    if (config.find("\"pool\""sv) != string_view_t::npos)
+    {
+        rapidjson::Document doc;
+        doc.Parse(config.data(), config.size());
+        if (!doc.HasParseError() && doc.IsObject() && rapidjson::get_value<int32_t>(&doc, "pool", 0) > 0)
+        {
+            auto luafile = rapidjson::get_value<std::string>(&doc, "file");
+            std::unique_lock<std::mutex> lck(service_pool_mutex);
+            if (auto iter = service_pool.find(luafile); iter != service_pool.end() && !iter->second.empty())
+            {
+                lua_service* s = iter->second.back();
+                iter->second.pop_back();
+                return service_ptr_t{ s };
+            }
+        }
+    }
+    return std::make_unique<lua_service>();
+}
+
+void lua_service::clear_pool()
+{
+    std::unordered_map<std::string, std::vector<lua_service*>> pool;
+    {
+        std::unique_lock<std::mutex> lck(service_pool_mutex);
+        pool.swap(service_pool);
+    }
+
+    for (auto& it : pool)
+    {
+        for (auto s : it.second)
+        {
+            delete s;
+        }
+    }
+}
+
+bool lua_service::recycle()
+{
+    if (pool_size_ == 0 || error_ || socket_used_ || !reset_.valid())
+    {
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> lck(service_pool_mutex);
+        if (service_pool[pool_key_].size() >= pool_size_)
+        {
+            return false;
+        }
+    }
+
+    try
+    {
+        //user hook wipes module state, return true if the service can be reused
+        auto result = reset_();
+        if (!result.valid())
+        {
+            sol::error err = result;
+            CONSOLE_ERROR(logger(), "%s", err.what());
+            return false;
+        }
+
+        if (!result.get<bool>())
+        {
+            return false;
+        }
+    }
+    catch (std::exception& e)
+    {
+        CONSOLE_ERROR(logger(), "lua_service::recycle :%s\n", e.what());
+        return false;
+    }
+
+    timer_.clear();
+    lua_gc(lua_.lua_state(), LUA_GCCOLLECT, 0);
+    started(false);
+    reused_ = true;
+
+    std::unique_lock<std::mutex> lck(service_pool_mutex);
+    auto& pool = service_pool[pool_key_];
+    if (pool.size() >= pool_size_)
+    {
+        return false;
+    }
+    pool.push_back(this);
+    return true;
+}
+
 moon::tcp * lua_service::get_tcp(const std::string& protocol)
 {
     uint8_t v = 0;
@@ -98,30 +283,34 @@ moon::tcp * lua_service::get_tcp(const std::string& protocol)
     {
         p = add_component<moon::tcp>(protocol);
     }
+
+    bind_socket();
     p->setprotocol(v);
     return ((p != nullptr) ? p.get() : nullptr);
 }
 
-uint32_t lua_service::make_cache(const moon::buffer_ptr_t & buf)
+//buf is a cache made by make_cache, it lives as long as lua references it
+void lua_service::send_cache(uint32_t receiver, const moon::buffer_ptr_t& buf, const string_view_t& header, int32_t responseid, uint8_t type) const
 {
-    auto iter = caches_.emplace(cache_uuid_++, buf);
-    if (iter.second)
-    {
-        return iter.first->first;
-    }
-    return 0;
+    get_router()->send(id(), receiver, buf, header, responseid, type);
 }
 
-void lua_service::send_cache(uint32_t receiver, uint32_t cacheid, const string_view_t& header, int32_t responseid, uint8_t type) const
+void lua_service::bind_socket()
 {
-    auto iter = caches_.find(cacheid);
-    if (iter == caches_.end())
+    //tcp usertype is bound by the first get_tcp, most services never use it.
+    //get_tcp called by config parse before moon_core created, it is bound in init.
+    socket_used_ = true;
+    if (socket_bound_)
     {
-        CONSOLE_DEBUG(logger(), "send_cache failed, can not find cache data id %s", cacheid);
         return;
     }
 
-    get_router()->send(id(), receiver, iter->second, header, responseid, type);
+    sol::optional<sol::table> module = lua_["package"]["loaded"]["moon_core"];
+    if (module)
+    {
+        lua_bind(module.value()).bind_socket();
+        socket_bound_ = true;
+    }
 }
 
 void lua_service::set_init(sol_function_t f)
@@ -149,6 +338,11 @@ void lua_service::set_destroy(sol_function_t f)
     destroy_ = f;
 }
 
+void lua_service::set_reset(sol_function_t f)
+{
+    reset_ = f;
+}
+
 void lua_service::set_on_timer(sol_function_t f)
 {
     timer_.set_on_timer([this, f](timer_id_t tid) {
@@ -207,77 +401,92 @@ bool lua_service::init(const string_view_t& config)
     }
 
     mem_limit = static_cast<size_t>(scfg.get_value<int64_t>("memlimit"));
+    pool_size_ = static_cast<size_t>(scfg.get_value<int32_t>("pool"));
+    pool_key_ = luafile;
+
+    //gc policy, set every time: a pooled lua state may keep the last service's
+    {
+        auto L = lua_.lua_state();
+        auto pause = scfg.get_value<int32_t>("gcpause");
+        auto stepmul = scfg.get_value<int32_t>("gcstepmul");
+        //lua 5.3 default pause 200%, stepmul 200
+        lua_gc(L, LUA_GCSETPAUSE, (pause > 0) ? pause : 200);
+        lua_gc(L, LUA_GCSETSTEPMUL, (stepmul > 0) ? stepmul : 200);
+        gc_idle_ = std::max(scfg.get_value<int32_t>("gcidle"), 0);
+        gctime_begin_ = lua_gctime(L);
+        gctime_idle_ = 0;
+    }
 
     {
         try
         {
-            lua_.open_libraries();
-            sol::table module = lua_.create_table();
-            lua_bind lua_bind(module);
-            lua_bind.bind_service(this)
-                .bind_log(logger())
-                .bind_util()
-                .bind_timer(&timer_)
-                .bind_message()
-                .bind_socket()
-                .bind_http();
-
-            lua_.require("fs", luaopen_fs);
-            lua_.require("seri", lua_serialize::open);
-            lua_.require("codecache", luaopen_cache);
-            lua_.require("json", luaopen_rapidjson);
-
-            lua_["package"]["loaded"]["moon_core"] = module;
-
-            auto cpaths = scfg.get_value<std::vector<std::string_view>>("cpath");
+            //reused service: lua state and script are ready, only call init callback
+            if (!reused_)
             {
-                cpaths.emplace_back("./clib");
-                std::string strpath;
-                strpath.append("package.cpath ='");
-                for (auto& v : cpaths)
+                lua_.open_libraries();
+                sol::table module = lua_.create_table();
+                lua_bind lua_bind(module);
+                lua_bind.bind_service(this)
+                    .bind_log(logger())
+                    .bind_util()
+                    .bind_timer(&timer_)
+                    .bind_message()
+                    .bind_lazy();
+
+                lua_.require("fs", luaopen_fs);
+                lua_.require("seri", lua_serialize::open);
+                lua_.require("resp", lua_resp::open);
+                lua_.require("codecache", luaopen_cache);
+                lua_.require("json", luaopen_rapidjson);
+
+                lua_["package"]["loaded"]["moon_core"] = module;
+                if (socket_used_)
                 {
-                    strpath.append(v.data(), v.size());
-                    strpath.append(LUA_CPATH_STR);
+                    bind_socket();
                 }
-                strpath.append("'..package.cpath");
-                lua_.script(strpath);
-            }
 
-            auto paths = scfg.get_value<std::vector<std::string_view>>("path");
-            {
-                paths.emplace_back("./lualib");
-                std::string strpath;
-                strpath.append("package.path ='");
-                for (auto& v : paths)
+                //set package.cpath/path directly, no chunk to compile
+                sol::table package = lua_["package"];
+                auto cpaths = scfg.get_value<std::vector<std::string_view>>("cpath");
                 {
-                    strpath.append(v.data(), v.size());
-                    strpath.append(LUA_PATH_STR);
+                    cpaths.emplace_back("./clib");
+                    std::string strpath;
+                    for (auto& v : cpaths)
+                    {
+                        strpath.append(v.data(), v.size());
+                        strpath.append(LUA_CPATH_STR);
+                    }
+                    strpath.append(package.get<std::string>("cpath"));
+                    package["cpath"] = strpath;
                 }
-                strpath.append("'..package.path");
-                lua_.script(strpath);
-            }
 
-            if (!directory::exists(luafile))
-            {
-                paths.push_back("./");
-                std::string file;
-                for (auto& p : paths)
+                auto paths = scfg.get_value<std::vector<std::string_view>>("path");
                 {
-                    file = directory::find_file(fs::path(p).parent_path().string(), luafile);
-                    if (!file.empty())
+                    paths.emplace_back("./lualib");
+                    std::string strpath;
+                    for (auto& v : paths)
                     {
-                        break;
+                        strpath.append(v.data(), v.size());
+                        strpath.append(LUA_PATH_STR);
                     }
+                    strpath.append(package.get<std::string>("path"));
+                    package["path"] = strpath;
                 }
-                MOON_CHECK(directory::exists(file), moon::format("luafile %s not found", luafile.data()).data());
-                luafile = file;
-            }
 
-            if (auto result = lua_.script_file(luafile);!result.valid())
-            {
-                sol::error err = result;
-                CONSOLE_ERROR(logger(), "%s", err.what());
-                return false;
+                if (!directory::exists(luafile))
+                {
+                    paths.push_back("./");
+                    auto file = find_luafile(luafile, paths);
+                    MOON_CHECK(!file.empty(), moon::format("luafile %s not found", luafile.data()).data());
+                    luafile = file;
+                }
+
+                if (auto result = lua_.script_file(luafile);!result.valid())
+                {
+                    sol::error err = result;
+                    CONSOLE_ERROR(logger(), "%s", err.what());
+                    return false;
+                }
             }
  
             if (init_.valid())
@@ -368,11 +577,6 @@ void lua_service::update()
         {
             CONSOLE_WARN(logger(), "service(%s:%u) timer update takes too long: %" PRId64 "ms", name().data(), id(), n);
         }
-        if (cache_uuid_ != 0)
-        {
-            cache_uuid_ = 0;
-            caches_.clear();
-        }
     }
     catch (std::exception& e)
     {
@@ -447,5 +651,37 @@ size_t lua_service::memory_use()
     return  mem;
 }
 
+std::tuple<double, double> lua_service::gc_time()
+{
+    auto total = lua_gctime(lua_.lua_state()) - gctime_begin_;
+    return std::make_tuple(total / 1000000.0, gctime_idle_ / 1000000.0);
+}
+
+static int gc_idle(lua_State* L)
+{
+    lua_gcidle(L, static_cast<int>(lua_tointeger(L, 1)));
+    return 0;
+}
+
+void lua_service::idle()
+{
+    if (error_ || gc_idle_ == 0)
+    {
+        return;
+    }
+
+    //protected, __gc metamethods may raise error
+    auto L = lua_.lua_state();
+    auto begin = lua_gctime(L);
+    lua_pushcfunction(L, gc_idle);
+    lua_pushinteger(L, gc_idle_);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK)
+    {
+        CONSOLE_ERROR(logger(), "%s idle gc error: %s", name().data(), lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+    gctime_idle_ += lua_gctime(L) - begin;
+}
+
 
 
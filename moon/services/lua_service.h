@@ -1,6 +1,7 @@
 #pragma  once
 #include "service.h"
 #include "common/log.hpp"
+#include "common/slab_allocator.hpp"
 #include "luabind/lua_bind.h"
 #include "luabind/lua_timer.hpp"
 #include "components/tcp/tcp.h"
@@ -29,8 +30,17 @@ public:
 
     ~lua_service();
 
+    //reuse an exited service of the same luafile if config has "pool"
+    static moon::service_ptr_t create(const moon::string_view_t& config);
+
+    //delete all pooled services
+    static void clear_pool();
+
     size_t memory_use();
 
+    //milliseconds spent in gc since init: total, by idle steps
+    std::tuple<double, double> gc_time();
+
     void set_init(sol_function_t f);
 
     void set_start(sol_function_t f);
@@ -41,6 +51,8 @@ public:
 
     void set_destroy(sol_function_t f);
 
+    void set_reset(sol_function_t f);
+
     void set_on_timer(sol_function_t f);
 
     void set_remove_timer(sol_function_t f);
@@ -49,9 +61,7 @@ public:
 
     moon::tcp* get_tcp(const std::string& protocol);
 
-    uint32_t make_cache(const moon::buffer_ptr_t & buf);
-
-    void send_cache(uint32_t receiver, uint32_t cacheid, const  moon::string_view_t& header, int32_t responseid, uint8_t type) const;
+    void send_cache(uint32_t receiver, const moon::buffer_ptr_t& buf, const  moon::string_view_t& header, int32_t responseid, uint8_t type) const;
 
     static const fs::path& work_path();
 private:
@@ -67,26 +77,53 @@ private:
 
     void dispatch(moon::message* msg) override;
 
+    bool recycle() override;
+
+    //pay gc debt in worker idle time, so less gc work runs while dispatching
+    void idle() override;
+
     void error(const std::string& msg);
 
+    void bind_socket();
+
     static void* lalloc(void * ud, void *ptr, size_t osize, size_t nsize);
 
     void runcmd(uint32_t sender, const std::string& cmd, int32_t responseid)  override;
+
+    //clear luafile lookup memo and code cache of all services, scripts changed on disk are reloaded by new services
+    void clear_script_cache();
 public:
     size_t mem = 0;
     size_t mem_limit = 0;
     size_t mem_report = 8 * 1024 * 1024;
 private:
+    static std::string find_luafile(const std::string& luafile, const std::vector<std::string_view>& paths);
+
     bool error_;
+    bool socket_used_ = false;
+    bool socket_bound_ = false;
+    //object is reused from pool, lua state is ready
+    bool reused_ = false;
+    //max pooled services of this luafile, 0: not pooled
+    size_t pool_size_ = 0;
+    std::string pool_key_;
+    //lua memory, declared before lua_: lua state is closed first.
+    //build with MOON_LUA_SYSTEM_ALLOC to use realloc, e.g. for memory checkers
+    moon::slab_allocator allocator_;
+    //max KB of gc debt paid by each idle step, 0: disabled
+    int gc_idle_ = 0;
+    //lua_gctime at init, a pooled lua state keeps counting
+    int64_t gctime_begin_ = 0;
+    //nanoseconds spent in idle steps
+    int64_t gctime_idle_ = 0;
     sol::state lua_;
     sol_function_t init_;
     sol_function_t start_;
     sol_function_t dispatch_;
     sol_function_t exit_;
     sol_function_t destroy_;
+    sol_function_t reset_;
     moon::lua_timer timer_;
-    uint32_t cache_uuid_;
-    std::unordered_map<uint32_t, moon::buffer_ptr_t> caches_;
 
     using command_hander_t = std::function<std::string(const std::vector<std::string>&)>;
     std::unordered_map<std::string, command_hander_t> commands_;
@@ -45,6 +45,25 @@ namespace moon
                     auto n = s->get_tcp(protocol);
                     n->settimeout(timeout);
                     n->set_enable_frame(frame_flag);
+
+                    //"permessage_deflate": true or {"level":1, "server_max_window_bits":15, ...}
+                    if (auto pmd = rapidjson::get_value<rapidjson::Value*>(&v.value, "permessage_deflate", nullptr); nullptr != pmd)
+                    {
+                        ws_deflate_options opt;
+                        opt.enable = pmd->IsObject() ? rapidjson::get_value<bool>(pmd, "enable", true) : rapidjson::detail::get_value<bool>(pmd, false);
+                        if (pmd->IsObject())
+                        {
+                            opt.server_no_context_takeover = rapidjson::get_value<bool>(pmd, "server_no_context_takeover", opt.server_no_context_takeover);
+                            opt.client_no_context_takeover = rapidjson::get_value<bool>(pmd, "client_no_context_takeover", opt.client_no_context_takeover);
+                            opt.server_max_window_bits = rapidjson::get_value<int32_t>(pmd, "server_max_window_bits", opt.server_max_window_bits);
+                            opt.client_max_window_bits = rapidjson::get_value<int32_t>(pmd, "client_max_window_bits", opt.client_max_window_bits);
+                            opt.mem_level = rapidjson::get_value<int32_t>(pmd, "mem_level", opt.mem_level);
+                            opt.level = rapidjson::get_value<int32_t>(pmd, "level", opt.level);
+                            opt.min_size = static_cast<size_t>(rapidjson::get_value<int64_t>(pmd, "min_size", static_cast<int64_t>(opt.min_size)));
+                            opt.max_message_size = static_cast<size_t>(rapidjson::get_value<int64_t>(pmd, "max_message_size", static_cast<int64_t>(opt.max_message_size)));
+                        }
+                        n->set_ws_deflate(opt);
+                    }
                     if (type == "listen")
                     {
                         if (!n->listen(ip, port))
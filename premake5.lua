@@ -91,8 +91,16 @@ project "moon"
     postbuildcommands{"{COPY} %{wks.location}/bin/%{cfg.buildcfg}/%{cfg.buildtarget.name} %{wks.location}/example/"}
     filter { "system:windows" }
         defines {"_WIN32_WINNT=0x0601"}
+        -- websocket permessage-deflate, 需要设置 zlib 环境变量 'ZLIB_HOME'
+        if os.getenv("ZLIB_HOME") then
+            defines {"MOON_ENABLE_ZLIB"}
+            includedirs {os.getenv("ZLIB_HOME").."/include"}
+            libdirs{os.getenv("ZLIB_HOME").."/lib"}
+            links{"zlib"}
+        end
     filter { "system:linux" }
-        links{"dl","pthread","stdc++fs"} --"-static-libstdc++"
+        defines {"MOON_ENABLE_ZLIB"}
+        links{"dl","pthread","stdc++fs","z"} --"-static-libstdc++"
         linkoptions {"-Wl,-rpath=./"}
     filter "configurations:Debug"
         targetsuffix "-d"
@@ -181,3 +189,112 @@ end)
 -- end
 -- )
 -- ----------------------------------------------
+
+-----------------------------------------------------------------------------------
+--[[
+    benchmark 可执行程序
+    @name: benchmark/name.cpp
+    @normaladdon : 平台通用的附加项
+    @linuxaddon : linux下的附加项
+    使用: make name
+]]
+newoption {
+    trigger = "serialize-baseline",
+    value = "REV",
+    description = "lua_serialize_benchmark also runs lua_serialize.hpp of this git revision"
+}
+
+local function add_benchmark(name, normaladdon, linuxaddon)
+    project(name)
+    objdir ("obj/"..name.."/%{cfg.platform}_%{cfg.buildcfg}")
+    location ("build/"..name)
+    kind "ConsoleApp"
+    language "C++"
+    targetdir "bin/%{cfg.buildcfg}"
+    includedirs {"./","./moon","./moon/core","./third"}
+    files {"./benchmark/"..name..".cpp"}
+    defines {"ASIO_STANDALONE"}
+    if normaladdon then
+        normaladdon()
+    end
+    filter { "system:linux" }
+        links{"pthread"}
+        if linuxaddon then
+            linuxaddon()
+        end
+    filter {}
+end
+
+add_benchmark("ws_mask_benchmark")
+add_benchmark("ws_deflate_benchmark", nil, function()
+    defines {"MOON_ENABLE_ZLIB"}
+    links{"z"}
+end)
+add_benchmark("lua_buffer_view_benchmark", function()
+    includedirs {"./third/lua53"}
+    links{"lua53"}
+end, function()
+    links{"dl"}
+    linkoptions {"-Wl,-rpath=./"}
+end)
+add_benchmark("lua_serialize_benchmark", function()
+    includedirs {"./third/lua53"}
+    links{"lua53"}
+    --baseline: lua_serialize.hpp of the git revision, e.g. --serialize-baseline=v0.9
+    local rev = _OPTIONS["serialize-baseline"]
+    if rev then
+        os.mkdir("build/serialize_baseline")
+        if not os.execute("git show "..rev..":moon/luabind/lua_serialize.hpp > build/serialize_baseline/lua_serialize_baseline.hpp") then
+            error("git show "..rev.." failed")
+        end
+        includedirs {"./build/serialize_baseline", "./moon/luabind"}
+        defines {"SERIALIZE_BASELINE"}
+    end
+end, function()
+    links{"dl"}
+    linkoptions {"-Wl,-rpath=./"}
+end)
+add_benchmark("lua_alloc_benchmark", function()
+    includedirs {"./third/lua53"}
+    links{"lua53"}
+end, function()
+    links{"dl"}
+    linkoptions {"-Wl,-rpath=./"}
+end)
+add_benchmark("lua_buffer_handle_test", function()
+    includedirs {"./third/lua53"}
+    links{"lua53"}
+end, function()
+    links{"dl"}
+    buildoptions {"-fsanitize=address"}
+    linkoptions {"-Wl,-rpath=./", "-fsanitize=address"}
+end)
+add_benchmark("resp_parser_test", function()
+    includedirs {"./third/lua53"}
+    links{"lua53"}
+end, function()
+    links{"dl"}
+    buildoptions {"-fsanitize=address"}
+    linkoptions {"-Wl,-rpath=./", "-fsanitize=address"}
+end)
+add_benchmark("log_benchmark", nil, function()
+    links{"stdc++fs"}
+end)
+
+-----------------------------------------------------------------------------------
+--[[
+    工具: 二进制日志文件转文本
+    使用: make log_decoder
+]]
+project "log_decoder"
+    objdir "obj/log_decoder/%{cfg.platform}_%{cfg.buildcfg}"
+    location "build/log_decoder"
+    kind "ConsoleApp"
+    language "C++"
+    targetdir "bin/%{cfg.buildcfg}"
+    includedirs {"./","./moon","./moon/core","./third"}
+    files {"./tools/log_decoder.cpp"}
+    defines {"ASIO_STANDALONE"}
+    filter { "system:linux" }
+        links{"pthread","stdc++fs"}
+    filter {}
@@ -1158,6 +1158,43 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+/* Add by moon */
+LUA_API lua_Integer lua_gctime (lua_State *L) {
+  lua_Integer t;
+  lua_lock(L);
+  t = G(L)->gctime;
+  lua_unlock(L);
+  return t;
+}
+
+
+/*
+** Add by moon. For idle time of the host: if a collection is running,
+** or the next one starts within 'kb' KB, do the GC work of 'kb' KB
+** allocation now and give the same credit, so the following 'kb' KB
+** allocation runs no GC step. Does nothing when the collector is stopped
+** or far from the next cycle. Returns 1 if a cycle finished.
+*/
+LUA_API int lua_gcidle (lua_State *L, int kb) {
+  global_State *g;
+  l_mem credit;
+  int res = 0;
+  lua_lock(L);
+  g = G(L);
+  credit = cast(l_mem, kb) * 1024;
+  if (g->gcrunning && kb > 0 &&
+      (g->gcstate != GCSpause || g->GCdebt > -credit)) {
+    luaE_setdebt(g, (g->GCdebt > 0 ? g->GCdebt : 0) + credit);
+    luaC_step(L);
+    if (g->gcstate == GCSpause)
+      res = 1;  /* cycle finished, pause gives the credit */
+    else if (g->GCdebt > -credit)
+      luaE_setdebt(g, -credit);
+  }
+  lua_unlock(L);
+  return res;
+}
+
 
 /*
 ** miscellaneous functions
@@ -1043,6 +1043,7 @@ LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver, size_t sz) {
 
 // use clonefunction
 
+#include <sys/stat.h>
 #include "spinlock.h"
 
 struct codecache {
@@ -1152,13 +1153,24 @@ static int cache_mode(lua_State *L) {
 	return 0;
 }
 
-LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
-                                             const char *mode) {
-  int level = cache_level(L);
-  if (level == CACHE_OFF) {
-    return luaL_loadfilex_(L, filename, mode);
-  }
-  const void * proto = load(filename);
+/*
+** cache key is filename + mtime + size, an edited script gets a new proto
+** next time it is loaded. Protos of old versions stay alive (running services
+** may still use them) until cache.clear().
+*/
+static const char *
+push_cachekey(lua_State *L, const char *filename) {
+  struct stat st;
+  if (stat(filename, &st) != 0)
+    return lua_pushstring(L, filename);
+  return lua_pushfstring(L, "%s\n%I:%I", filename,
+    (LUAI_UACINT)st.st_mtime, (LUAI_UACINT)st.st_size);
+}
+
+static int
+loadfile_cached (lua_State *L, const char *filename, const char *mode,
+                 const char *key, int level) {
+  const void * proto = load(key);
   if (proto) {
     lua_clonefunction(L, proto);
     return LUA_OK;
@@ -1180,7 +1192,7 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
     return err;
   }
   proto = lua_topointer(eL, -1);
-  const void * oldv = save(filename, proto);
+  const void * oldv = save(key, proto);
   if (oldv) {
     lua_close(eL);
     lua_clonefunction(L, oldv);
@@ -1192,6 +1204,19 @@ LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
   return LUA_OK;
 }
 
+LUALIB_API int luaL_loadfilex (lua_State *L, const char *filename,
+                                             const char *mode) {
+  int level = cache_level(L);
+  if (level == CACHE_OFF || filename == NULL) {
+    return luaL_loadfilex_(L, filename, mode);
+  }
+  const char * key = push_cachekey(L, filename);
+  int keyidx = lua_gettop(L);
+  int err = loadfile_cached(L, filename, mode, key, level);
+  lua_remove(L, keyidx);
+  return err;
+}
+
 static int
 cache_clear(lua_State *L) {
 	(void)(L);
@@ -466,6 +466,11 @@ LUA_API lua_State * skynet_sig_L;
 LUA_API void (lua_checksig_)(lua_State *L);
 #define lua_checksig(L) if (skynet_sig_L) { lua_checksig_(L); }
 
+/* Add by moon: nanoseconds spent in garbage collection of this state */
+LUA_API lua_Integer (lua_gctime) (lua_State *L);
+/* Add by moon: pay GC work of the next 'kb' KB allocation in advance, see lapi.c */
+LUA_API int (lua_gcidle) (lua_State *L, int kb);
+
 /******************************************************************************
 * Copyright (C) 1994-2018 Lua.org, PUC-Rio.
 *
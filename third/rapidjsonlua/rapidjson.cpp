@@ -110,6 +110,13 @@ int decode(lua_State* L, Stream* s)
 
 static int json_decode(lua_State* L)
 {
+	// json.decode(pointer, size): decode memory without copy to lua string
+	if (lua_type(L, 1) == LUA_TLIGHTUSERDATA) {
+		auto contents = static_cast<const char*>(lua_touserdata(L, 1));
+		auto len = static_cast<size_t>(luaL_checkinteger(L, 2));
+		MemoryStream s(contents, len);
+		return decode(L, &s);
+	}
 	size_t len = 0;
 	auto contents = luaL_checklstring(L, 1, &len);
 	StringStream s(contents);
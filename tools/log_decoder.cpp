@@ -0,0 +1,98 @@
+/*
+    prints binary log files (config "log_binary": true) as text log.
+    usage: log_decoder file [file...]
+*/
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "common/log.hpp"
+
+using namespace moon;
+
+static bool decode(const char* path)
+{
+    std::FILE* fp = std::fopen(path, "rb");
+    if (nullptr == fp)
+    {
+        fprintf(stderr, "%s: can not open\n", path);
+        return false;
+    }
+
+    bool ok = true;
+    char magic[sizeof(log_format::FILE_MAGIC)];
+    if (std::fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, log_format::FILE_MAGIC, sizeof(magic)) != 0)
+    {
+        fprintf(stderr, "%s: not a binary log file\n", path);
+        ok = false;
+    }
+
+    std::unordered_map<uint32_t, std::string> formats;
+    std::vector<char> payload;
+    std::vector<char> line(log_header::MAX_LEN + 8 * 1024 + 2);
+    log_header header;
+    log_format::entry_head head;
+    while (ok && std::fread(&head, 1, sizeof(head), fp) == sizeof(head))
+    {
+        payload.resize(head.size);
+        if (std::fread(payload.data(), 1, head.size, fp) != head.size)
+        {
+            fprintf(stderr, "%s: truncated entry\n", path);
+            ok = false;
+            break;
+        }
+
+        size_t len = 0;
+        switch (head.type)
+        {
+        case log_format::entry_type::format:
+            formats[head.id].assign(payload.data(), payload.size());
+            continue;
+        case log_format::entry_type::text:
+            len = header.format(line.data(), head.time, head.thread, static_cast<LogLevel>(head.level));
+            std::fwrite(line.data(), 1, len, stdout);
+            std::fwrite(payload.data(), 1, payload.size(), stdout);
+            std::fputc('\n', stdout);
+            continue;
+        case log_format::entry_type::packed:
+        {
+            auto it = formats.find(head.id);
+            if (it == formats.end())
+            {
+                fprintf(stderr, "%s: format %u not defined\n", path, head.id);
+                ok = false;
+                break;
+            }
+            len = header.format(line.data(), head.time, head.thread, static_cast<LogLevel>(head.level));
+            len += log_format::format(line.data() + len, line.size() - len - 1, it->second.data(), payload.data(), payload.size());
+            line[len++] = '\n';
+            std::fwrite(line.data(), 1, len, stdout);
+            continue;
+        }
+        default:
+            fprintf(stderr, "%s: unknown entry type %d\n", path, static_cast<int>(head.type));
+            ok = false;
+            break;
+        }
+    }
+    std::fclose(fp);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: log_decoder file [file...]\n");
+        return 1;
+    }
+    int res = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!decode(argv[i]))
+        {
+            res = 1;
+        }
+    }
+    return res;
+}